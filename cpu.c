@@ -40,6 +40,8 @@ char *secstore;
 char *user, *pass;
 char secstorebuf[65536];
 char *geometry;
+int drawnproc = 1;
+int drawbandmin;
 
 extern void	guimain(void);
 
@@ -58,6 +60,48 @@ ending(void)
 	panic("ending");
 }
 
+static int	mntflag;	/* -M: devmnt options for our mounts */
+
+/*
+ * Parse -M's flags: r keeps several reads in flight,
+ * w several writes, and a number from 1 to 15 says how many;
+ * k reads replies in a kproc of the mount's own, and
+ * c caches file data.
+ */
+int
+mountflags(char *s)
+{
+	int flag, n;
+
+	flag = 0;
+	while(*s != 0){
+		switch(*s){
+		case 'r':
+			flag |= MRAH;
+			break;
+		case 'w':
+			flag |= MWB;
+			break;
+		case 'k':
+			flag |= MKPROC;
+			break;
+		case 'c':
+			flag |= MCACHE;
+			break;
+		default:
+			if(*s < '0' || *s > '9')
+				return -1;
+			n = strtol(s, &s, 10);
+			if(n < 1 || n > 15)
+				return -1;
+			flag |= MWIN(n);
+			continue;
+		}
+		s++;
+	}
+	return flag;
+}
+
 int
 mountfactotum(void)
 {
@@ -65,7 +109,7 @@ mountfactotum(void)
 	
 	if((fd = dialfactotum()) < 0)
 		return -1;
-	if(sysmount(fd, -1, "/mnt/factotum", MREPL, "") < 0){
+	if(sysmount(fd, -1, "/mnt/factotum", MREPL|(mntflag&~MCACHE), "") < 0){
 		fprint(2, "mount factotum: %r\n");
 		return -1;
 	}
@@ -243,12 +287,12 @@ ncpu(char *host, char *cmd)
 void
 usage(void)
 {
-	fprint(2, "usage: %s [-9GBO] "
+	fprint(2, "usage: %s [-9GBOZ] "
 		"[-h host] [-u user] [-a authserver] [-s secstore] "
 		"[-e 'crypt hash'] [-k keypattern] "
 		"[-p] [-t timeout] "
 		"[-r root] "
-		"[-g geometry] "
+		"[-g geometry] [-j nproc[,minpixels]] [-M flags] "
 		"[-c cmd ...]\n", argv0);
 	exits("usage");
 }
@@ -279,6 +323,9 @@ cpumain(int argc, char **argv)
 	case 'O':
 		norcpu = 1;
 		break;
+	case 'Z':
+		exportsplice = 1;
+		break;
 	case 'p':
 		aanfilter = 1;
 		break;
@@ -326,6 +373,16 @@ cpumain(int argc, char **argv)
 		 */
 		geometry = EARGF(usage());
 		break;
+	case 'j':
+		s = EARGF(usage());
+		drawnproc = strtol(s, &s, 0);
+		if(*s == ',')
+			drawbandmin = strtol(s+1, nil, 0);
+		break;
+	case 'M':
+		if((mntflag = mountflags(EARGF(usage()))) < 0)
+			usage();
+		break;
 	default:
 		usage();
 	}ARGEND;
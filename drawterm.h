@@ -3,7 +3,10 @@ extern char *secstore;
 extern char *secstorefetch(char *addr, char *owner, char *passwd);
 extern char *authserver;
 extern int exportfs(int, int);
+extern int exportsplice;
+extern int (*exportstats)(char*, int);
 extern int dialfactotum(void);
+extern int mountflags(char*);
 extern char *getuser(void);
 extern void cpumain(int, char**);
 extern char *estrdup(char*);
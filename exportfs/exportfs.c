@@ -21,6 +21,9 @@ int	qidcnt;
 int	qfreecnt;
 int	ncollision;
 int	netfd[2];
+int	exportsplice;	/* set to splice file reads to the transport */
+
+static void	writer(void*);
 
 int
 exportfs(int rfd, int wfd)
@@ -34,15 +37,15 @@ exportfs(int rfd, int wfd)
 	fcalls[Tauth] = Xauth;
 	fcalls[Tflush] = Xflush;
 	fcalls[Tattach] = Xattach;
-	fcalls[Twalk] = Xwalk;
+	fcalls[Twalk] = slave;
 	fcalls[Topen] = slave;
-	fcalls[Tcreate] = Xcreate;
-	fcalls[Tclunk] = Xclunk;
+	fcalls[Tcreate] = slave;
+	fcalls[Tclunk] = slave;
 	fcalls[Tread] = slave;
 	fcalls[Twrite] = slave;
-	fcalls[Tremove] = Xremove;
-	fcalls[Tstat] = Xstat;
-	fcalls[Twstat] = Xwstat;
+	fcalls[Tremove] = slave;
+	fcalls[Tstat] = slave;
+	fcalls[Twstat] = slave;
 
 	srvfd = -1;
 	netfd[0] = rfd;
@@ -62,6 +65,9 @@ exportfs(int rfd, int wfd)
 	fmtinstall('F', fcallfmt);
 
 	initroot();
+	exportstats = exportfsstats;
+	if(kproc("exportwriter", writer, nil) < 0)
+		fatal("kproc");
 
 	DEBUG(DFD, "exportfs: %s\n", buf);
 
@@ -99,8 +105,8 @@ if(0) iprint("<- %F\n", &r->work);
 void
 reply(Fcall *r, Fcall *t, char *err)
 {
-	uchar *data;
-	int m, n;
+	Rbuf *b;
+	int n;
 
 	t->tag = r->tag;
 	t->fid = r->fid;
@@ -114,15 +120,167 @@ reply(Fcall *r, Fcall *t, char *err)
 if(0) iprint("-> %F\n", t);
 	DEBUG(DFD, "\t%F\n", t);
 
-	data = malloc(messagesize);	/* not mallocz; no need to clear */
-	if(data == nil)
-		fatal(Enomem);
-	n = convS2M(t, data, messagesize);
-	if((m=write(netfd[1], data, n))!=n){
+	b = getrbuf();
+	n = convS2M(t, b->data, messagesize);
+	if(n == 0)
+		fatal("convS2M");
+	b->n = n;
+	sendrbuf(b);
+}
+
+/*
+ * Replies are encoded into Rbufs, recycled through
+ * rbufs.free, and written in order by the writer
+ * kproc.  Small replies that queue up while it writes
+ * go out together in one write.
+ */
+static struct
+{
+	Lock	lk;
+	Rbuf	*free;
+	int	nfree;
+	Rbuf	*q;
+	Rbuf	*ql;
+	int	sleeping;
+	QLock	wlk;		/* writes to netfd[1] */
+} rbufs;
+
+Rbuf*
+getrbuf(void)
+{
+	Rbuf *b;
+
+	lock(&rbufs.lk);
+	if((b = rbufs.free) != nil){
+		rbufs.free = b->next;
+		rbufs.nfree--;
+	}
+	unlock(&rbufs.lk);
+	if(b == nil)
+		b = emallocz(sizeof(Rbuf)+messagesize);
+	b->next = nil;
+	b->n = 0;
+	return b;
+}
+
+void
+putrbuf(Rbuf *b)
+{
+	lock(&rbufs.lk);
+	if(rbufs.nfree < Nrbuf){
+		b->next = rbufs.free;
+		rbufs.free = b;
+		rbufs.nfree++;
+		b = nil;
+	}
+	unlock(&rbufs.lk);
+	free(b);
+}
+
+void
+sendrbuf(Rbuf *b)
+{
+	int wake;
+
+	b->next = nil;
+	lock(&rbufs.lk);
+	if(rbufs.q == nil)
+		rbufs.q = b;
+	else
+		rbufs.ql->next = b;
+	rbufs.ql = b;
+	wake = rbufs.sleeping;
+	rbufs.sleeping = 0;
+	unlock(&rbufs.lk);
+	if(wake)
+		rendezvous(&rbufs, nil);
+}
+
+static void
+flushreplies(uchar *buf, int n)
+{
+	int m;
+
+	if(n == 0)
+		return;
+	qlock(&rbufs.wlk);
+	if((m=write(netfd[1], buf, n))!=n){
 		iprint("wrote %d got %d (%r)\n", n, m);
 		fatal("write");
 	}
-	free(data);
+	nwrites++;
+	qunlock(&rbufs.wlk);
+}
+
+/*
+ * Have the kernel send the Rread for tag with up to n
+ * bytes of fd at off, moving the data from file to
+ * transport without copying it through here.  Returns
+ * -1 if it can't, and the caller replies as usual.
+ */
+long
+splicereply(int fd, int tag, long n, vlong off)
+{
+	char err[ERRMAX];
+	long r;
+
+	if(!exportsplice)
+		return -1;
+	qlock(&rbufs.wlk);
+	werrstr("");
+	r = sendrread(netfd[1], fd, tag, n, off);
+	if(r >= 0)
+		nsplices++;
+	qunlock(&rbufs.wlk);
+	if(r < 0){
+		rerrstr(err, sizeof err);
+		if(err[0] != 0)
+			fatal("sendrread: %s", err);
+	}
+	return r;
+}
+
+static void
+writer(void *a)
+{
+	Rbuf *b, *next;
+	uchar *buf;
+	int n, nbuf;
+
+	USED(a);
+	nbuf = messagesize;
+	buf = emallocz(nbuf);
+	for(;;){
+		lock(&rbufs.lk);
+		b = rbufs.q;
+		rbufs.q = nil;
+		if(b == nil){
+			rbufs.sleeping = 1;
+			unlock(&rbufs.lk);
+			while(rendezvous(&rbufs, nil) == (void*)~0)
+				;
+			continue;
+		}
+		unlock(&rbufs.lk);
+
+		n = 0;
+		for(; b != nil; b = next){
+			next = b->next;
+			nreplies++;
+			if(b->n > Nsmallreply || n+b->n > nbuf){
+				flushreplies(buf, n);
+				n = 0;
+			}
+			if(b->n > Nsmallreply)
+				flushreplies(b->data, b->n);
+			else {
+				memmove(buf+n, b->data, b->n);
+				n += b->n;
+			}
+			putrbuf(b);
+		}
+		flushreplies(buf, n);
+	}
 }
 
 Fid *
@@ -130,19 +288,24 @@ getfid(int nr)
 {
 	Fid *f;
 
+	qlock(&filelk);
 	for(f = fidhash(nr); f; f = f->next)
 		if(f->nr == nr)
-			return f;
+			break;
+	qunlock(&filelk);
 
-	return 0;
+	return f;
 }
 
+static void freefilelocked(File*);
+
 int
 freefid(int nr)
 {
 	Fid *f, **l;
 	char buf[128];
 
+	qlock(&filelk);
 	l = &fidhash(nr);
 	for(f = *l; f; f = f->next) {
 		if(f->nr == nr) {
@@ -152,30 +315,54 @@ freefid(int nr)
 				psmap[f->mid] = 0;
 			}
 			if(f->f) {
-				freefile(f->f);
+				freefilelocked(f->f);
 				f->f = nil;
 			}
+			freerah(f);
 			*l = f->next;
 			f->next = fidfree;
 			fidfree = f;
+			qunlock(&filelk);
 			return 1;
 		}
 		l = &f->next;
 	}
+	qunlock(&filelk);
 
 	return 0;	
 }
 
+/*
+ * Called with filelk held.
+ */
+void
+freerah(Fid *f)
+{
+	Rah *a;
+
+	if((a = f->rah) == nil)
+		return;
+	DEBUG(DFD, "\trah: fid %d hits %lud misses %lud\n", f->nr, a->hits, a->misses);
+	rahhits += a->hits;
+	rahmisses += a->misses;
+	free(a->data);
+	free(a);
+	f->rah = nil;
+}
+
 Fid *
 newfid(int nr)
 {
 	Fid *new, **l;
 	int i;
 
+	qlock(&filelk);
 	l = &fidhash(nr);
 	for(new = *l; new; new = new->next)
-		if(new->nr == nr)
+		if(new->nr == nr){
+			qunlock(&filelk);
 			return 0;
+		}
 
 	if(fidfree == 0) {
 		fidfree = emallocz(sizeof(Fid) * Fidchunk);
@@ -195,35 +382,42 @@ newfid(int nr)
 	new->nr = nr;
 	new->fid = -1;
 	new->mid = 0;
+	qunlock(&filelk);
 
 	return new;	
 }
 
+/*
+ * Slaves free their Fsrpcs with putsbuf, which wakes the
+ * 9P reader if it is waiting in getsbuf for one.
+ */
+static struct
+{
+	Lock	lk;
+	int	sleeping;
+} sbufs;
+
 Fsrpc *
 getsbuf(void)
 {
-	static int ap;
-	int look, rounds;
 	Fsrpc *wb;
-	int small_instead_of_fast = 1;
 
-	if(small_instead_of_fast)
-		ap = 0;	/* so we always start looking at the beginning and reuse buffers */
-
-	for(rounds = 0; rounds < 10; rounds++) {
-		for(look = 0; look < Nr_workbufs; look++) {
-			if(++ap == Nr_workbufs)
-				ap = 0;
-			if(Workq[ap].busy == 0)
+	/* all buffers busy: stop reading until a slave finishes one */
+	for(;;) {
+		lock(&sbufs.lk);
+		/* always start looking at the beginning and reuse buffers */
+		for(wb = Workq; wb < &Workq[Nr_workbufs]; wb++)
+			if(wb->busy == 0)
 				break;
-		}
-
-		if(look == Nr_workbufs){
-			sleep(10 * rounds);
+		if(wb == &Workq[Nr_workbufs]){
+			sbufs.sleeping = 1;
+			unlock(&sbufs.lk);
+			while(rendezvous(&sbufs, nil) == (void*)~0)
+				;
 			continue;
 		}
+		unlock(&sbufs.lk);
 
-		wb = &Workq[ap];
 		wb->pid = 0;
 		wb->canint = 0;
 		wb->flushtag = NOTAG;
@@ -232,12 +426,32 @@ getsbuf(void)
 			wb->buf = emallocz(messagesize);
 		return wb;
 	}
-	fatal("No more work buffers");
-	return nil;
+}
+
+void
+putsbuf(Fsrpc *wb)
+{
+	int wake;
+
+	lock(&sbufs.lk);
+	wb->busy = 0;
+	wake = sbufs.sleeping;
+	sbufs.sleeping = 0;
+	unlock(&sbufs.lk);
+	if(wake)
+		rendezvous(&sbufs, nil);
 }
 
 void
 freefile(File *f)
+{
+	qlock(&filelk);
+	freefilelocked(f);
+	qunlock(&filelk);
+}
+
+static void
+freefilelocked(File *f)
 {
 	File *parent, *child;
 
@@ -282,6 +496,7 @@ file(File *parent, char *name)
 	if(dir == nil)
 		return nil;
 
+	qlock(&filelk);
 	for(f = parent->child; f; f = f->childlist)
 		if(strcmp(name, f->name) == 0)
 			break;
@@ -304,6 +519,7 @@ file(File *parent, char *name)
 	f->qid.path = f->qidt->uniqpath;
 
 	f->inval = 0;
+	qunlock(&filelk);
 
 	free(dir);
 
@@ -354,6 +570,7 @@ makepath(File *p, char *name)
 	int i, n;
 	char *c, *s, *path, *seg[256];
 
+	qlock(&filelk);
 	seg[0] = name;
 	n = strlen(name)+2;
 	for(i = 1; i < 256 && p; i++, p = p->parent){
@@ -373,6 +590,7 @@ makepath(File *p, char *name)
 	while(s[-1] == '/')
 		s--;
 	*s = '\0';
+	qunlock(&filelk);
 
 	return path;
 }
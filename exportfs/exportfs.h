@@ -14,15 +14,19 @@ typedef struct Fid Fid;
 typedef struct File File;
 typedef struct Proc Proc;
 typedef struct Qidtab Qidtab;
+typedef struct Rbuf Rbuf;
+typedef struct Rah Rah;
 
 struct Fsrpc
 {
 	int	busy;		/* Work buffer has pending rpc to service */
-	int	pid;		/* Pid of slave process executing the rpc */
+	int	pid;		/* Pid of slave process executing the rpc, -1 while queued */
 	int	canint;		/* Interrupt gate */
 	int	flushtag;	/* Tag on which to reply to flush */
 	Fcall work;		/* Plan 9 incoming Fcall */
 	uchar	*buf;	/* Data buffer */
+	ulong	t0;		/* ticks when queued for a slave */
+	Fsrpc	*fnext;		/* waiting behind others on its fid */
 };
 
 struct Fid
@@ -33,6 +37,26 @@ struct Fid
 	int	nr;		/* fid number */
 	int	mid;		/* Mount id */
 	Fid	*next;		/* hash link */
+	Rah	*rah;		/* read-ahead, if open on a regular file */
+};
+
+/*
+ * Data read ahead on a fid open on a regular host file
+ * once it is read sequentially, good while the File's
+ * wgen is unchanged.
+ */
+struct Rah
+{
+	QLock	lk;
+	vlong	next;		/* offset a sequential read starts at */
+	int	seq;		/* sequential reads in a row */
+	vlong	off;		/* data holds [off, off+n) */
+	int	n;
+	int	gen;
+	uchar	*data;
+	int	size;
+	ulong	hits;
+	ulong	misses;
 };
 
 struct File
@@ -42,6 +66,7 @@ struct File
 	Qid	qid;
 	Qidtab	*qidt;
 	int	inval;
+	int	wgen;		/* bumped by writes, for Rah */
 	File	*parent;
 	File	*child;
 	File	*childlist;
@@ -52,6 +77,14 @@ struct Proc
 	int	pid;
 	int	busy;
 	Proc	*next;
+	Proc	*idle;		/* next idle slave */
+};
+
+struct Rbuf
+{
+	Rbuf	*next;
+	int	n;		/* length of the message in data */
+	uchar	data[1];	/* messagesize bytes */
 };
 
 struct Qidtab
@@ -68,11 +101,14 @@ enum
 {
 	MAXPROC		= 50,
 	FHASHSIZE	= 64,
-	Nr_workbufs 	= 50,
+	Nr_workbufs 	= 2*MAXPROC,	/* room to queue behind blocked slaves */
 	Fidchunk	= 1000,
 	Npsmpt		= 32,
 	Nqidbits		= 5,
 	Nqidtab		= (1<<Nqidbits),
+	Nrbuf		= 2*Nr_workbufs,	/* free reply buffers kept */
+	Nsmallreply	= 1024,		/* replies the writer coalesces */
+	Nrah		= 4,		/* iounits read ahead */
 };
 
 #define Enomem Exenomem
@@ -99,11 +135,17 @@ Extern File	*root;
 Extern File	*psmpt;
 Extern Fid	**fhash;
 Extern Fid	*fidfree;
+Extern QLock	filelk;		/* fhash, fidfree, the File tree and qidtab */
 Extern Proc	*Proclist;
 Extern char	psmap[Npsmpt];
 Extern Qidtab	*qidtab[Nqidtab];
 Extern ulong	messagesize;
 Extern int		srvfd;
+Extern ulong	nreplies;
+Extern ulong	nwrites;
+Extern ulong	nsplices;
+Extern ulong	rahhits;
+Extern ulong	rahmisses;
 
 /* File system protocol service procedures */
 void Xattach(Fsrpc*);
@@ -120,10 +162,15 @@ void Xwstat(Fsrpc*);
 void slave(Fsrpc*);
 
 void	reply(Fcall*, Fcall*, char*);
+Rbuf	*getrbuf(void);
+void	putrbuf(Rbuf*);
+void	sendrbuf(Rbuf*);
+long	splicereply(int, int, long, vlong);
 Fid 	*getfid(int);
 int	freefid(int);
 Fid	*newfid(int);
 Fsrpc	*getsbuf(void);
+void	putsbuf(Fsrpc*);
 void	initroot(void);
 void	fatal(char*, ...);
 char*	makepath(File*, char*);
@@ -132,7 +179,11 @@ void	freefile(File*);
 void	slaveopen(Fsrpc*);
 void	slaveread(Fsrpc*);
 void	slavewrite(Fsrpc*);
+long	rahread(Fid*, uchar*, long, vlong);
+void	rahfill(Fid*);
+void	freerah(Fid*);
 void	blockingslave(void*);
+int	exportfsstats(char*, int);
 void	reopen(Fid *f);
 void	noteproc(int, char*);
 void	flushaction(void*, char*);
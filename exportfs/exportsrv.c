@@ -14,6 +14,13 @@ char Enopsmt[] = "Out of pseudo mount points";
 char Enomem[] = "No memory";
 char Eversion[] = "Bad 9P2000 version";
 
+enum
+{
+	Rreadhdr	= BIT32SZ+BIT8SZ+BIT16SZ+BIT32SZ,	/* size[4] Rread tag[2] count[4] */
+};
+
+static int	poolflush(Fsrpc*, int);
+
 void*
 emallocz(uint n)
 {
@@ -62,16 +69,16 @@ Xflush(Fsrpc *t)
 	e = &Workq[Nr_workbufs];
 
 	for(w = Workq; w < e; w++) {
-		if(w->work.tag == t->work.oldtag) {
+		if(w != t && w->busy && w->work.tag == t->work.oldtag) {
 			DEBUG(DFD, "\tQ busy %d pid %d can %d\n", w->busy, w->pid, w->canint);
-			if(w->busy && w->pid) {
-				w->flushtag = t->work.tag;
+			if(poolflush(w, t->work.tag)) {
 				DEBUG(DFD, "\tset flushtag %d\n", t->work.tag);
 			//	if(w->canint)
 			//		postnote(PNPROC, w->pid, "flush");
 				t->busy = 0;
 				return;
 			}
+			break;
 		}
 	}
 
@@ -125,8 +132,10 @@ Xattach(Fsrpc *t)
 		f->mid = i;
 */
 	}else{
+		qlock(&filelk);
 		f->f = root;
 		f->f->ref++;
+		qunlock(&filelk);
 	}
 
 	rhdr.qid = f->f->qid;
@@ -151,8 +160,10 @@ clonefid(Fid *f, int new)
 		if(n == 0)
 			fatal("inconsistent fids2");
 	}
+	qlock(&filelk);
 	n->f = f->f;
 	n->f->ref++;
+	qunlock(&filelk);
 	return n;
 }
 
@@ -168,7 +179,6 @@ Xwalk(Fsrpc *t)
 	f = getfid(t->work.fid);
 	if(f == 0) {
 		reply(&t->work, &rhdr, Ebadfid);
-		t->busy = 0;
 		return;
 	}
 
@@ -191,8 +201,10 @@ Xwalk(Fsrpc *t)
 				e = Exmnt;
 				break;
 			}
+			qlock(&filelk);
 			wf = f->f->parent;
 			wf->ref++;
+			qunlock(&filelk);
 			goto Accept;
 		}
 	
@@ -214,7 +226,6 @@ Xwalk(Fsrpc *t)
 	if(rhdr.nwqid > 0)
 		e = nil;
 	reply(&t->work, &rhdr, e);
-	t->busy = 0;
 }
 
 void
@@ -226,7 +237,6 @@ Xclunk(Fsrpc *t)
 	f = getfid(t->work.fid);
 	if(f == 0) {
 		reply(&t->work, &rhdr, Ebadfid);
-		t->busy = 0;
 		return;
 	}
 
@@ -235,7 +245,6 @@ Xclunk(Fsrpc *t)
 
 	freefid(t->work.fid);
 	reply(&t->work, &rhdr, 0);
-	t->busy = 0;
 }
 
 void
@@ -251,7 +260,6 @@ Xstat(Fsrpc *t)
 	f = getfid(t->work.fid);
 	if(f == 0) {
 		reply(&t->work, &rhdr, Ebadfid);
-		t->busy = 0;
 		return;
 	}
 	if(f->fid >= 0)
@@ -265,11 +273,12 @@ Xstat(Fsrpc *t)
 	if(d == nil) {
 		errstr(err, sizeof err);
 		reply(&t->work, &rhdr, err);
-		t->busy = 0;
 		return;
 	}
 
+	qlock(&filelk);
 	d->qid.path = f->f->qidt->uniqpath;
+	qunlock(&filelk);
 	s = sizeD2M(d);
 	statbuf = emallocz(s);
 	s = convD2M(d, statbuf, s);
@@ -278,7 +287,6 @@ Xstat(Fsrpc *t)
 	rhdr.stat = statbuf;
 	reply(&t->work, &rhdr, 0);
 	free(statbuf);
-	t->busy = 0;
 }
 
 static int
@@ -303,7 +311,6 @@ Xcreate(Fsrpc *t)
 	f = getfid(t->work.fid);
 	if(f == 0) {
 		reply(&t->work, &rhdr, Ebadfid);
-		t->busy = 0;
 		return;
 	}
 	
@@ -314,7 +321,6 @@ Xcreate(Fsrpc *t)
 	if(f->fid < 0) {
 		errstr(err, sizeof err);
 		reply(&t->work, &rhdr, err);
-		t->busy = 0;
 		return;
 	}
 
@@ -322,7 +328,6 @@ Xcreate(Fsrpc *t)
 	if(nf == 0) {
 		errstr(err, sizeof err);
 		reply(&t->work, &rhdr, err);
-		t->busy = 0;
 		return;
 	}
 
@@ -332,7 +337,6 @@ Xcreate(Fsrpc *t)
 	rhdr.qid = f->f->qid;
 	rhdr.iounit = getiounit(f->fid);
 	reply(&t->work, &rhdr, 0);
-	t->busy = 0;
 }
 
 void
@@ -345,7 +349,6 @@ Xremove(Fsrpc *t)
 	f = getfid(t->work.fid);
 	if(f == 0) {
 		reply(&t->work, &rhdr, Ebadfid);
-		t->busy = 0;
 		return;
 	}
 
@@ -355,7 +358,6 @@ Xremove(Fsrpc *t)
 		free(path);
 		errstr(err, sizeof err);
 		reply(&t->work, &rhdr, err);
-		t->busy = 0;
 		return;
 	}
 	free(path);
@@ -366,7 +368,6 @@ Xremove(Fsrpc *t)
 	freefid(t->work.fid);
 
 	reply(&t->work, &rhdr, 0);
-	t->busy = 0;
 }
 
 void
@@ -382,14 +383,12 @@ Xwstat(Fsrpc *t)
 	f = getfid(t->work.fid);
 	if(f == 0) {
 		reply(&t->work, &rhdr, Ebadfid);
-		t->busy = 0;
 		return;
 	}
 	strings = emallocz(t->work.nstat);	/* ample */
 	if(convM2D(t->work.stat, t->work.nstat, &d, strings) <= BIT16SZ){
 		rerrstr(err, sizeof err);
 		reply(&t->work, &rhdr, err);
-		t->busy = 0;
 		free(strings);
 		return;
 	}
@@ -407,56 +406,325 @@ Xwstat(Fsrpc *t)
 	}
 	else {
 		/* wstat may really be rename */
+		qlock(&filelk);
+		f->f->wgen++;
 		if(strcmp(d.name, f->f->name)!=0 && strcmp(d.name, "")!=0){
 			free(f->f->name);
 			f->f->name = estrdup(d.name);
 		}
+		qunlock(&filelk);
 		reply(&t->work, &rhdr, 0);
 	}
 	free(strings);
-	t->busy = 0;
 }
 
-void
-slave(Fsrpc *f)
+/*
+ * All but Tversion, Tauth, Tattach and Tflush are served by
+ * up to MAXPROC slaves.  slave queues the request in pool.q,
+ * which can't overflow since there are only Nr_workbufs
+ * Fsrpcs, and wakes an idle slave or starts a new one.  With
+ * all MAXPROC busy the request waits for the first to finish.
+ *
+ * Requests on one fid keep their order: Treads, Twrites and
+ * Tstats may run together, anything else runs alone (a
+ * Twstat may truncate or rename the file), and a request
+ * that can't start yet waits in its fid's Fidq, as does
+ * everything after it.  A Twalk also holds its newfid.
+ */
+typedef struct Fidq Fidq;
+struct Fidq
 {
-	Proc *p;
-	int pid;
-	static int nproc;
+	int	nr;
+	int	nbusy;		/* requests on the fid in slaves */
+	int	excl;		/* one of them must run alone */
+	Fsrpc	*wait;
+	Fsrpc	*waitl;
+	Fidq	*next;
+};
+
+static struct
+{
+	Lock	lk;
+	Fsrpc	*q[Nr_workbufs];
+	int	qi;		/* oldest request */
+	int	qn;
+	Proc	*idle;		/* slaves waiting for work */
+	int	nidle;
+	int	nproc;
+	int	nblock;		/* slaves in requests that may block */
+	Fidq	*fidq[FHASHSIZE];
+
+	int	maxq;
+	ulong	nrpc;
+	uvlong	ms;		/* total queued plus service time */
+	ulong	maxms;
+} pool;
 
-	for(;;) {
-		for(p = Proclist; p; p = p->next) {
-			if(p->busy == 0) {
-				f->pid = p->pid;
-				p->busy = 1;
-				pid = (uintptr)rendezvous((void*)(uintptr)p->pid, f);
-				if(pid != p->pid)
-					fatal("rendezvous sync fail");
-				return;
-			}	
+static int
+shared(Fsrpc *r)
+{
+	switch(r->work.type){
+	case Tread:
+	case Twrite:
+	case Tstat:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Reads, writes and opens may wait on the file for
+ * as long as it likes: a pipe, a tty, a network line.
+ * They get at most MAXPROC-1 slaves, leaving one for
+ * everything else.
+ */
+static int
+blocking(Fsrpc *r)
+{
+	switch(r->work.type){
+	case Tread:
+	case Twrite:
+	case Topen:
+		return 1;
+	}
+	return 0;
+}
+
+static int
+hasnewfid(Fsrpc *r)
+{
+	return r->work.type == Twalk && r->work.newfid != r->work.fid;
+}
+
+static Fidq*
+getfidq(int nr)
+{
+	Fidq *q;
+
+	for(q = pool.fidq[(uint)nr%FHASHSIZE]; q != nil; q = q->next)
+		if(q->nr == nr)
+			return q;
+	q = emallocz(sizeof(Fidq));
+	q->nr = nr;
+	q->next = pool.fidq[(uint)nr%FHASHSIZE];
+	pool.fidq[(uint)nr%FHASHSIZE] = q;
+	return q;
+}
+
+static void
+putfidq(Fidq *q)
+{
+	Fidq **l;
+
+	if(q->nbusy > 0 || q->wait != nil)
+		return;
+	for(l = &pool.fidq[(uint)q->nr%FHASHSIZE]; *l != nil; l = &(*l)->next)
+		if(*l == q){
+			*l = q->next;
+			break;
 		}
+	free(q);
+}
+
+static int
+canrun(Fidq *q, Fsrpc *r)
+{
+	return !q->excl && (shared(r) || q->nbusy == 0);
+}
+
+/*
+ * Queue r for a slave.  Returns the pid of the idle
+ * slave to wake, 0 to start one, or -1 for neither.
+ */
+static int
+poolput(Fsrpc *r)
+{
+	Proc *p;
+
+	pool.q[(pool.qi+pool.qn)%Nr_workbufs] = r;
+	if(++pool.qn > pool.maxq)
+		pool.maxq = pool.qn;
+	if((p = pool.idle) != nil){
+		pool.idle = p->idle;
+		pool.nidle--;
+		p->busy = 1;
+		return p->pid;
+	}
+	if(pool.nproc >= MAXPROC)
+		return -1;
+	pool.nproc++;
+	return 0;
+}
+
+/*
+ * Take the i'th oldest request off the ring.
+ */
+static void
+pooldel(int i)
+{
+	int j;
+
+	for(; i > 0; i--){
+		j = (pool.qi+i)%Nr_workbufs;
+		pool.q[j] = pool.q[(j+Nr_workbufs-1)%Nr_workbufs];
+	}
+	pool.qi = (pool.qi+1)%Nr_workbufs;
+	pool.qn--;
+}
 
-		if(++nproc > MAXPROC)
-			fatal("too many procs");
+/*
+ * The oldest request a slave may start, or nil.
+ * Blocking ones are passed over while they hold
+ * all but the last slave.
+ */
+static Fsrpc*
+poolget(void)
+{
+	Fsrpc *r;
+	int i;
+
+	for(i = 0; i < pool.qn; i++){
+		r = pool.q[(pool.qi+i)%Nr_workbufs];
+		if(blocking(r)){
+			if(pool.nblock >= MAXPROC-1)
+				continue;
+			pool.nblock++;
+		}
+		pooldel(i);
+		return r;
+	}
+	return nil;
+}
 
+static void
+poolwake(int pid)
+{
+	if(pid > 0)
+		rendezvous((void*)(uintptr)pid, nil);
+	else if(pid == 0){
 		pid = kproc("slave", blockingslave, nil);
 		DEBUG(DFD, "slave pid %d\n", pid);
 		if(pid == -1)
 			fatal("kproc");
+	}
+}
 
-		p = malloc(sizeof(Proc));
-		if(p == 0)
-			fatal("out of memory");
+/*
+ * Start what waits on q and can run now,
+ * adding the slaves to wake to run.
+ */
+static int
+fidstart(Fidq *q, int *run, int nrun)
+{
+	Fsrpc *r;
+
+	while((r = q->wait) != nil && canrun(q, r)){
+		q->wait = r->fnext;
+		q->nbusy++;
+		if(!shared(r))
+			q->excl = 1;
+		run[nrun++] = poolput(r);
+	}
+	putfidq(q);
+	return nrun;
+}
 
-		p->busy = 0;
-		p->pid = pid;
-		p->next = Proclist;
-		Proclist = p;
+/*
+ * A request on q is done: start what waited behind it.
+ */
+static int
+fidrelease(Fidq *q, int excl, int *run, int nrun)
+{
+	q->nbusy--;
+	if(excl)
+		q->excl = 0;
+	return fidstart(q, run, nrun);
+}
+
+/*
+ * Flush r on behalf of the Tflush with tag.  A request still
+ * queued, on the ring or behind others on its fid, is dropped
+ * and 0 returned for Xflush to answer at once.  One a slave is
+ * running gets its flushtag and 1 is returned: the slave
+ * answers once it is done.  So does one that has finished but
+ * not yet been freed, as the slave hasn't checked for a flush.
+ */
+static int
+poolflush(Fsrpc *r, int tag)
+{
+	Fsrpc **l, *w;
+	Fidq *q;
+	int i, n, run[2*Nr_workbufs];
+
+	lock(&pool.lk);
+	if(r->pid == 0){
+		unlock(&pool.lk);
+		return 0;
+	}
+	if(r->pid > 0){
+		r->flushtag = tag;
+		unlock(&pool.lk);
+		return 1;
+	}
+	n = 0;
+	q = getfidq(r->work.fid);
+	for(i = 0; i < pool.qn; i++)
+		if(pool.q[(pool.qi+i)%Nr_workbufs] == r)
+			break;
+	if(i < pool.qn){
+		pooldel(i);
+		n = fidrelease(q, !shared(r), run, n);
+	}else{
+		w = nil;
+		for(l = &q->wait; *l != r; l = &(*l)->fnext)
+			w = *l;
+		*l = r->fnext;
+		if(q->waitl == r)
+			q->waitl = w;
+		n = fidstart(q, run, n);
+	}
+	if(hasnewfid(r))
+		n = fidrelease(getfidq(r->work.newfid), 1, run, n);
+	unlock(&pool.lk);
+	for(i = 0; i < n; i++)
+		poolwake(run[i]);
+	DEBUG(DFD, "\tflushed queued %F\n", &r->work);
+	r->pid = 0;
+	putsbuf(r);
+	return 0;
+}
 
-DEBUG(DFD, "parent %d rendez\n", pid);
-		rendezvous((void*)(uintptr)pid, p);
-DEBUG(DFD, "parent %d went\n", pid);
+void
+slave(Fsrpc *f)
+{
+	Fidq *q;
+	int pid;
+
+	f->pid = -1;
+	f->t0 = ticks();
+	f->fnext = nil;
+	lock(&pool.lk);
+	if(hasnewfid(f)){
+		q = getfidq(f->work.newfid);
+		q->nbusy++;
+		q->excl = 1;
 	}
+	q = getfidq(f->work.fid);
+	if(q->wait != nil || !canrun(q, f)){
+		if(q->wait == nil)
+			q->wait = f;
+		else
+			q->waitl->fnext = f;
+		q->waitl = f;
+		unlock(&pool.lk);
+		return;
+	}
+	q->nbusy++;
+	if(!shared(f))
+		q->excl = 1;
+	pid = poolput(f);
+	unlock(&pool.lk);
+	poolwake(pid);
 }
 
 void
@@ -465,28 +733,58 @@ blockingslave(void *x)
 	Fsrpc *p;
 	Fcall rhdr;
 	Proc *m;
-	int pid;
+	int i, n, pid, excl, blk, fid, newfid, flushtag, run[2*Nr_workbufs];
+	ulong t;
 
 	USED(x);
 
 	notify(flushaction);
 
 	pid = getpid();
+	m = emallocz(sizeof(Proc));
+	m->pid = pid;
+	m->busy = 1;
+	lock(&pool.lk);
+	m->next = Proclist;
+	Proclist = m;
+	unlock(&pool.lk);
 
-DEBUG(DFD, "blockingslave %d rendez\n", pid);
-	m = (Proc*)rendezvous((void*)(uintptr)pid, 0);
-DEBUG(DFD, "blockingslave %d rendez got %p\n", pid, m);
-	
 	for(;;) {
-		p = rendezvous((void*)(uintptr)pid, (void*)(uintptr)pid);
-		if((uintptr)p == ~(uintptr)0)			/* Interrupted */
+		lock(&pool.lk);
+		if((p = poolget()) == nil){
+			m->busy = 0;
+			m->idle = pool.idle;
+			pool.idle = m;
+			pool.nidle++;
+			unlock(&pool.lk);
+			while(rendezvous((void*)(uintptr)pid, nil) == (void*)~0)	/* Interrupted */
+				;
 			continue;
+		}
+		p->pid = pid;
+		unlock(&pool.lk);
+		blk = blocking(p);
+		fid = p->work.fid;
+		newfid = hasnewfid(p) ? p->work.newfid : -1;
+		excl = !shared(p);
 
 		DEBUG(DFD, "\tslave: %d %F b %d p %d\n", pid, &p->work, p->busy, p->pid);
 		if(p->flushtag != NOTAG)
 			goto flushme;
 
 		switch(p->work.type) {
+		case Twalk:
+			Xwalk(p);
+			break;
+
+		case Topen:
+			slaveopen(p);
+			break;
+
+		case Tcreate:
+			Xcreate(p);
+			break;
+
 		case Tread:
 			slaveread(p);
 			break;
@@ -495,24 +793,68 @@ DEBUG(DFD, "blockingslave %d rendez got %p\n", pid, m);
 			slavewrite(p);
 			break;
 
-		case Topen:
-			slaveopen(p);
+		case Tclunk:
+			Xclunk(p);
+			break;
+
+		case Tremove:
+			Xremove(p);
+			break;
+
+		case Tstat:
+			Xstat(p);
+			break;
+
+		case Twstat:
+			Xwstat(p);
 			break;
 
 		default:
 			reply(&p->work, &rhdr, "exportfs: slave type error");
 		}
-		if(p->flushtag != NOTAG) {
 flushme:
+		t = ticks() - p->t0;
+		lock(&pool.lk);
+		/* Xflush sets flushtag while pid is ours */
+		flushtag = p->flushtag;
+		p->pid = 0;
+		if(blk)
+			pool.nblock--;
+		pool.nrpc++;
+		pool.ms += t;
+		if(t > pool.maxms)
+			pool.maxms = t;
+		n = fidrelease(getfidq(fid), excl, run, 0);
+		if(newfid != -1)
+			n = fidrelease(getfidq(newfid), 1, run, n);
+		unlock(&pool.lk);
+		if(flushtag != NOTAG) {
 			p->work.type = Tflush;
-			p->work.tag = p->flushtag;
+			p->work.tag = flushtag;
 			reply(&p->work, &rhdr, 0);
 		}
-		p->busy = 0;
-		m->busy = 0;
+		putsbuf(p);
+		for(i = 0; i < n; i++)
+			poolwake(run[i]);
 	}
 }
 
+int
+exportfsstats(char *buf, int n)
+{
+	ulong avg;
+
+	lock(&pool.lk);
+	avg = 0;
+	if(pool.nrpc > 0)
+		avg = pool.ms*1000/pool.nrpc;
+	n = snprint(buf, n, "exportfs slaves %d idle %d queue %d max %d rpc %lud ms %lud.%.3lud max %lud replies %lud writes %lud spliced %lud rah hits %lud misses %lud\n",
+		pool.nproc, pool.nidle, pool.qn, pool.maxq, pool.nrpc, avg/1000, avg%1000, pool.maxms,
+		nreplies, nwrites, nsplices, rahhits, rahmisses);
+	unlock(&pool.lk);
+	return n;
+}
+
 int
 openmount(int sfd)
 {
@@ -542,6 +884,9 @@ slaveopen(Fsrpc *p)
 	
 	path = makepath(f->f, "");
 	DEBUG(DFD, "\topen: %s %d\n", path, work->mode);
+	qlock(&filelk);
+	freerah(f);
+	qunlock(&filelk);
 
 	p->canint = 1;
 	if(p->flushtag != NOTAG){
@@ -558,7 +903,11 @@ slaveopen(Fsrpc *p)
 		reply(work, &rhdr, err);
 		return;
 	}
+	qlock(&filelk);
 	f->f->qid = d->qid;
+	if(work->mode & OTRUNC)
+		f->f->wgen++;
+	qunlock(&filelk);
 	free(d);
 	if(f->f->qid.type & QTMOUNT){	/* fork new exportfs for this */
 		f->fid = openmount(f->fid);
@@ -568,6 +917,13 @@ slaveopen(Fsrpc *p)
 
 	DEBUG(DFD, "\topen: fd %d\n", f->fid);
 	f->mode = work->mode;
+	/* reading a device consumes its data: only read ahead on regular files */
+	if(regularfile(f->fid) > 0){
+		qlock(&filelk);
+		f->rah = emallocz(sizeof(Rah));
+		f->rah->next = -1;
+		qunlock(&filelk);
+	}
 	rhdr.iounit = getiounit(f->fid);
 	rhdr.qid = f->f->qid;
 	reply(work, &rhdr, 0);
@@ -579,7 +935,9 @@ slaveread(Fsrpc *p)
 	Fid *f;
 	int n, r;
 	Fcall *work, rhdr;
-	char *data, err[ERRMAX];
+	char err[ERRMAX];
+	Rbuf *b;
+	uchar *h;
 
 	work = &p->work;
 
@@ -593,15 +951,23 @@ slaveread(Fsrpc *p)
 	p->canint = 1;
 	if(p->flushtag != NOTAG)
 		return;
-	data = malloc(n);
-	if(data == nil)
-		fatal(Enomem);
+	if((f->f->qid.type & QTDIR) == 0 && splicereply(f->fid, work->tag, n, work->offset) >= 0){
+		p->canint = 0;
+		DEBUG(DFD, "\tread: fd=%d spliced\n", f->fid);
+		return;
+	}
+	/* read straight into the reply, after its header */
+	b = getrbuf();
+	h = b->data;
 
 	/* can't just call pread, since directories must update the offset */
-	r = pread(f->fid, data, n, work->offset);
+	if(f->f->qid.type & QTDIR)
+		r = pread(f->fid, h+Rreadhdr, n, work->offset);
+	else
+		r = rahread(f, h+Rreadhdr, n, work->offset);
 	p->canint = 0;
 	if(r < 0) {
-		free(data);
+		putrbuf(b);
 		errstr(err, sizeof err);
 		reply(work, &rhdr, err);
 		return;
@@ -609,10 +975,108 @@ slaveread(Fsrpc *p)
 
 	DEBUG(DFD, "\tread: fd=%d %d bytes\n", f->fid, r);
 
-	rhdr.data = data;
-	rhdr.count = r;
-	reply(work, &rhdr, 0);
-	free(data);
+	b->n = Rreadhdr+r;
+	PBIT32(h, b->n);
+	h[BIT32SZ] = Rread;
+	PBIT16(h+BIT32SZ+BIT8SZ, work->tag);
+	PBIT32(h+BIT32SZ+BIT8SZ+BIT16SZ, r);
+	sendrbuf(b);
+
+	/* fetch what comes next while the reply is on its way */
+	if((f->f->qid.type & QTDIR) == 0)
+		rahfill(f);
+}
+
+/*
+ * The File's write generation; writers bump it under filelk.
+ */
+static int
+filegen(File *f)
+{
+	int gen;
+
+	qlock(&filelk);
+	gen = f->wgen;
+	qunlock(&filelk);
+	return gen;
+}
+
+/*
+ * Reads on a regular host file go through its Rah: data
+ * read ahead is used if it covers the offset, the rest is
+ * pread as usual.  Other files are just pread.
+ */
+long
+rahread(Fid *f, uchar *buf, long n, vlong off)
+{
+	Rah *a;
+	long m, r;
+	int gen;
+
+	if((a = f->rah) == nil)
+		return pread(f->fid, buf, n, off);
+	gen = filegen(f->f);
+	qlock(&a->lk);
+	if(off == a->next)
+		a->seq++;
+	else
+		a->seq = 0;
+	m = 0;
+	if(a->n > 0 && a->gen == gen && off >= a->off && off < a->off+a->n){
+		m = a->off+a->n - off;
+		if(m > n)
+			m = n;
+		memmove(buf, a->data+(off-a->off), m);
+		a->hits++;
+	} else if(a->seq > 0)
+		a->misses++;
+	r = m;
+	if(m < n){
+		r = pread(f->fid, buf+m, n-m, off+m);
+		if(r < 0 && m == 0){
+			qunlock(&a->lk);
+			return -1;
+		}
+		if(r < 0)
+			r = 0;
+		r += m;
+	}
+	a->next = off+r;
+	qunlock(&a->lk);
+	return r;
+}
+
+/*
+ * After the second sequential read, keep the next
+ * Nrah iounits read ahead of the reader.
+ */
+void
+rahfill(Fid *f)
+{
+	Rah *a;
+	long n;
+	int iou, gen;
+
+	a = f->rah;
+	if(a == nil || a->seq == 0)
+		return;
+	iou = messagesize-IOHDRSZ;
+	gen = filegen(f->f);
+	qlock(&a->lk);
+	if(a->seq == 0 || a->n > 0 && a->gen == gen
+	&& a->next >= a->off && a->next+iou <= a->off+a->n){
+		qunlock(&a->lk);
+		return;
+	}
+	if(a->data == nil){
+		a->size = Nrah*iou;
+		a->data = emallocz(a->size);
+	}
+	a->gen = gen;
+	n = pread(f->fid, a->data, a->size, a->next);
+	a->off = a->next;
+	a->n = n > 0 ? n : 0;
+	qunlock(&a->lk);
 }
 
 void
@@ -637,6 +1101,9 @@ slavewrite(Fsrpc *p)
 		return;
 	n = pwrite(f->fid, work->data, n, work->offset);
 	p->canint = 0;
+	qlock(&filelk);
+	f->f->wgen++;
+	qunlock(&filelk);
 	if(n < 0) {
 		errstr(err, sizeof err);
 		reply(work, &rhdr, err);
@@ -77,10 +77,25 @@ wl_surface_frame_done(void *data, struct wl_callback *cb, uint32_t time)
 	Wlwin *wl;
 
 	wl = data;
+	qlock(&drawlock);
+	if(wl->frame == cb)
+		wl->frame = nil;
 	wl_callback_destroy(cb);
-	cb = wl_surface_frame(wl->surface);
-	wl_callback_add_listener(cb, &wl_surface_frame_listener, wl);
-	wlflush(wl);
+	/* damage collected since the last commit goes out now */
+	if(wl->dirty)
+		wlflush(wl);
+	qunlock(&drawlock);
+}
+
+/* Ask to be told when the compositor wants the next frame;
+ * flushes until then only accumulate damage. */
+void
+wlframe(Wlwin *wl)
+{
+	if(wl->frame != nil)
+		return;
+	wl->frame = wl_surface_frame(wl->surface);
+	wl_callback_add_listener(wl->frame, &wl_surface_frame_listener, wl);
 }
 
 static void
@@ -738,7 +753,6 @@ wlsetcb(Wlwin *wl)
 {
 	struct wl_registry *registry;
 	struct xdg_surface *xdg_surface;
-	struct wl_callback *cb;
 	struct zxdg_toplevel_decoration_v1 *deco;
 
 	//Wayland doesn't do keyboard repeat, but also may
@@ -779,9 +793,6 @@ wlsetcb(Wlwin *wl)
 
 	xdg_toplevel_set_app_id(wl->xdg_toplevel, "drawterm");
 
-	cb = wl_surface_frame(wl->surface);
-	wl_callback_add_listener(cb, &wl_surface_frame_listener, wl);
-
 	if(wl->data_device_manager != nil && wl->seat != nil){
 		wl->data_device = wl_data_device_manager_get_data_device(wl->data_device_manager, wl->seat);
 		wl_data_device_add_listener(wl->data_device, &data_device_listener, wl);
@@ -1,6 +1,7 @@
 typedef struct Wlwin Wlwin;
 typedef struct Clipboard Clipboard;
 typedef struct Csd Csd;
+typedef struct Wlbuf Wlbuf;
 
 /* The contents of the clipboard
  * are not stored in the compositor.
@@ -45,6 +46,24 @@ struct Csd {
 	Rectangle button_minimize;
 };
 
+enum {
+	Nscreenbuf = 3,
+};
+
+/* One of the screen buffers in the shm pool.
+ * The compositor owns it from attach until
+ * wl_buffer.release; damage is what it still
+ * lacks from gscreen, csd whether it still
+ * lacks the decorations. */
+struct Wlbuf {
+	struct wl_buffer *buffer;
+	uchar *data;
+	Rectangle damage;
+	int dirty;
+	int csd;
+	int busy;
+};
+
 struct Wlwin {
 	int dx;
 	int dy;
@@ -69,7 +88,8 @@ struct Wlwin {
 	struct xdg_wm_base *xdg_wm_base;
 	struct xdg_toplevel *xdg_toplevel;
 	struct wl_shm_pool *pool;
-	struct wl_buffer *screenbuffer;
+	Wlbuf screenbuf[Nscreenbuf];
+	struct wl_callback *frame;
 	struct wl_buffer *cursorbuffer;
 	struct wl_shm *shm;
 	struct wl_seat *seat;
@@ -101,6 +121,7 @@ void wlsetmouse(Wlwin*, Point);
 void wldrawcursor(Wlwin*, Cursorinfo*);
 void wlresize(Wlwin*, int, int);
 void wlflush(Wlwin*);
+void wlframe(Wlwin*);
 void wlclose(Wlwin*);
 void wltogglemaximize(Wlwin*);
 void wlminimize(Wlwin*);
@@ -95,41 +95,98 @@ wlupdatecsdrects(Wlwin *wl)
 }
 
 static void
-wlfillrect(Wlwin *wl, Rectangle rect, uint32_t color)
+wldamage(Wlwin *wl, Rectangle r)
+{
+	if(wl->dirty)
+		combinerect(&wl->r, r);
+	else
+		wl->r = r;
+	wl->dirty = 1;
+}
+
+static void
+wlfillrect(Wlwin *wl, Wlbuf *b, Rectangle rect, uint32_t color)
 {
 	Point p;
-	uint32_t *data = wl->shm_data;
+	uint32_t *data;
 
+	data = (uint32_t*)b->data;
 	for(p.y = rect.min.y; p.y < rect.max.y; p.y++)
 		for(p.x = rect.min.x; p.x < rect.max.x; p.x++)
 			data[p.y * wl->dx + p.x] = color;
 }
 
+/*
+ * Paint the decorations into b, which
+ * the compositor must not be holding.
+ */
+static void
+wlpaintcsd(Wlwin *wl, Wlbuf *b)
+{
+	b->csd = 0;
+	if(!wl->client_side_deco)
+		return;
+	wlfillrect(wl, b, wl->csd_rects.bar, 0xAAAAAA);
+	wlfillrect(wl, b, wl->csd_rects.button_close, DRed >> 8);
+	wlfillrect(wl, b, wl->csd_rects.button_maximize, DGreen >> 8);
+	wlfillrect(wl, b, wl->csd_rects.button_minimize, DYellow >> 8);
+}
+
+/*
+ * Mark the decorations as damage in every buffer;
+ * wlflush paints them into the buffer it commits.
+ */
 static void
 wldrawcsd(Wlwin *wl)
 {
+	Wlbuf *b;
+
 	if(!wl->client_side_deco)
 		return;
-	wlfillrect(wl, wl->csd_rects.bar, 0xAAAAAA);
-	wlfillrect(wl, wl->csd_rects.button_close, DRed >> 8);
-	wlfillrect(wl, wl->csd_rects.button_maximize, DGreen >> 8);
-	wlfillrect(wl, wl->csd_rects.button_minimize, DYellow >> 8);
+	for(b = wl->screenbuf; b < wl->screenbuf+Nscreenbuf; b++)
+		b->csd = 1;
+	wldamage(wl, wl->csd_rects.bar);
 }
 
+/*
+ * Bring a free buffer up to date with gscreen and commit it.
+ * Called with drawlock held.  If the compositor still holds
+ * every buffer the damage stays pending until one is released.
+ */
 void
 wlflush(Wlwin *wl)
 {
+	Wlbuf *b;
+	Rectangle r;
 	Point p;
 
-	wl_surface_attach(wl->surface, wl->screenbuffer, 0, 0);
+	for(b = wl->screenbuf; b < wl->screenbuf+Nscreenbuf; b++)
+		if(!b->busy)
+			break;
+	if(b == wl->screenbuf+Nscreenbuf)
+		return;
+
+	if(gscreen != nil && b->dirty){
+		r = b->damage;
+		if(rectclip(&r, gscreen->r)){
+			p.x = r.min.x;
+			for(p.y = r.min.y; p.y < r.max.y; p.y++)
+				memcpy(b->data+(p.y*wl->dx+p.x)*4, byteaddr(gscreen, p), Dx(r)*4);
+		}
+		b->dirty = 0;
+	}
+	if(b->csd)
+		wlpaintcsd(wl, b);
+
+	wl_surface_attach(wl->surface, b->buffer, 0, 0);
 	if(wl->dirty){
-		p.x = wl->r.min.x;
-		for(p.y = wl->r.min.y; p.y < wl->r.max.y; p.y++)
-			memcpy(wl->shm_data+(p.y*wl->dx+p.x)*4, byteaddr(gscreen, p), Dx(wl->r)*4);
-		wl_surface_damage(wl->surface, p.x, wl->r.min.y, Dx(wl->r), Dy(wl->r));
+		wl_surface_damage(wl->surface, wl->r.min.x, wl->r.min.y, Dx(wl->r), Dy(wl->r));
 		wl->dirty = 0;
 	}
+	b->busy = 1;
+	wlframe(wl);
 	wl_surface_commit(wl->surface);
+	wl_display_flush(wl->display);
 }
 
 void  _screenresize(Rectangle);
@@ -153,10 +210,9 @@ wlresize(Wlwin *wl, int x, int y)
 	screenresize(r);
 
 	qlock(&drawlock);
-	wl->dirty = 1;
-	wl->r = r;
-	wlflush(wl);
 	wldrawcsd(wl);
+	wldamage(wl, r);
+	wlflush(wl);
 	qunlock(&drawlock);
 }
 
@@ -197,8 +253,9 @@ wlattach(char *label)
 	kproc("wldispatch", dispatchproc, wl);
 	qlock(&drawlock);
 	terminit();
-	wlflush(wl);
 	wldrawcsd(wl);
+	wldamage(wl, r);
+	wlflush(wl);
 	qunlock(&drawlock);
 	return wl;
 }
@@ -231,9 +288,19 @@ attachscreen(Rectangle *r, ulong *chan, int *depth, int *width, int *softscreen)
 void
 flushmemscreen(Rectangle r)
 {
-	gwin->dirty = 1;
-	gwin->r = r;
-	wlflush(gwin);
+	Wlbuf *b;
+
+	for(b = gwin->screenbuf; b < gwin->screenbuf+Nscreenbuf; b++){
+		if(b->dirty)
+			combinerect(&b->damage, r);
+		else
+			b->damage = r;
+		b->dirty = 1;
+	}
+	wldamage(gwin, r);
+	/* between frames only collect damage; frame done commits it */
+	if(gwin->frame == nil)
+		wlflush(gwin);
 }
 
 void
@@ -49,48 +49,94 @@ wlallocpool(Wlwin *wl)
 	int depth;
 	int fd;
 
-	if(wl->pool != nil)
+	if(wl->pool != nil){
 		wl_shm_pool_destroy(wl->pool);
+		munmap(wl->shm_data, wl->poolsize);
+	}
 
 	depth = 4;
 	screensize = wl->monx * wl->mony * depth;
 	cursorsize = 16 * 16 * depth;
 
-	fd = wlcreateshm(screensize+cursorsize);
+	fd = wlcreateshm(Nscreenbuf*screensize+cursorsize);
 	if(fd < 0)
 		panic("could not mk_shm_fd");
-	if(ftruncate(fd, screensize+cursorsize) < 0)
+	if(ftruncate(fd, Nscreenbuf*screensize+cursorsize) < 0)
 		panic("could not ftruncate");
 
-	wl->shm_data = mmap(nil, screensize+cursorsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	wl->shm_data = mmap(nil, Nscreenbuf*screensize+cursorsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 	if(wl->shm_data == MAP_FAILED)
 		panic("could not mmap shm_data");
 
-	wl->pool = wl_shm_create_pool(wl->shm, fd, screensize+cursorsize);
-	wl->poolsize = screensize+cursorsize;
+	wl->pool = wl_shm_create_pool(wl->shm, fd, Nscreenbuf*screensize+cursorsize);
+	wl->poolsize = Nscreenbuf*screensize+cursorsize;
 	close(fd);
 }
 
+static void
+wl_buffer_release(void *data, struct wl_buffer *buffer)
+{
+	Wlwin *wl;
+	Wlbuf *b;
+
+	wl = data;
+	qlock(&drawlock);
+	for(b = wl->screenbuf; b < wl->screenbuf+Nscreenbuf; b++)
+		if(b->buffer == buffer)
+			break;
+	if(b < wl->screenbuf+Nscreenbuf)
+		b->busy = 0;
+	else
+		wl_buffer_destroy(buffer);	/* replaced by a resize while busy */
+	/* a flush that found every buffer busy is retried here */
+	if(wl->dirty && wl->frame == nil)
+		wlflush(wl);
+	qunlock(&drawlock);
+}
+
+static const struct wl_buffer_listener wl_buffer_listener = {
+	.release = wl_buffer_release,
+};
+
 void
 wlallocbuffer(Wlwin *wl)
 {
 	int depth;
 	int size;
+	int i, busy;
+	Wlbuf *b;
 
 	depth = 4;
 	size = wl->dx * wl->dy * depth;
-	if(wl->pool == nil || size+(16*16*depth) > wl->poolsize)
+	/*
+	 * Buffers the compositor still holds are left to
+	 * wl_buffer_release to destroy.  Their memory must not be
+	 * reused before then, so they force a fresh pool.
+	 */
+	busy = 0;
+	for(i = 0; i < Nscreenbuf; i++)
+		busy |= wl->screenbuf[i].busy;
+	if(wl->pool == nil || busy || Nscreenbuf*size+(16*16*depth) > wl->poolsize)
 		wlallocpool(wl);
 
-	assert(size+(16*16*depth) <= wl->poolsize);
+	assert(Nscreenbuf*size+(16*16*depth) <= wl->poolsize);
+
+	for(i = 0; i < Nscreenbuf; i++){
+		b = &wl->screenbuf[i];
+		if(b->buffer != nil && !b->busy)
+			wl_buffer_destroy(b->buffer);
+		b->buffer = wl_shm_pool_create_buffer(wl->pool, i*size, wl->dx, wl->dy, wl->dx*4, WL_SHM_FORMAT_XRGB8888);
+		wl_buffer_add_listener(b->buffer, &wl_buffer_listener, wl);
+		b->data = (uchar*)wl->shm_data + i*size;
+		b->damage = Rect(0, 0, wl->dx, wl->dy);
+		b->dirty = 1;
+		b->csd = 1;
+		b->busy = 0;
+	}
 
-	if(wl->screenbuffer != nil)
-		wl_buffer_destroy(wl->screenbuffer);
 	if(wl->cursorbuffer != nil)
 		wl_buffer_destroy(wl->cursorbuffer);
-
-	wl->screenbuffer = wl_shm_pool_create_buffer(wl->pool, 0, wl->dx, wl->dy, wl->dx*4, WL_SHM_FORMAT_XRGB8888);
-	wl->cursorbuffer = wl_shm_pool_create_buffer(wl->pool, size, 16, 16, 16*4, WL_SHM_FORMAT_ARGB8888);
+	wl->cursorbuffer = wl_shm_pool_create_buffer(wl->pool, Nscreenbuf*size, 16, 16, 16*4, WL_SHM_FORMAT_ARGB8888);
 }
 
 enum {
@@ -108,7 +154,7 @@ wldrawcursor(Wlwin *wl, Cursorinfo *c)
 	u32int *buf;
 	uint16_t clr[16], set[16];
 
-	buf = wl->shm_data+(wl->dx*wl->dy*4);
+	buf = (u32int*)((uchar*)wl->shm_data + Nscreenbuf*wl->dx*wl->dy*4);
 	for(i=0,j=0; i < 16; i++,j+=2){
 		clr[i] = c->clr[j]<<8 | c->clr[j+1];
 		set[i] = c->set[j]<<8 | c->set[j+1];
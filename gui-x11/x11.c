@@ -21,6 +21,9 @@ typedef struct Cursor Cursor;
 
 #undef	getenv
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <poll.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
@@ -28,6 +31,7 @@ typedef struct Cursor Cursor;
 #include <X11/StringDefs.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
+#include <X11/extensions/XShm.h>
 #include "keysym2ucs.h"
 
 #undef	Font
@@ -54,6 +58,193 @@ extern char		*geometry;	/* defined in main.c */
 
 #include "../glenda-t.xbm"
 
+/*
+ * With MIT-SHM, when the server is local, the screen's pixels live
+ * in a segment the server maps too, and flushmemscreen hands over
+ * rectangles with XShmPutImage instead of sending them down the socket.
+ * The puts are not waited for there: xshmwait, as screenwait, waits
+ * for the completion of the last one before anything draws on the
+ * segment again.
+ * A segment left behind by a resize is kept until devdraw lets go of it.
+ */
+typedef struct Xshm Xshm;
+struct Xshm
+{
+	XShmSegmentInfo	info;
+	Memdata		*md;
+	Xshm		*next;
+};
+
+static	int		xshmok;		/* server has MIT-SHM */
+static	int		xshmdone;	/* ShmCompletion event type */
+static	int		xshmerr;
+static	int		xshmbusy;	/* a put has not completed */
+static	ulong		xshmserial;	/* request serial of the last put */
+static	Xshm*		xscreenshm;	/* segment behind gscreen, or nil */
+static	Xshm*		xshmold;
+
+static int
+xshmtrap(XDisplay *d, XErrorEvent *e)
+{
+	USED(d);
+	USED(e);
+	xshmerr = 1;
+	return 0;
+}
+
+static void
+xshmfree(Xshm *s)
+{
+	if(s->info.shmaddr != nil && s->info.shmaddr != (char*)-1)
+		shmdt(s->info.shmaddr);
+	free(s->md);
+	free(s);
+}
+
+/*
+ * The segment must be attached by the server before we can use it:
+ * if the server is remote, this is where we find out.
+ */
+static Memimage*
+xshmallocmemimage(Rectangle r, ulong chan, XImage **X)
+{
+	int (*old)(XDisplay*, XErrorEvent*);
+	Memimage *m;
+	XImage *xi;
+	Xshm *s;
+	int d;
+
+	d = chantodepth(chan);
+	if(!xshmok || d < 8 || r.min.x != 0
+	|| (xtblbit && chan == CMAP8) || ImageByteOrder(xdisplay) != LSBFirst)
+		return nil;
+	if((s = mallocz(sizeof(Xshm), 1)) == nil)
+		return nil;
+	s->info.shmid = -1;
+	xi = XShmCreateImage(xdisplay, xvis, d==32?24:d, ZPixmap, nil, &s->info, Dx(r), Dy(r));
+	if(xi == nil){
+		free(s);
+		return nil;
+	}
+	if(xi->bytes_per_line != wordsperline(r, d)*sizeof(ulong))
+		goto Error;
+	s->info.shmid = shmget(IPC_PRIVATE, xi->bytes_per_line*Dy(r), IPC_CREAT|0600);
+	if(s->info.shmid < 0)
+		goto Error;
+	s->info.shmaddr = xi->data = shmat(s->info.shmid, nil, 0);
+	if(s->info.shmaddr == (char*)-1)
+		goto Error;
+	s->info.readOnly = True;
+
+	xshmerr = 0;
+	old = XSetErrorHandler(xshmtrap);
+	XShmAttach(xdisplay, &s->info);
+	XSync(xdisplay, False);
+	XSetErrorHandler(old);
+	if(xshmerr){
+		xshmok = 0;
+		goto Error;
+	}
+	/* gone once both sides detach */
+	shmctl(s->info.shmid, IPC_RMID, nil);
+	s->info.shmid = -1;
+
+	if((s->md = mallocz(sizeof(Memdata), 1)) == nil)
+		goto Detach;
+	s->md->ref = 1;
+	s->md->base = (ulong*)s->info.shmaddr;
+	s->md->bdata = (uchar*)s->info.shmaddr;
+	s->md->allocd = 0;	/* freememimage leaves it to us */
+	if((m = allocmemimaged(r, chan, s->md)) == nil)
+		goto Detach;
+	s->md->imref = m;
+
+	xscreenshm = s;
+	*X = xi;
+	return m;
+
+Detach:
+	XShmDetach(xdisplay, &s->info);
+	XSync(xdisplay, False);
+Error:
+	xi->data = nil;
+	XDestroyImage(xi);
+	if(s->info.shmid >= 0)
+		shmctl(s->info.shmid, IPC_RMID, nil);
+	xshmfree(s);
+	return nil;
+}
+
+/*
+ * Free the retired segments nobody uses any more.
+ */
+static void
+xshmsweep(void)
+{
+	Xshm **l, *s;
+
+	for(l=&xshmold; (s=*l) != nil; ){
+		if(s->md->ref > 0){
+			l = &s->next;
+			continue;
+		}
+		*l = s->next;
+		XShmDetach(xdisplay, &s->info);
+		XSync(xdisplay, False);
+		xshmfree(s);
+	}
+}
+
+static Bool
+isxshmdone(XDisplay *d, XEvent *e, XPointer a)
+{
+	USED(d);
+	USED(a);
+	return e->type == xshmdone;
+}
+
+enum
+{
+	Xshmwait	= 500,	/* ms to wait for the server to read a segment */
+};
+
+/*
+ * Called with drawlock held: wait until the server has read
+ * the segment for every put made.  Completions carry the serial
+ * of their put and come in order, so the one for the last put
+ * covers the rest.  A completion that does not come in time is
+ * given up on rather than holding drawlock; when it turns up
+ * later its older serial keeps it from passing for a newer put.
+ */
+static void
+xshmwait(void)
+{
+	struct pollfd pfd;
+	ulong t0;
+	XEvent e;
+	int ms;
+
+	t0 = ticks();
+	while(xshmbusy){
+		if(XCheckIfEvent(xdisplay, &e, isxshmdone, nil)){
+			if((long)(e.xany.serial - xshmserial) >= 0)
+				xshmbusy = 0;
+			continue;
+		}
+		ms = Xshmwait - (ticks()-t0);
+		if(ms <= 0){
+			xshmbusy = 0;
+			break;
+		}
+		pfd.fd = ConnectionNumber(xdisplay);
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		poll(&pfd, 1, ms);
+	}
+	if(xshmold != nil)
+		xshmsweep();
+}
+
 Memimage*
 xallocmemimage(Rectangle r, ulong chan, int pmid, XImage **X)
 {
@@ -62,6 +253,9 @@ xallocmemimage(Rectangle r, ulong chan, int pmid, XImage **X)
 	int offset;
 	int d;
 
+	if(chan == xscreenchan && (m = xshmallocmemimage(r, chan, X)) != nil)
+		return m;
+
 	m = allocmemimage(r, chan);
 	if(m == nil)
 		return nil;
@@ -178,12 +372,21 @@ flushmemscreen(Rectangle r)
 			for(x=r.min.x, p=byteaddr(gscreen, Pt(x,y)); x<r.max.x; x++, p++)
 				*p = plan9tox11[*p];
 
-	XPutImage(xdisplay, xscreenid, xgccopy, xscreenimage, r.min.x, r.min.y, r.min.x, r.min.y, Dx(r), Dy(r));
-
-	if(xtblbit && gscreen->chan == CMAP8)
+	if(xscreenshm != nil){
+		xshmserial = NextRequest(xdisplay);
+		XShmPutImage(xdisplay, xscreenid, xgccopy, xscreenimage, r.min.x, r.min.y, r.min.x, r.min.y, Dx(r), Dy(r), True);
+		xshmbusy = 1;
+	}else
+		XPutImage(xdisplay, xscreenid, xgccopy, xscreenimage, r.min.x, r.min.y, r.min.x, r.min.y, Dx(r), Dy(r));
+
+	if(xtblbit && gscreen->chan == CMAP8){
+		/* the pixels are about to change back under the server */
+		if(xscreenshm != nil)
+			xshmwait();
 		for(y=r.min.y; y<r.max.y; y++)
 			for(x=r.min.x, p=byteaddr(gscreen, Pt(x,y)); x<r.max.x; x++, p++)
 				*p = x11toplan9[*p];
+	}
 
 	XCopyArea(xdisplay, xscreenid, xdrawable, xgccopy, r.min.x, r.min.y, Dx(r), Dy(r), r.min.x, r.min.y);
 	XFlush(xdisplay);
@@ -215,6 +418,12 @@ screeninit(void)
 	XSetErrorHandler(shutup);
 	XSetIOErrorHandler(panicshutup);
 
+	if(XShmQueryExtension(xdisplay)){
+		xshmok = 1;
+		xshmdone = XShmGetEventBase(xdisplay) + ShmCompletion;
+		screenwait = xshmwait;
+	}
+
 	xkmcon = XOpenDisplay(NULL);
 	if(xkmcon == 0)
 		panic("XOpenDisplay: %r [DISPLAY=%s]", getenv("DISPLAY"));
@@ -387,6 +596,7 @@ screensize(Rectangle r, ulong chan)
 	Drawable pix;
 	Memimage *mi;
 	XImage *xi;
+	Xshm *old;
 	GC gc;
 
 	pix = XCreatePixmap(xdisplay, xdrawable, Dx(r), Dy(r), xscreendepth);
@@ -399,8 +609,11 @@ screensize(Rectangle r, ulong chan)
 		return;
 	}
 
+	old = xscreenshm;
+	xscreenshm = nil;
 	mi = xallocmemimage(r, chan, pix, &xi);
 	if(mi == nil){
+		xscreenshm = old;
 		XFreeGC(xdisplay, gc);
 		XFreePixmap(xdisplay, pix);
 		return;
@@ -414,6 +627,11 @@ screensize(Rectangle r, ulong chan)
 		XFreeGC(xdisplay, xgccopy);
 		XFreePixmap(xdisplay, xscreenid);
 	}
+	if(old != nil){
+		old->next = xshmold;
+		xshmold = old;
+		xshmsweep();
+	}
 
 	xscreenimage = xi;
 	xscreenid = pix;
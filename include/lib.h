@@ -91,7 +91,11 @@ extern	char*	utfrrune(char*, long);
 #define	MAFTER	0x0002	/* mount goes after others in union directory */
 #define	MCREATE	0x0004	/* permit creation in mounted directory */
 #define	MCACHE	0x0010	/* cache some data */
-#define	MMASK	0x0017	/* all bits on */
+#define	MRAH	0x0020	/* keep several reads in flight on sequential access */
+#define	MWB	0x0040	/* don't wait for sequential writes; errors come later */
+#define	MKPROC	0x0080	/* a kproc reads the replies */
+#define	MWIN(n)	(((n)&0xF)<<8)	/* rpcs in flight for MRAH and MWB; 0 is the default */
+#define	MMASK	0x0FF7	/* all bits on */
 
 #define	OREAD	0	/* open for read */
 #define	OWRITE	1	/* write */
@@ -31,6 +31,13 @@ struct AESstate
 extern void (*aes_encrypt)(ulong rk[], int Nr, uchar pt[16], uchar ct[16]);
 extern void (*aes_decrypt)(ulong rk[], int Nr, uchar ct[16], uchar pt[16]);
 
+/* whole-block modes, nil unless the cpu has AES instructions */
+extern void (*aes_cbcencrypt)(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n);
+extern void (*aes_cbcdecrypt)(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n);
+extern void (*aes_ctr32)(ulong rk[], int Nr, uchar ctr[16], uchar *p, ulong n);
+extern void (*aes_ghashinit)(uchar h[16], uchar *tab);
+extern void (*aes_ghash)(uchar *tab, uchar y[16], uchar *p, ulong n);
+
 void	setupAESstate(AESstate *s, uchar key[], int nkey, uchar *ivec);
 
 void	aesCBCencrypt(uchar *p, int len, AESstate *s);
@@ -47,8 +54,7 @@ struct AESGCMstate
 {
 	AESstate a;
 
-	ulong	H[4];
-	ulong	M[16][256][4];
+	uvlong	M[16][2];	/* multiples of H by 4-bit values, or aes_ghash's table */
 };
 
 void	setupAESGCMstate(AESGCMstate *s, uchar *key, int keylen, uchar *iv, int ivlen);
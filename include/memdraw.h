@@ -4,6 +4,7 @@ typedef struct	Memsubfont Memsubfont;
 typedef struct	Memlayer Memlayer;
 typedef struct	Memcmap Memcmap;
 typedef struct	Memdrawparam	Memdrawparam;
+typedef struct	Memspan	Memspan;
 
 /*
  * Memdata is allocated from main pool, but .data from the image pool.
@@ -107,6 +108,16 @@ struct	Memdrawparam
 	ulong sdval;	/* sval in dst format */
 };
 
+/*
+ * A run of pixels [x0, x1) on row y, for memimagespans and memdrawspans.
+ */
+struct	Memspan
+{
+	int	x0;
+	int	x1;
+	int	y;
+};
+
 /*
  * Memimage management
  */
@@ -131,11 +142,13 @@ extern int		memsetchan(Memimage*, ulong);
  * Graphics
  */
 extern void	memdraw(Memimage*, Rectangle, Memimage*, Point, Memimage*, Point, int);
+extern void	memdrawspans(Memimage*, Memspan*, int, Memimage*, Point, int);
 extern void	memline(Memimage*, Point, Point, int, int, int, Memimage*, Point, int);
 extern void	mempoly(Memimage*, Point*, int, int, int, int, Memimage*, Point, int);
 extern void	memfillpoly(Memimage*, Point*, int, int, Memimage*, Point, int);
 extern void	_memfillpolysc(Memimage*, Point*, int, int, Memimage*, Point, int, int, int, int);
 extern void	memimagedraw(Memimage*, Rectangle, Memimage*, Point, Memimage*, Point, int);
+extern void	memimagespans(Memimage*, Memspan*, int, Memimage*, Point, int);
 extern int	hwdraw(Memdrawparam*);
 extern void	memimageline(Memimage*, Point, Point, int, int, int, Memimage*, Point, int);
 extern void	_memimageline(Memimage*, Point, Point, int, int, int, Memimage*, Point, Rectangle, int);
@@ -147,6 +160,37 @@ extern int	memlineendsize(int);
 extern void	_memmkcmap(void);
 extern int	memimageinit(void);
 
+/*
+ * Band-parallel drawing: if memdrawbands is set, memimagedraw splits
+ * draws of at least memdrawbandmin pixels into up to memdrawnband
+ * horizontal bands and calls memdrawbands(fn, arg, n), which must
+ * run fn(arg[i]) for each band and return when all are done.
+ */
+extern int	memdrawnband;
+extern int	memdrawbandmin;
+extern void	(*memdrawbands)(void (*)(void*), void**, int);
+
+/*
+ * Specialized kernels for common formats (on unless memdrawspec is 0);
+ * memdrawcoverage reports what still goes the general way.
+ */
+extern int	memdrawspec;
+extern int	memdrawcoverage(char*, int);
+
+/*
+ * Per-thread scratch for the general draw: memdrawscratch, if set,
+ * returns the calling thread's slot, initially nil; give what is left
+ * there to freememdrawscratch when the thread exits.  The counters
+ * are arenas live, times one grew, the biggest in bytes, and draws
+ * that had to allocate scratch of their own.
+ */
+extern void**	(*memdrawscratch)(void);
+extern void	freememdrawscratch(void*);
+extern ulong	memdrawscratchn;
+extern ulong	memdrawscratchgrow;
+extern ulong	memdrawscratchmax;
+extern ulong	memdrawscratchtemp;
+
 /*
  * Subfont management
  */
@@ -23,6 +23,8 @@
 #define nsec sysnsec
 #define pread syspread
 #define pwrite syspwrite
+#define sendrread syssendrread
+#define regularfile sysregularfile
 #undef sleep
 #define	sleep	osmsleep
 #define iounit	sysiounit
@@ -76,12 +78,15 @@ extern	ulong	truerand(void);
 extern	int	pushssl(int, char*, char*, char*, int*);
 extern	long	pread(int, void*, long, vlong);
 extern	long	pwrite(int, void*, long, vlong);
+extern	long	sendrread(int, int, int, long, vlong);
+extern	int	regularfile(int);
 extern	void*	rendezvous(void*, void*);
 extern	int	kproc(char*, void(*)(void*), void*);
 extern	int	getpid(void);
 extern	void	panic(char*, ...);
 extern	void	sleep(int);
 extern	void	osyield(void);
+extern	ulong	ticks(void);
 extern	void	setmalloctag(void*, uintptr);
 extern	void	setrealloctag(void*, uintptr);
 extern	int	errstr(char*, uint);
@@ -0,0 +1,358 @@
+#include	"u.h"
+#include	"lib.h"
+#include	"dat.h"
+#include	"fns.h"
+#include	"error.h"
+
+/*
+ * Client data cache for mounts made with MCACHE.
+ * Files are named by mount id and qid.path; a file's
+ * blocks are only good for the qid.vers they were read at.
+ * Blocks are CACHEBLK bytes except the last, whose
+ * length gives the file length.  Least recently used
+ * blocks are evicted once the cache holds more than
+ * cachesize bytes.
+ */
+typedef struct Cblk Cblk;
+typedef struct Cfile Cfile;
+
+enum
+{
+	NFHASH	= 128,
+	NBHASH	= 32,
+};
+
+struct Cblk
+{
+	Cfile	*f;
+	ulong	bno;
+	int	n;
+	Cblk	*hash;
+	Cblk	*prev;		/* lru */
+	Cblk	*next;
+	uchar	data[1];
+};
+
+struct Cfile
+{
+	ulong	mntid;
+	uvlong	path;
+	ulong	vers;
+	vlong	len;		/* -1 if unknown */
+	int	nblk;
+	Cfile	*hash;
+	Cblk	*blk[NBHASH];
+};
+
+static struct
+{
+	Lock	lk;
+	Cfile	*hash[NFHASH];
+	Cblk	lru;
+	ulong	nbytes;
+	ulong	nfile;
+	ulong	hits;
+	ulong	misses;
+	ulong	evicts;
+} cache;
+
+ulong	cachesize = 16*1024*1024;
+
+static Cfile*
+clookup(Chan *c, int mk)
+{
+	Cfile *f, **l;
+	ulong id;
+
+	id = c->mchan->mux->id;
+	l = &cache.hash[(c->qid.path^id)%NFHASH];
+	for(f = *l; f != nil; f = f->hash)
+		if(f->path == c->qid.path && f->mntid == id)
+			return f;
+	if(!mk)
+		return nil;
+	f = mallocz(sizeof(Cfile), 1);
+	if(f == nil)
+		return nil;
+	f->mntid = id;
+	f->path = c->qid.path;
+	f->vers = c->qid.vers;
+	f->len = -1;
+	f->hash = *l;
+	*l = f;
+	cache.nfile++;
+	return f;
+}
+
+static void
+cunlinkfile(Cfile *f)
+{
+	Cfile **l;
+
+	for(l = &cache.hash[(f->path^f->mntid)%NFHASH]; *l != nil; l = &(*l)->hash)
+		if(*l == f){
+			*l = f->hash;
+			break;
+		}
+	cache.nfile--;
+	free(f);
+}
+
+static void
+cfreeblk(Cblk *b)
+{
+	Cblk **l;
+	Cfile *f;
+
+	f = b->f;
+	for(l = &f->blk[b->bno%NBHASH]; *l != nil; l = &(*l)->hash)
+		if(*l == b){
+			*l = b->hash;
+			break;
+		}
+	f->nblk--;
+	b->prev->next = b->next;
+	b->next->prev = b->prev;
+	cache.nbytes -= b->n;
+	free(b);
+}
+
+static void
+cpurge(Cfile *f)
+{
+	Cblk *b;
+	int i;
+
+	for(i = 0; i < NBHASH; i++)
+		while((b = f->blk[i]) != nil)
+			cfreeblk(b);
+	f->len = -1;
+}
+
+static Cblk*
+cfind(Cfile *f, ulong bno)
+{
+	Cblk *b;
+
+	for(b = f->blk[bno%NBHASH]; b != nil; b = b->hash)
+		if(b->bno == bno)
+			return b;
+	return nil;
+}
+
+static void
+clru(Cblk *b)
+{
+	if(b->prev != nil){
+		b->prev->next = b->next;
+		b->next->prev = b->prev;
+	}
+	b->next = cache.lru.next;
+	b->prev = &cache.lru;
+	b->next->prev = b;
+	cache.lru.next = b;
+}
+
+static void
+cinit(void)
+{
+	if(cache.lru.next == nil)
+		cache.lru.next = cache.lru.prev = &cache.lru;
+}
+
+/*
+ * Only plain files whose qid.vers changes when they are
+ * written can be cached.  Synthetic files such as factotum's
+ * rpc keep vers at 0 and answer each read afresh.
+ */
+int
+ccachable(Chan *c)
+{
+	return (c->flag & CCACHE) != 0 && c->qid.vers != 0
+		&& (c->qid.type & (QTDIR|QTAPPEND|QTEXCL|QTMOUNT|QTAUTH)) == QTFILE;
+}
+
+/*
+ * Called after a Topen: forget what was
+ * cached for an older version of the file.
+ */
+void
+copen(Chan *c)
+{
+	Cfile *f;
+
+	lock(&cache.lk);
+	cinit();
+	f = clookup(c, 0);
+	if(f != nil && f->vers != c->qid.vers){
+		cpurge(f);
+		cunlinkfile(f);
+	}
+	unlock(&cache.lk);
+}
+
+/*
+ * Called after a Tcreate or truncating Topen.
+ */
+void
+ctrunc(Chan *c)
+{
+	Cfile *f;
+
+	lock(&cache.lk);
+	cinit();
+	f = clookup(c, 0);
+	if(f != nil){
+		cpurge(f);
+		cunlinkfile(f);
+	}
+	unlock(&cache.lk);
+}
+
+/*
+ * Copy cached data at off into buf, stopping at the
+ * first block not in the cache.  Returns -1 if the
+ * block at off is missing, 0 at end of file.
+ */
+long
+cread(Chan *c, uchar *buf, long n, vlong off)
+{
+	Cfile *f;
+	Cblk *b;
+	long cnt, k, o;
+
+	lock(&cache.lk);
+	cinit();
+	f = clookup(c, 0);
+	if(f == nil || f->vers != c->qid.vers){
+		cache.misses++;
+		unlock(&cache.lk);
+		return -1;
+	}
+	if(f->len >= 0 && off >= f->len){
+		unlock(&cache.lk);
+		return 0;
+	}
+	cnt = 0;
+	while(n > 0){
+		b = cfind(f, off/CACHEBLK);
+		if(b == nil){
+			cache.misses++;
+			break;
+		}
+		cache.hits++;
+		clru(b);
+		o = off%CACHEBLK;
+		if(o >= b->n)
+			break;
+		k = b->n - o;
+		if(k > n)
+			k = n;
+		memmove(buf, b->data+o, k);
+		buf += k;
+		off += k;
+		n -= k;
+		cnt += k;
+		if(b->n < CACHEBLK)
+			break;
+	}
+	if(cnt == 0 && n > 0 && (f->len < 0 || off < f->len))
+		cnt = -1;
+	unlock(&cache.lk);
+	return cnt;
+}
+
+/*
+ * Enter the n bytes read at the block boundary off.
+ * A short block marks the end of the file.
+ */
+void
+cupdate(Chan *c, uchar *buf, long n, vlong off)
+{
+	Cfile *f;
+	Cblk *b;
+	ulong bno;
+
+	if(n < 0 || n > CACHEBLK || off%CACHEBLK != 0 || !ccachable(c))
+		return;
+	bno = off/CACHEBLK;
+	lock(&cache.lk);
+	cinit();
+	f = clookup(c, 1);
+	if(f == nil){
+		unlock(&cache.lk);
+		return;
+	}
+	if(f->vers != c->qid.vers){
+		cpurge(f);
+		f->vers = c->qid.vers;
+	}
+	if(n < CACHEBLK)
+		f->len = off+n;
+	if((b = cfind(f, bno)) != nil)
+		cfreeblk(b);
+	if(n > 0 && (b = malloc(sizeof(Cblk)+n)) != nil){
+		b->f = f;
+		b->bno = bno;
+		b->n = n;
+		memmove(b->data, buf, n);
+		b->hash = f->blk[bno%NBHASH];
+		f->blk[bno%NBHASH] = b;
+		f->nblk++;
+		b->prev = nil;
+		clru(b);
+		cache.nbytes += n;
+	}
+	/* an empty file, or a zero-length read at a block boundary */
+	if(f->nblk == 0)
+		cunlinkfile(f);
+	while(cache.nbytes > cachesize && (b = cache.lru.prev) != &cache.lru){
+		f = b->f;
+		cfreeblk(b);
+		cache.evicts++;
+		if(f->nblk == 0)
+			cunlinkfile(f);
+	}
+	unlock(&cache.lk);
+}
+
+/*
+ * A local write makes the blocks it covers
+ * and the known length stale.
+ */
+void
+cwrite(Chan *c, uchar *buf, long n, vlong off)
+{
+	Cfile *f;
+	Cblk *b;
+	ulong bno, e;
+
+	USED(buf);
+	if(n <= 0)
+		return;
+	lock(&cache.lk);
+	cinit();
+	f = clookup(c, 0);
+	if(f != nil){
+		e = (off+n-1)/CACHEBLK;
+		for(bno = off/CACHEBLK; bno <= e; bno++)
+			if((b = cfind(f, bno)) != nil)
+				cfreeblk(b);
+		f->len = -1;
+		if(f->nblk == 0)
+			cunlinkfile(f);
+	}
+	unlock(&cache.lk);
+}
+
+int
+cstats(char *buf, int nbuf)
+{
+	int n;
+
+	lock(&cache.lk);
+	n = snprint(buf, nbuf, "cache hits %lud misses %lud evicted %lud files %lud bytes %lud max %lud\n",
+		cache.hits, cache.misses, cache.evicts, cache.nfile, cache.nbytes, cachesize);
+	unlock(&cache.lk);
+	return n;
+}
@@ -106,6 +106,8 @@ enum
 	CFREE	= 0x0010,		/* not in use */
 	CRCLOSE	= 0x0020,		/* remove on close */
 	CCACHE	= 0x0080,		/* client cache */
+
+	CACHEBLK	= 8*1024,	/* client cache block size */
 };
 
 /* flag values */
@@ -268,6 +270,26 @@ struct Mnt
 	int	msize;		/* data + IOHDRSZ */
 	char	*version;			/* 9P version */
 	Queue	*q;		/* input queue */
+	int	nrah;		/* Treads in flight on sequential reads; 0 is off */
+	int	nwb;		/* Twrites in flight on sequential writes; 0 is off */
+	Mntrpc	**tags;		/* queue indexed by tag */
+	int	ntags;
+	int	kproc;		/* replies are read by a kproc, not by rip */
+	Proc	*reader;	/* that kproc */
+	Rendez	rz;		/* where it waits for requests */
+	Rendez	cz;		/* where muxclose waits for it to exit */
+	int	closing;
+	ulong	nq;		/* requests in queue */
+	ulong	maxq;
+	ulong	nrpc;		/* replies received */
+	uvlong	rpcms;		/* their total round trip time */
+	ulong	maxms;
+	Mntrpc	*rpcfree;	/* free rpcs, each holding a tag */
+	int	nrpcfree;
+	int	tagnext;	/* next tag never handed out */
+	ushort	*tagfree;	/* tags given back */
+	int	ntagfree;
+	int	natagfree;
 };
 
 enum
@@ -386,6 +408,8 @@ struct Proc
 	void	(*fn)(void*);
 	void	*arg;
 
+	void	*drawscratch;	/* libmemdraw's, see memdrawscratch */
+
 	char oproc[1024];	/* reserved for os */
 
 };
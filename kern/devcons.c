@@ -12,6 +12,7 @@
 #undef read
 
 void	(*screenputs)(char*, int) = 0;
+int	(*exportstats)(char*, int) = 0;
 
 Kmesg	kmesg;			/* console messages */
 Queue*	kbdq;			/* unprocessed console input */
@@ -342,6 +343,7 @@ enum{
 	Qkprint,
 	Qhostdomain,
 	Qhostowner,
+	Qmntstat,
 	Qnull,
 	Qosversion,
 	Qrandom,
@@ -369,6 +371,7 @@ static Dirtab consdir[]={
 	"hostowner",	{Qhostowner},	0,	0664,
 	"kmesg",	{Qkmesg},	0,		0440,
 	"kprint",	{Qkprint, 0, QTEXCL},	0,	DMEXCL|0440,
+	"mntstat",	{Qmntstat},	0,		0444,
 	"null",		{Qnull},	0,		0666,
 	"osversion",	{Qosversion},	0,		0444,
 	"random",	{Qrandom},	0,		0444,
@@ -654,6 +657,22 @@ consread(Chan *c, void *buf, long n, vlong off)
 		poperror();
 		return n;
 
+	case Qmntstat:
+		b = malloc(READSTR);
+		if(b == nil)
+			error(Enomem);
+		n = mntstats(b, READSTR);
+		if(exportstats != nil)
+			n += exportstats(b+n, READSTR-n);
+		if(waserror()){
+			free(b);
+			nexterror();
+		}
+		n = readstr((ulong)offset, buf, n, b);
+		free(b);
+		poperror();
+		return n;
+
 	case Qzero:
 		memset(buf, 0, n);
 		return n;
@@ -150,14 +150,23 @@ struct DScreen
 
 static	Draw		sdraw;
 	QLock	drawlock;
+	void	(*screenwait)(void);
 
 static	Memimage	*screenimage;
 static	DImage*	screendimage;
 static	char	screenname[40];
 static	int	screennameid;
 
-static	Rectangle	flushrect;
-static	int		waste;
+/*
+ * Screen damage waiting for drawflush: at most Nflush
+ * disjoint rectangles, each passed to flushmemscreen.
+ */
+enum
+{
+	Nflush = 16,
+};
+static	Rectangle	flushr[Nflush];
+static	int		nflush;
 static	DScreen*	dscreen;
 extern	void		flushmemscreen(Rectangle);
 	void		drawmesg(Client*, void*, int);
@@ -188,6 +197,8 @@ static void
 dlock(void)
 {
 	qlock(&drawlock);
+	if(screenwait != nil)
+		screenwait();
 }
 
 static void
@@ -354,47 +365,176 @@ drawrefresh(Memimage *i, Rectangle r, void *v)
 	}
 }
 
+/*
+ * What it costs to push the bounding box of a and b
+ * rather than the two: the area in neither.
+ */
+static int
+flushwaste(Rectangle a, Rectangle b)
+{
+	Rectangle bb;
+
+	bb = a;
+	combinerect(&bb, b);
+	return Dx(bb)*Dy(bb) - Dx(a)*Dy(a) - Dx(b)*Dy(b);
+}
+
 static void
-addflush(Rectangle r)
+flushadd(Rectangle r)
 {
-	int abb, ar, anbb;
-	Rectangle nbb;
+	int i, w, best, bw;
+	Rectangle bb;
 
-	if(sdraw.softscreen==0 || screenimage == nil || !rectclip(&r, screenimage->r))
+	if(screenimage != nil && !rectclip(&r, screenimage->r))
 		return;
-	if(flushrect.min.x >= flushrect.max.x){
-		flushrect = r;
-		waste = 0;
+	if(Dx(r) <= 0 || Dy(r) <= 0)
 		return;
+    Again:
+	for(i=0; i<nflush; i++){
+		if(rectinrect(r, flushr[i]))
+			return;
+		/*
+		 * absorb if:
+		 *	rectangles touch
+		 *	total area is small
+		 *	waste is less than half total area
+		 */
+		bb = r;
+		combinerect(&bb, flushr[i]);
+		if(rectXrect(flushr[i], r) || Dx(bb)*Dy(bb) <= 1024
+		|| flushwaste(flushr[i], r)*2 < Dx(bb)*Dy(bb)){
+			r = bb;
+			flushr[i] = flushr[--nflush];
+			goto Again;
+		}
 	}
-	nbb = flushrect;
-	combinerect(&nbb, r);
-	ar = Dx(r)*Dy(r);
-	abb = Dx(flushrect)*Dy(flushrect);
-	anbb = Dx(nbb)*Dy(nbb);
-	/*
-	 * Area of new waste is area of new bb minus area of old bb,
-	 * less the area of the new segment, which we assume is not waste.
-	 * This could be negative, but that's OK.
-	 */
-	waste += anbb-abb - ar;
-	if(waste < 0)
-		waste = 0;
-	/*
-	 * absorb if:
-	 *	total area is small
-	 *	waste is less than half total area
-	 * 	rectangles touch
-	 */
-	if(anbb<=1024 || waste*2<anbb || rectXrect(flushrect, r)){
-		flushrect = nbb;
+	if(nflush == Nflush){
+		/* full: merge with the one that wastes least */
+		best = 0;
+		bw = flushwaste(flushr[0], r);
+		for(i=1; i<nflush; i++)
+			if((w = flushwaste(flushr[i], r)) < bw){
+				best = i;
+				bw = w;
+			}
+		combinerect(&r, flushr[best]);
+		flushr[best] = flushr[--nflush];
+		goto Again;
+	}
+	flushr[nflush++] = r;
+}
+
+static void
+addflush(Rectangle r)
+{
+	if(sdraw.softscreen==0 || screenimage == nil)
 		return;
+	flushadd(r);
+}
+
+/*
+ * Procs for band-parallel memimagedraw (-j nproc[,minpixels]).
+ * The proc doing the draw takes bands too, then spins
+ * until the others are done: it must not sleep, since
+ * a note would unwind it while they still use its stack.
+ */
+extern	int		drawnproc, drawbandmin;	/* set in cpu.c */
+
+static struct
+{
+	Lock	lk;
+	Rendez	*r;		/* one per worker */
+	int	nproc;
+	void	(*fn)(void*);
+	void	**arg;
+	int	n;		/* bands in this draw */
+	int	next;		/* next band to hand out */
+	int	ndone;
+} dband;
+
+static int
+dbandready(void *a)
+{
+	USED(a);
+	return dband.next < dband.n;
+}
+
+static void
+dbandwork(void)
+{
+	void (*fn)(void*);
+	void *arg;
+
+	for(;;){
+		lock(&dband.lk);
+		if(dband.next >= dband.n){
+			unlock(&dband.lk);
+			return;
+		}
+		fn = dband.fn;
+		arg = dband.arg[dband.next++];
+		unlock(&dband.lk);
+		(*fn)(arg);
+		lock(&dband.lk);
+		dband.ndone++;
+		unlock(&dband.lk);
 	}
-	/* emit current state */
-	if(flushrect.min.x < flushrect.max.x)
-		flushmemscreen(flushrect);
-	flushrect = r;
-	waste = 0;
+}
+
+static void
+dbandproc(void *a)
+{
+	Rendez *r;
+
+	r = a;
+	for(;;){
+		sleep(r, dbandready, nil);
+		dbandwork();
+	}
+}
+
+static void
+drawbands(void (*fn)(void*), void **arg, int n)
+{
+	int i;
+
+	lock(&dband.lk);
+	dband.fn = fn;
+	dband.arg = arg;
+	dband.n = n;
+	dband.next = 0;
+	dband.ndone = 0;
+	unlock(&dband.lk);
+	for(i=0; i<dband.nproc; i++)
+		wakeup(&dband.r[i]);
+	dbandwork();
+	while(dband.ndone < n)
+		osyield();
+}
+
+static void**
+drawscratch(void)
+{
+	return &up->drawscratch;
+}
+
+static void
+drawbandinit(void)
+{
+	int i;
+
+	if(drawnproc < 2 || dband.r != nil)
+		return;
+	dband.r = mallocz((drawnproc-1)*sizeof(Rendez), 1);
+	if(dband.r == nil)
+		return;
+	for(i=0; i<drawnproc-1; i++)
+		kproc("drawband", dbandproc, &dband.r[i]);
+	dband.nproc = drawnproc-1;
+	if(drawbandmin > 0)
+		memdrawbandmin = drawbandmin;
+	memdrawnband = drawnproc;
+	memdrawbands = drawbands;
 }
 
 static
@@ -404,7 +544,7 @@ dstflush(int dstid, Memimage *dst, Rectangle r)
 	Memlayer *l;
 
 	if(dstid == 0){
-		combinerect(&flushrect, r);
+		flushadd(r);
 		return;
 	}
 	if(screenimage == nil || dst == nil || (l = dst->layer) == nil)
@@ -421,9 +561,12 @@ dstflush(int dstid, Memimage *dst, Rectangle r)
 void
 drawflush(void)
 {
-	if(screenimage && flushrect.min.x < flushrect.max.x)
-		flushmemscreen(flushrect);
-	flushrect = Rect(10000, 10000, -10000, -10000);
+	int i;
+
+	if(screenimage)
+		for(i=0; i<nflush; i++)
+			flushmemscreen(flushr[i]);
+	nflush = 0;
 }
 
 int
@@ -985,6 +1128,8 @@ drawattach(char *spec)
 		dunlock();
 		error("no frame buffer");
 	}
+	memdrawscratch = drawscratch;
+	drawbandinit();
 	dunlock();
 	return devattach('i', spec);
 }
@@ -1040,7 +1185,7 @@ drawopen(Chan *c, int omode)
 		if(cl->busy)
 			error(Einuse);
 		cl->busy = 1;
-		flushrect = Rect(10000, 10000, -10000, -10000);
+		nflush = 0;
 		dn = drawlookupname(strlen(screenname), screenname);
 		if(dn == 0)
 			error("draw: cannot happen 2");
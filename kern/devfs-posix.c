@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define	_GNU_SOURCE	/* splice */
+#endif
 #include	"u.h"
 #include	<sys/types.h>
 #include	<sys/time.h>
@@ -26,6 +29,8 @@ struct Ufsinfo
 	DIR*	dir;
 	vlong	offset;
 	QLock	oq;
+	int	seq;		/* advised sequential */
+	vlong	willneed;	/* end of the range advised WILLNEED */
 	char*	path;
 	char nextname[NAME_MAX];
 };
@@ -34,6 +39,15 @@ static	Qid	fsqid(struct stat *);
 static	char*	catpath(char*, char*);
 static	ulong	fsdirread(Chan*, uchar*, int, ulong);
 static	int	fsomode(int);
+static	void	fsadvise(Ufsinfo*, vlong, long);
+
+enum
+{
+	Nwillneed	= 1024*1024,	/* read ahead of sequential readers */
+	Nsplicepipe	= 8,		/* idle pipes kept for fssendrread */
+	Npipesize	= 256*1024,	/* room for the largest Rread */
+	Rreadhdr	= BIT32SZ+BIT8SZ+BIT16SZ+BIT32SZ,
+};
 
 static char*
 lastelem(char *s)
@@ -298,6 +312,7 @@ fsread(Chan *c, void *va, long n, vlong offset)
 		nexterror();
 	}
 	fd = uif->fd;
+	fsadvise(uif, offset, n);
 	if(uif->offset != offset) {
 		r = lseek(fd, offset, 0);
 		if(r < 0)
@@ -316,6 +331,189 @@ fsread(Chan *c, void *va, long n, vlong offset)
 	return n;
 }
 
+/*
+ * Tell the host when a file is read sequentially
+ * and keep it reading Nwillneed bytes ahead.
+ * Called with uif->oq held.
+ */
+static void
+fsadvise(Ufsinfo *uif, vlong offset, long n)
+{
+#ifdef POSIX_FADV_SEQUENTIAL
+	vlong s;
+
+	if(offset != uif->offset || offset == 0){
+		if(uif->seq){
+			posix_fadvise(uif->fd, 0, 0, POSIX_FADV_NORMAL);
+			uif->seq = 0;
+		}
+		uif->willneed = 0;
+		return;
+	}
+	if(!uif->seq){
+		posix_fadvise(uif->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		uif->seq = 1;
+	}
+	if(uif->willneed < offset+n+Nwillneed/2){
+		s = uif->willneed > offset ? uif->willneed : offset;
+		posix_fadvise(uif->fd, s, Nwillneed, POSIX_FADV_WILLNEED);
+		uif->willneed = s+Nwillneed;
+	}
+#else
+	USED(uif);
+	USED(offset);
+	USED(n);
+#endif
+}
+
+/*
+ * Whether open c is a regular host file, which reads
+ * don't consume, unlike a tty or a device.
+ */
+int
+fsregular(Chan *c)
+{
+	Ufsinfo *uif;
+	struct stat st;
+
+	if(c->qid.type & QTDIR)
+		return 0;
+	uif = c->aux;
+	return fstat(uif->fd, &st) >= 0 && S_ISREG(st.st_mode);
+}
+
+#ifdef SPLICE_F_MOVE
+static struct
+{
+	Lock	lk;
+	int	fd[Nsplicepipe][2];
+	int	n;
+} splicepipes;
+
+static int
+getsplicepipe(int p[2])
+{
+	int ok;
+
+	lock(&splicepipes.lk);
+	ok = splicepipes.n > 0;
+	if(ok){
+		splicepipes.n--;
+		p[0] = splicepipes.fd[splicepipes.n][0];
+		p[1] = splicepipes.fd[splicepipes.n][1];
+	}
+	unlock(&splicepipes.lk);
+	if(ok)
+		return 0;
+	if(pipe(p) < 0)
+		return -1;
+#ifdef F_SETPIPE_SZ
+	fcntl(p[1], F_SETPIPE_SZ, Npipesize);
+#endif
+	return 0;
+}
+
+/* only empty pipes go back */
+static void
+putsplicepipe(int p[2], int empty)
+{
+	lock(&splicepipes.lk);
+	if(empty && splicepipes.n < Nsplicepipe){
+		splicepipes.fd[splicepipes.n][0] = p[0];
+		splicepipes.fd[splicepipes.n][1] = p[1];
+		splicepipes.n++;
+		empty = -1;
+	}
+	unlock(&splicepipes.lk);
+	if(empty != -1){
+		close(p[0]);
+		close(p[1]);
+	}
+}
+
+/*
+ * Write a 9P Rread for tag carrying up to n bytes of the
+ * file at offset to the host fd ofd.  The header and the
+ * file's pages go through a pipe, so the data is never
+ * copied into our memory.  Returns -1, having written
+ * nothing, if the file or ofd can't be spliced.
+ */
+long
+fssendrread(Chan *c, int ofd, int tag, long n, vlong offset)
+{
+	Ufsinfo *uif;
+	struct stat st;
+	uchar h[Rreadhdr];
+	loff_t off;
+	long r, m, w, tot;
+	int p[2];
+
+	if(c->qid.type & QTDIR)
+		return -1;
+	uif = c->aux;
+	if(fstat(uif->fd, &st) < 0 || !S_ISREG(st.st_mode))
+		return -1;
+	if(offset >= st.st_size)
+		n = 0;
+	else if(n > st.st_size - offset)
+		n = st.st_size - offset;
+	if(getsplicepipe(p) < 0)
+		return -1;
+
+	/* fill the pipe with the whole reply before sending any of it */
+	PBIT32(h, Rreadhdr+n);
+	h[BIT32SZ] = Rread;
+	PBIT16(h+BIT32SZ+BIT8SZ, tag);
+	PBIT32(h+BIT32SZ+BIT8SZ+BIT16SZ, n);
+	if(write(p[1], h, Rreadhdr) != Rreadhdr){
+		putsplicepipe(p, 0);
+		return -1;
+	}
+	off = offset;
+	for(r = 0; r < n; r += m){
+		m = splice(uif->fd, &off, p[1], nil, n-r, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if(m < 0 && errno == EINTR){
+			m = 0;
+			continue;
+		}
+		if(m <= 0){
+			/* the file shrank or the pipe is full */
+			putsplicepipe(p, 0);
+			return -1;
+		}
+	}
+
+	tot = Rreadhdr+n;
+	for(w = 0; w < tot; w += m){
+		m = splice(p[0], nil, ofd, nil, tot-w, SPLICE_F_MOVE);
+		if(m < 0 && errno == EINTR){
+			m = 0;
+			continue;
+		}
+		if(m <= 0){
+			putsplicepipe(p, 0);
+			if(w == 0)
+				return -1;
+			/* the transport now holds part of a message */
+			error(strerror(errno));
+		}
+	}
+	putsplicepipe(p, 1);
+	return n;
+}
+#else
+long
+fssendrread(Chan *c, int ofd, int tag, long n, vlong offset)
+{
+	USED(c);
+	USED(ofd);
+	USED(tag);
+	USED(n);
+	USED(offset);
+	return -1;
+}
+#endif
+
 static long
 fswrite(Chan *c, void *va, long n, vlong offset)
 {
@@ -525,6 +525,28 @@ fsread(Chan *c, void *va, long n, vlong offset)
 	return n;
 }
 
+int
+fsregular(Chan *c)
+{
+	Ufsinfo *uif;
+
+	if(c->qid.type & QTDIR)
+		return 0;
+	uif = c->aux;
+	return GetFileType(uif->fh) == FILE_TYPE_DISK;
+}
+
+long
+fssendrread(Chan *c, int ofd, int tag, long n, vlong offset)
+{
+	USED(c);
+	USED(ofd);
+	USED(tag);
+	USED(n);
+	USED(offset);
+	return -1;
+}
+
 static long
 fswrite(Chan *c, void *va, long n, vlong offset)
 {
@@ -583,6 +583,22 @@ ipwrite(Chan *ch, void *a, long n, vlong offset)
 	return n;
 }
 
+/*
+ * The host socket under a tcp data file, or -1.
+ */
+int
+iphostfd(Chan *ch)
+{
+	Conv *c;
+
+	if(TYPE(ch->qid) != Qdata)
+		return -1;
+	c = proto[PROTO(ch->qid)].conv[CONV(ch->qid)];
+	if(c->p->stype != S_TCP)
+		return -1;
+	return c->sfd;
+}
+
 static Conv*
 protoclone(Proto *p, char *user, int nfd)
 {
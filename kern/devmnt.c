@@ -22,20 +22,49 @@ struct Mntrpc
 {
 	Chan*	c;		/* Channel for whom we are working */
 	Mntrpc*	list;		/* Free/pending list */
+	Mntrpc*	prev;		/* pending list */
 	Fcall	request;	/* Outgoing file system protocol message */
 	Fcall 	reply;		/* Incoming reply */
 	Mnt*	m;		/* Mount device during rpc */
 	Rendez*	z;		/* Place to hang out */
 	Block*	b;		/* reply blocks */
 	Mntrpc*	flushed;	/* message this one flushes */
+	Mnt*	owner;		/* whose free list and tags it uses */
+	ulong	t0;		/* ticks when sent */
 	char	done;		/* Rpc completed */
 };
 
+/*
+ * Rpcs an open Chan on a mount with MRAH or MWB keeps
+ * in flight, kept in c->aux.  r holds Treads, oldest
+ * first, for consecutive iounit pieces starting at the
+ * offset the next read is expected at; w holds Twrites
+ * sent behind, for consecutive pieces ending at woff.
+ */
+typedef struct Mntwin Mntwin;
+struct Mntwin
+{
+	QLock	lk;
+	vlong	off;		/* offset the next sequential read starts at */
+	int	seq;		/* sequential reads in a row */
+	vlong	roff;		/* offset of the next Tread to send */
+	int	i;		/* oldest rpc in r */
+	int	n;		/* rpcs in r */
+	ulong	used;		/* bytes of r[i] already returned */
+	Mntrpc	*r[16];
+
+	vlong	woff;		/* offset the next sequential write starts at */
+	int	wi;		/* oldest rpc in w */
+	int	wn;		/* rpcs in w */
+	Mntrpc	*w[16];
+	char	err[ERRMAX];	/* write error not yet reported */
+};
+
 enum
 {
-	TAGSHIFT = 5,
-	TAGMASK = (1<<TAGSHIFT)-1,
-	NMASK = (64*1024)>>TAGSHIFT,
+	NRAH = 4,		/* default window for MRAH and MWB */
+	NRPCFREE = 32,		/* free Mntrpcs kept per Mnt */
+	NBFREE = 32,		/* free MAXRPC Blocks kept */
 };
 
 static struct Mntalloc
@@ -43,13 +72,13 @@ static struct Mntalloc
 	Lock	lk;
 	Mnt*	list;		/* Mount devices in use */
 	Mnt*	mntfree;	/* Free list */
-	Mntrpc*	rpcfree;
-	ulong	nrpcfree;
-	ulong	nrpcused;
 	ulong	id;
-	u32int	tagmask[NMASK];
+	Lock	blk;
+	Block*	bfree;		/* MAXRPC Blocks for requests and replies */
+	int	nbfree;
 } mntalloc;
 
+static Block*	mntballoc(int);
 static Chan*	mntchan(void);
 static Mnt*	mntchk(Chan*);
 static void	mntdirfix(uchar*, Chan*);
@@ -57,14 +86,28 @@ static Mntrpc*	mntflushalloc(Mntrpc*);
 static Mntrpc*	mntflushfree(Mnt*, Mntrpc*);
 static void	mntfree(Mntrpc*);
 static void	mntgate(Mnt*);
+static void	mntqadd(Mnt*, Mntrpc*);
+static void	mntqdel(Mnt*, Mntrpc*);
 static void	mntqrm(Mnt*, Mntrpc*);
-static Mntrpc*	mntralloc(Chan*);
+static Mntrpc*	mntralloc(Mnt*, Chan*);
 static long	mntrdwr(int, Chan*, void*, long, vlong);
+static long	mntcacheread(Chan*, uchar*, long, vlong);
+static void	mntrahcancel(Mnt*, Mntwin*);
+static long	mntrahread(Mnt*, Chan*, uchar*, long, vlong);
 static int	mntrpcread(Mnt*, Mntrpc*);
+static void	mntsend(Mnt*, Mntrpc*);
 static void	mountio(Mnt*, Mntrpc*);
 static void	mountmux(Mnt*, Mntrpc*);
+static void	mntreader(void*);
 static void	mountrpc(Mnt*, Mntrpc*);
+static void	mntwbdrain(Mnt*, Mntwin*);
+static void	mntwbsync(Mnt*, Chan*, int);
+static long	mntwbwrite(Mnt*, Chan*, uchar*, long, vlong);
+static Mntwin*	mntwin(Chan*);
+static char*	mntwinfree(Mnt*, Chan*, char*);
 static int	rpcattn(void*);
+static int	mntreaderattn(void*);
+static int	mntreaderdone(void*);
 
 char	Esbadstat[] = "invalid directory entry received from server";
 char	Enoversion[] = "version not established for mount channel";
@@ -74,8 +117,6 @@ static void
 mntreset(void)
 {
 	mntalloc.id = 1;
-	mntalloc.tagmask[0] = 1;			/* don't allow 0 as a tag */
-	mntalloc.tagmask[NMASK-1] = 0x80000000;		/* don't allow NOTAG */
 	fmtinstall('F', fcallfmt);
 	fmtinstall('D', dirfmt);
 /* We can't install %M since eipfmt does and is used in the kernel [sape] */
@@ -208,7 +249,7 @@ mntversion(Chan *c, char *version, int msize, int returnlen)
 		mntalloc.mntfree = m->list;
 	else {
 		unlock(&mntalloc.lk);
-		m = malloc(sizeof(Mnt));
+		m = mallocz(sizeof(Mnt), 1);
 		if(m == nil) {
 			qfree(q);
 			free(v);
@@ -222,6 +263,17 @@ mntversion(Chan *c, char *version, int msize, int returnlen)
 	m->id = mntalloc.id++;
 	m->q = q;
 	m->msize = f.msize;
+	m->nrah = 0;
+	m->nwb = 0;
+	m->kproc = 0;
+	m->reader = nil;
+	m->closing = 0;
+	m->nq = 0;
+	m->maxq = 0;
+	m->nrpc = 0;
+	m->rpcms = 0;
+	m->maxms = 0;
+	m->tagnext = 1;		/* don't allow 0 as a tag */
 	unlock(&mntalloc.lk);
 
 	if(returnlen > 0)
@@ -268,7 +320,7 @@ mntauth(Chan *c, char *spec)
 		nexterror();
 	}
 
-	r = mntralloc(c);
+	r = mntralloc(m, c);
 	if(waserror()) {
 		mntfree(r);
 		nexterror();
@@ -301,6 +353,7 @@ mntattach(Chan *c, Chan *ac, char *spec, int flags)
 {
 	Mnt *m;
 	Mntrpc *r;
+	int n;
 
 	if(ac != nil && ac->mchan != c)
 		error(Ebadusefd);
@@ -322,7 +375,7 @@ mntattach(Chan *c, Chan *ac, char *spec, int flags)
 		nexterror();
 	}
 
-	r = mntralloc(c);
+	r = mntralloc(m, c);
 	if(waserror()) {
 		mntfree(r);
 		nexterror();
@@ -349,6 +402,25 @@ mntattach(Chan *c, Chan *ac, char *spec, int flags)
 
 	if(flags&MCACHE)
 		c->flag |= CCACHE;
+	if(flags&(MRAH|MWB)){
+		lock(&m->lk);
+		n = (flags>>8)&0xF;
+		if(n == 0)
+			n = NRAH;
+		if(flags&MRAH)
+			m->nrah = n;
+		if(flags&MWB)
+			m->nwb = n;
+		unlock(&m->lk);
+	}
+	if(flags&MKPROC){
+		lock(&m->lk);
+		n = m->kproc;
+		m->kproc = 1;
+		unlock(&m->lk);
+		if(!n)
+			kproc("mntreader", mntreader, m);
+	}
 	return c;
 }
 
@@ -398,7 +470,7 @@ mntwalk(Chan *c, Chan *nc, char **name, int nname)
 
 	alloc = 0;
 	m = mntchk(c);
-	r = mntralloc(c);
+	r = mntralloc(m, c);
 	if(nc == nil){
 		nc = devclone(c);
 		/*
@@ -466,7 +538,8 @@ mntstat(Chan *c, uchar *dp, int n)
 	if(n < BIT16SZ)
 		error(Eshortstat);
 	m = mntchk(c);
-	r = mntralloc(c);
+	mntwbsync(m, c, 0);
+	r = mntralloc(m, c);
 	if(waserror()) {
 		mntfree(r);
 		nexterror();
@@ -496,7 +569,7 @@ mntopencreate(int type, Chan *c, char *name, int omode, ulong perm)
 	Mntrpc *r;
 
 	m = mntchk(c);
-	r = mntralloc(c);
+	r = mntralloc(m, c);
 	if(waserror()) {
 		mntfree(r);
 		nexterror();
@@ -520,6 +593,12 @@ mntopencreate(int type, Chan *c, char *name, int omode, ulong perm)
 	poperror();
 	mntfree(r);
 
+	if(c->flag & CCACHE){
+		if(type == Tcreate || (omode&OTRUNC))
+			ctrunc(c);
+		else
+			copen(c);
+	}
 	return c;
 }
 
@@ -540,9 +619,11 @@ mntclunk(Chan *c, int t)
 {
 	Mnt *m;
 	Mntrpc *r;
+	char *err, buf[ERRMAX];
 
 	m = mntchk(c);
-	r = mntralloc(c);
+	err = mntwinfree(m, c, buf);
+	r = mntralloc(m, c);
 	if(waserror()) {
 		mntfree(r);
 		nexterror();
@@ -552,6 +633,8 @@ mntclunk(Chan *c, int t)
 	mountrpc(m, r);
 	mntfree(r);
 	poperror();
+	if(err != nil)
+		error(err);
 }
 
 void
@@ -560,10 +643,41 @@ muxclose(Mnt *m)
 	Mnt *f, **l;
 	Mntrpc *r;
 
+	/*
+	 * The reader kproc only holds m->c while there are
+	 * requests, so here it is idle or is the caller.
+	 */
+	lock(&m->lk);
+	if(m->kproc && m->reader != up){
+		m->closing = 1;
+		wakeup(&m->rz);
+		unlock(&m->lk);
+		while(waserror())
+			;
+		sleep(&m->cz, mntreaderdone, m);
+		poperror();
+	} else
+		unlock(&m->lk);
+	m->kproc = 0;
+	m->reader = nil;
+
 	while((r = m->queue) != nil){
-		m->queue = r->list;
+		mntqdel(m, r);
 		mntfree(r);
 	}
+	while((r = m->rpcfree) != nil){
+		m->rpcfree = r->list;
+		free(r);
+	}
+	m->nrpcfree = 0;
+	free(m->tagfree);
+	m->tagfree = nil;
+	m->ntagfree = 0;
+	m->natagfree = 0;
+	m->tagnext = 0;
+	free(m->tags);
+	m->tags = nil;
+	m->ntags = 0;
 	m->id = 0;
 	free(m->version);
 	m->version = nil;
@@ -603,7 +717,9 @@ mntwstat(Chan *c, uchar *dp, int n)
 	Mntrpc *r;
 
 	m = mntchk(c);
-	r = mntralloc(c);
+	/* a wstat that changes nothing is fsync: report write errors */
+	mntwbsync(m, c, 1);
+	r = mntralloc(m, c);
 	if(waserror()) {
 		mntfree(r);
 		nexterror();
@@ -615,6 +731,8 @@ mntwstat(Chan *c, uchar *dp, int n)
 	mountrpc(m, r);
 	poperror();
 	mntfree(r);
+	if(c->flag & CCACHE)
+		ctrunc(c);
 	return n;
 }
 
@@ -625,6 +743,8 @@ mntread(Chan *c, void *buf, long n, vlong off)
 	int dirlen;
 
 	p = buf;
+	if(ccachable(c))
+		return mntcacheread(c, p, n, off);
 	n = mntrdwr(Tread, c, p, n, off);
 	if(c->qid.type & QTDIR) {
 		for(e = &p[n]; p+BIT16SZ < e; p += dirlen){
@@ -643,7 +763,57 @@ mntread(Chan *c, void *buf, long n, vlong off)
 static long
 mntwrite(Chan *c, void *buf, long n, vlong off)
 {
-	return mntrdwr(Twrite, c, buf, n, off);
+	n = mntrdwr(Twrite, c, buf, n, off);
+	if(c->flag & CCACHE)
+		cwrite(c, buf, n, off);
+	return n;
+}
+
+/*
+ * Reads on MCACHE mounts are served from the client
+ * cache, fetching whole CACHEBLK blocks on a miss.
+ */
+static long
+mntcacheread(Chan *c, uchar *buf, long n, vlong off)
+{
+	uchar *b;
+	long cnt, k, nr, o;
+	vlong bo;
+
+	b = nil;
+	if(waserror()){
+		free(b);
+		nexterror();
+	}
+	cnt = 0;
+	while(n > 0){
+		k = cread(c, buf, n, off);
+		if(k == 0)
+			break;
+		if(k < 0){
+			if(b == nil)
+				b = smalloc(CACHEBLK);
+			o = off%CACHEBLK;
+			bo = off-o;
+			nr = mntrdwr(Tread, c, b, CACHEBLK, bo);
+			cupdate(c, b, nr, bo);
+			if(nr <= o)
+				break;
+			k = nr-o;
+			if(k > n)
+				k = n;
+			memmove(buf, b+o, k);
+			if(nr < CACHEBLK)
+				n = k;
+		}
+		buf += k;
+		off += k;
+		n -= k;
+		cnt += k;
+	}
+	poperror();
+	free(b);
+	return cnt;
 }
 
 static long
@@ -651,10 +821,28 @@ mntrdwr(int type, Chan *c, void *buf, long n, vlong off)
 {
 	Mnt *m;
  	Mntrpc *r;
+	Mntwin *w;
 	char *uba;
 	ulong cnt, nr, nreq;
+	long l;
 
 	m = mntchk(c);
+	if((c->qid.type & (QTDIR|QTAPPEND|QTEXCL)) == 0){
+		l = -1;
+		if(type == Tread){
+			if(m->nrah > 0 || c->aux != nil)
+				l = mntrahread(m, c, buf, n, off);
+		} else if(m->nwb > 0)
+			l = mntwbwrite(m, c, buf, n, off);
+		else if((w = c->aux) != nil){
+			/* don't return data read ahead of this write */
+			qlock(&w->lk);
+			mntrahcancel(m, w);
+			qunlock(&w->lk);
+		}
+		if(l != -1)
+			return l;
+	}
 	uba = buf;
 	cnt = 0;
 
@@ -663,7 +851,7 @@ mntrdwr(int type, Chan *c, void *buf, long n, vlong off)
 		if(nreq > c->iounit)
 			nreq = c->iounit;
 
-		r = mntralloc(c);
+		r = mntralloc(m, c);
 		if(waserror()) {
 			mntfree(r);
 			nexterror();
@@ -692,14 +880,326 @@ mntrdwr(int type, Chan *c, void *buf, long n, vlong off)
 	return cnt;
 }
 
+static Mntwin*
+mntwin(Chan *c)
+{
+	Mntwin *w;
+
+	if((w = c->aux) != nil)
+		return w;
+	w = mallocz(sizeof(Mntwin), 1);
+	if(w == nil)
+		return nil;
+	lock(&c->lk);
+	if(c->aux == nil)
+		c->aux = w;
+	else {
+		free(w);
+		w = c->aux;
+	}
+	unlock(&c->lk);
+	return w;
+}
+
+/*
+ * Cancel reads and wait for writes in flight on a Chan
+ * being clunked.  A write error not yet reported is
+ * copied to buf and returned.
+ */
+static char*
+mntwinfree(Mnt *m, Chan *c, char *buf)
+{
+	Mntwin *w;
+	char *err;
+
+	w = c->aux;
+	if(w == nil)
+		return nil;
+	c->aux = nil;
+	qlock(&w->lk);
+	mntrahcancel(m, w);
+	mntwbdrain(m, w);
+	err = nil;
+	if(w->err[0] != '\0'){
+		strecpy(buf, buf+ERRMAX, w->err);
+		err = buf;
+	}
+	qunlock(&w->lk);
+	free(w);
+	return err;
+}
+
+/*
+ * Send Treads until the window is full.
+ */
+static void
+mntrahfill(Mnt *m, Chan *c, Mntwin *w)
+{
+	Mntrpc *r;
+
+	while(w->n < m->nrah){
+		r = mntralloc(m, c);
+		if(waserror()){
+			mntqrm(m, r);
+			mntfree(r);
+			nexterror();
+		}
+		r->request.type = Tread;
+		r->request.fid = c->fid;
+		r->request.offset = w->roff;
+		r->request.count = c->iounit;
+		mntsend(m, r);
+		poperror();
+		w->r[(w->i+w->n)%nelem(w->r)] = r;
+		w->n++;
+		w->roff += c->iounit;
+	}
+}
+
+/*
+ * Throw away everything read ahead.  Unanswered Treads
+ * are flushed, all at once so this costs a single round
+ * trip; their tags can't be reused before the Rflush.
+ */
+static void
+mntrahcancel(Mnt *m, Mntwin *w)
+{
+	Mntrpc *r, *f[nelem(w->r)];
+	int k;
+
+	for(k = 0; k < w->n; k++){
+		r = w->r[(w->i+k)%nelem(w->r)];
+		f[k] = nil;
+		if(r->done)
+			continue;
+		f[k] = mntflushalloc(r);
+		if(waserror()){
+			mntflushfree(m, f[k]);
+			f[k] = nil;
+			continue;
+		}
+		mntsend(m, f[k]);
+		poperror();
+	}
+	for(k = 0; k < w->n; k++){
+		if(f[k] != nil && !waserror()){
+			mountio(m, f[k]);
+			poperror();
+		}
+		mntfree(w->r[(w->i+k)%nelem(w->r)]);
+	}
+	w->i = 0;
+	w->n = 0;
+	w->used = 0;
+	w->seq = 0;
+}
+
+/*
+ * Read through the read-ahead window once a Chan has been
+ * read sequentially.  Returns -1 when the caller should
+ * do an ordinary read instead.
+ */
+static long
+mntrahread(Mnt *m, Chan *c, uchar *buf, long n, vlong off)
+{
+	Mntwin *w;
+	Mntrpc *r;
+	ulong nr, k, cnt;
+	int eof;
+
+	if((w = mntwin(c)) == nil)
+		return -1;
+
+	/* someone else is using this Chan; don't wait on them */
+	if(!canqlock(&w->lk))
+		return -1;
+	if(w->wn > 0)
+		mntwbdrain(m, w);
+	if(m->nrah == 0){
+		qunlock(&w->lk);
+		return -1;
+	}
+	if(off != w->off)
+		mntrahcancel(m, w);
+	w->off = off+n;
+	if(w->seq++ == 0){
+		qunlock(&w->lk);
+		return -1;
+	}
+
+	if(waserror()){
+		mntrahcancel(m, w);
+		qunlock(&w->lk);
+		nexterror();
+	}
+	if(w->n == 0)
+		w->roff = off;
+	cnt = 0;
+	while(n > 0){
+		mntrahfill(m, c, w);
+		r = w->r[w->i];
+		if(w->used == 0)
+			mountrpc(m, r);
+		nr = r->reply.count;
+		if(nr > r->request.count)
+			nr = r->request.count;
+		k = nr - w->used;
+		if(k > n)
+			k = n;
+		k = readblist(r->b, buf, k, w->used);
+		w->used += k;
+		buf += k;
+		cnt += k;
+		n -= k;
+		if(w->used < nr)
+			continue;
+
+		/* done with this one */
+		w->r[w->i] = nil;
+		w->i = (w->i+1)%nelem(w->r);
+		w->n--;
+		w->used = 0;
+		eof = nr < r->request.count;
+		mntfree(r);
+		if(eof){
+			/* short read: the rest of the window is past the end */
+			mntrahcancel(m, w);
+			break;
+		}
+	}
+	w->off = off+cnt;
+	poperror();
+	qunlock(&w->lk);
+	return cnt;
+}
+
+/*
+ * Wait for the oldest write sent behind.  The first
+ * error is kept for the next write, wstat or clunk.
+ */
+static void
+mntwbreap(Mnt *m, Mntwin *w)
+{
+	Mntrpc *r;
+
+	r = w->w[w->wi];
+	w->w[w->wi] = nil;
+	w->wi = (w->wi+1)%nelem(w->w);
+	w->wn--;
+	if(!waserror()){
+		mountrpc(m, r);
+		if(r->reply.count < r->request.count && w->err[0] == '\0')
+			strecpy(w->err, w->err+ERRMAX, "short write");
+		poperror();
+	} else if(w->err[0] == '\0')
+		strecpy(w->err, w->err+ERRMAX, up->errstr);
+	mntfree(r);
+}
+
+static void
+mntwbdrain(Mnt *m, Mntwin *w)
+{
+	while(w->wn > 0)
+		mntwbreap(m, w);
+}
+
+/*
+ * Wait for the writes on c; with report set, raise the
+ * error one of them got.
+ */
+static void
+mntwbsync(Mnt *m, Chan *c, int report)
+{
+	Mntwin *w;
+	char buf[ERRMAX];
+
+	if((w = c->aux) == nil)
+		return;
+	qlock(&w->lk);
+	mntwbdrain(m, w);
+	if(!report || w->err[0] == '\0'){
+		qunlock(&w->lk);
+		return;
+	}
+	strecpy(buf, buf+sizeof buf, w->err);
+	w->err[0] = '\0';
+	qunlock(&w->lk);
+	error(buf);
+}
+
+/*
+ * Send the Twrites for a sequential write and return
+ * without waiting for all of them: up to m->nwb stay in
+ * flight.  Writes that are not sequential wait for the
+ * previous ones first, so those in flight never overlap.
+ * Returns -1 when the caller should do an ordinary write.
+ */
+static long
+mntwbwrite(Mnt *m, Chan *c, uchar *buf, long n, vlong off)
+{
+	Mntwin *w;
+	Mntrpc *r;
+	ulong nreq, cnt;
+	char err[ERRMAX];
+
+	if((w = mntwin(c)) == nil)
+		return -1;
+	qlock(&w->lk);
+	if(waserror()){
+		qunlock(&w->lk);
+		nexterror();
+	}
+	mntrahcancel(m, w);
+	if(off != w->woff || n == 0)
+		mntwbdrain(m, w);
+	cnt = 0;
+	while(w->err[0] == '\0' && n > 0){
+		if(w->wn == m->nwb){
+			mntwbreap(m, w);
+			continue;
+		}
+		nreq = n;
+		if(nreq > c->iounit)
+			nreq = c->iounit;
+		r = mntralloc(m, c);
+		if(waserror()){
+			mntqrm(m, r);
+			mntfree(r);
+			nexterror();
+		}
+		r->request.type = Twrite;
+		r->request.fid = c->fid;
+		r->request.offset = off;
+		r->request.data = (char*)buf;
+		r->request.count = nreq;
+		mntsend(m, r);
+		poperror();
+		w->w[(w->wi+w->wn)%nelem(w->w)] = r;
+		w->wn++;
+		off += nreq;
+		buf += nreq;
+		cnt += nreq;
+		n -= nreq;
+	}
+	w->woff = off;
+	if(w->err[0] != '\0'){
+		mntwbdrain(m, w);
+		strecpy(err, err+sizeof err, w->err);
+		w->err[0] = '\0';
+		error(err);
+	}
+	poperror();
+	qunlock(&w->lk);
+	if(cnt == 0)
+		return -1;
+	return cnt;
+}
+
 static void
 mountrpc(Mnt *m, Mntrpc *r)
 {
 	int t;
 
-	r->reply.tag = 0;
-	r->reply.type = Tmax;	/* can't ever be a valid message type */
-
 	mountio(m, r);
 
 	t = r->reply.type;
@@ -719,12 +1219,47 @@ mountrpc(Mnt *m, Mntrpc *r)
 	}
 }
 
+/*
+ * Queue r for its reply and transmit it.
+ */
 static void
-mountio(Mnt *m, Mntrpc *r)
+mntsend(Mnt *m, Mntrpc *r)
 {
 	Block *b;
 	int n;
 
+	r->reply.tag = 0;
+	r->reply.type = Tmax;	/* can't ever be a valid message type */
+
+	lock(&m->lk);
+	r->m = m;
+	r->t0 = ticks();
+	mntqadd(m, r);
+	if(m->kproc)
+		wakeup(&m->rz);
+	unlock(&m->lk);
+
+	/* Transmit a file system rpc */
+	n = sizeS2M(&r->request);
+	b = mntballoc(n);
+	if(waserror()){
+		freeb(b);
+		nexterror();
+	}
+	n = convS2M(&r->request, b->wp, n);
+	if(n <= 0 || n > m->msize) {
+		print("mountio: proc %s %lud: convS2M returned %d for tag %d fid %d T%d\n",
+			up->text, up->pid, n, r->request.tag, r->request.fid, r->request.type);
+		error(Emountrpc);
+	}
+	b->wp += n;
+	poperror();
+	devtab[m->c->type]->bwrite(m->c, b, 0);
+}
+
+static void
+mountio(Mnt *m, Mntrpc *r)
+{
 	while(waserror()) {
 		if(m->rip == up)
 			mntgate(m);
@@ -743,34 +1278,20 @@ mountio(Mnt *m, Mntrpc *r)
 		poperror();
 	}
 
+	/*
+	 * An rpc sent ahead of time is only waited for, maybe
+	 * by another proc than the one that sent it.
+	 */
 	lock(&m->lk);
 	r->z = &up->sleep;
-	r->m = m;
-	r->list = m->queue;
-	m->queue = r;
 	unlock(&m->lk);
-
-	/* Transmit a file system rpc */
-	n = sizeS2M(&r->request);
-	b = allocb(n);
-	if(waserror()){
-		freeb(b);
-		nexterror();
-	}
-	n = convS2M(&r->request, b->wp, n);
-	if(n <= 0 || n > m->msize) {
-		print("mountio: proc %s %lud: convS2M returned %d for tag %d fid %d T%d\n",
-			up->text, up->pid, n, r->request.tag, r->request.fid, r->request.type);
-		error(Emountrpc);
-	}
-	b->wp += n;
-	poperror();
-	devtab[m->c->type]->bwrite(m->c, b, 0);
+	if(r->m == nil)
+		mntsend(m, r);
 
 	/* Gate readers onto the mount point one at a time */
 	for(;;) {
 		lock(&m->lk);
-		if(m->rip == nil)
+		if(m->rip == nil && !m->kproc)
 			break;
 		unlock(&m->lk);
 		sleep(r->z, rpcattn, r);
@@ -796,9 +1317,21 @@ static int
 doread(Mnt *m, int len)
 {
 	Block *b;
+	Dev *d;
 
+	d = devtab[m->c->type];
 	while(qlen(m->q) < len){
-		b = devtab[m->c->type]->bread(m->c, m->msize, 0);
+		if(d->bread == devbread){
+			/* devbread would allocate; read into a pooled block */
+			b = mntballoc(m->msize);
+			if(waserror()){
+				freeb(b);
+				nexterror();
+			}
+			b->wp += d->read(m->c, b->wp, m->msize, 0);
+			poperror();
+		} else
+			b = d->bread(m->c, m->msize, 0);
 		if(b == nil || qaddlist(m->q, b) == 0)
 			return -1;
 	}
@@ -864,7 +1397,7 @@ mntrpcread(Mnt *m, Mntrpc *r)
 			l = &(b->next);
 		} else {
 			/* split block and put unused bit back */
-			nb = allocb(i-len);
+			nb = mntballoc(i-len);
 			memmove(nb->wp, b->rp+len, i-len);
 			b->wp = b->rp+len;
 			nb->wp += i-len;
@@ -884,8 +1417,10 @@ mntgate(Mnt *m)
 
 	lock(&m->lk);
 	m->rip = nil;
+	if(m->kproc)
+		wakeup(&m->rz);
 	for(q = m->queue; q != nil; q = q->list) {
-		if(q->done == 0)
+		if(q->done == 0 && q->z != nil)
 		if(wakeup(q->z))
 			break;
 	}
@@ -895,38 +1430,131 @@ mntgate(Mnt *m)
 static void
 mountmux(Mnt *m, Mntrpc *r)
 {
-	Mntrpc **l, *q;
+	Mntrpc *q;
 	Rendez *z;
+	ulong t;
 
 	lock(&m->lk);
-	l = &m->queue;
-	for(q = *l; q != nil; q = q->list) {
-		/* look for a reply to a message */
-		if(q->request.tag == r->reply.tag) {
-			*l = q->list;
-			if(q == r) {
-				q->done = 1;
-				unlock(&m->lk);
-				return;
+	q = nil;
+	if(r->reply.tag < m->ntags)
+		q = m->tags[r->reply.tag];
+	if(q == nil){
+		unlock(&m->lk);
+		print("unexpected reply tag %ud; type %d\n", r->reply.tag, r->reply.type);
+		return;
+	}
+	mntqdel(m, q);
+	t = ticks() - q->t0;
+	m->nrpc++;
+	m->rpcms += t;
+	if(t > m->maxms)
+		m->maxms = t;
+	if(q == r) {
+		q->done = 1;
+		unlock(&m->lk);
+		return;
+	}
+	/*
+	 * Completed someone else.
+	 * Trade pointers to receive buffer.
+	 */
+	q->reply = r->reply;
+	q->b = r->b;
+	r->b = nil;
+	z = q->z;
+	// coherence();
+	q->done = 1;
+	if(z != nil)
+		wakeup(z);
+	unlock(&m->lk);
+}
+
+/*
+ * Reads replies for a mount with MKPROC.  It has m->c
+ * referenced and holds m->rip only while requests are
+ * pending, so an idle mount can still be closed.
+ */
+static void
+mntreader(void *a)
+{
+	Mnt *m;
+	Mntrpc *r;
+	Chan *c;
+	int err;
+
+	m = a;
+	/* don't pin the mounter's files or namespace */
+	closefgrp(up->fgrp);
+	up->fgrp = nil;
+	closepgrp(up->pgrp);
+	up->pgrp = nil;
+	cclose(up->dot);
+	up->dot = cclone(up->slash);
+
+	r = mallocz(sizeof(Mntrpc), 1);
+	lock(&m->lk);
+	m->reader = up;
+	while(r != nil){
+		while(!mntreaderattn(m)){
+			unlock(&m->lk);
+			while(waserror())
+				;
+			sleep(&m->rz, mntreaderattn, m);
+			poperror();
+			lock(&m->lk);
+		}
+		if(m->closing)
+			break;
+		m->rip = up;
+		c = m->c;
+		incref(&c->ref);
+		unlock(&m->lk);
+
+		err = 0;
+		while(!err){
+			if(waserror()){
+				err = 1;
+				break;
 			}
-			/*
-			 * Completed someone else.
-			 * Trade pointers to receive buffer.
-			 */
-			q->reply = r->reply;
-			q->b = r->b;
+			if(mntrpcread(m, r) < 0)
+				err = 1;
+			else
+				mountmux(m, r);
+			poperror();
+			freeblist(r->b);
 			r->b = nil;
-			z = q->z;
-			// coherence();
-			q->done = 1;
-			wakeup(z);
+			lock(&m->lk);
+			if(m->queue == nil){
+				unlock(&m->lk);
+				break;
+			}
 			unlock(&m->lk);
-			return;
 		}
-		l = &q->list;
+		if(err){
+			/* let the waiters read and get the error themselves */
+			lock(&m->lk);
+			m->kproc = 0;
+			unlock(&m->lk);
+		}
+		mntgate(m);
+
+		/* the last reference: close it here, it takes m with it */
+		if(decref(&c->ref) == 0){
+			incref(&c->ref);
+			free(r);
+			cclose(c);
+			pexit("", 0);
+		}
+		lock(&m->lk);
+		if(err)
+			break;
 	}
+	m->kproc = 0;
+	m->reader = nil;
+	wakeup(&m->cz);
 	unlock(&m->lk);
-	print("unexpected reply tag %ud; type %d\n", r->reply.tag, r->reply.type);
+	free(r);
+	pexit("", 0);
 }
 
 /*
@@ -938,7 +1566,7 @@ mntflushalloc(Mntrpc *r)
 {
 	Mntrpc *fr;
 
-	fr = mntralloc(r->c);
+	fr = mntralloc(r->owner, r->c);
 	fr->request.type = Tflush;
 	if(r->request.type == Tflush)
 		fr->request.oldtag = r->request.oldtag;
@@ -975,56 +1603,107 @@ mntflushfree(Mnt *m, Mntrpc *r)
 	return r;
 }
 
-static int
-alloctag(void)
+/*
+ * Blocks of MAXRPC bytes carry requests and, for devices
+ * without a bread of their own, replies.  They return to
+ * mntalloc.bfree when freed.
+ */
+static void
+mntbfree(Block *b)
 {
-	int i, j;
-	u32int v;
+	lock(&mntalloc.blk);
+	if(mntalloc.nbfree < NBFREE){
+		b->next = mntalloc.bfree;
+		mntalloc.bfree = b;
+		mntalloc.nbfree++;
+		unlock(&mntalloc.blk);
+		return;
+	}
+	unlock(&mntalloc.blk);
+	b->free = nil;
+	freeb(b);
+}
 
-	for(i = 0; i < NMASK; i++){
-		v = mntalloc.tagmask[i];
-		if(v == -1)
-			continue;
-		for(j = 0; (v & 1) != 0; j++)
-			v >>= 1;
-		mntalloc.tagmask[i] |= 1<<j;
-		return i<<TAGSHIFT | j;
+static Block*
+mntballoc(int n)
+{
+	Block *b;
+
+	if(n > MAXRPC)
+		return allocb(n);
+	lock(&mntalloc.blk);
+	b = mntalloc.bfree;
+	if(b != nil){
+		mntalloc.bfree = b->next;
+		mntalloc.nbfree--;
 	}
-	panic("no friggin tags left");
-	return NOTAG;
+	unlock(&mntalloc.blk);
+	if(b == nil){
+		b = allocb(MAXRPC);
+		b->free = mntbfree;
+	}
+	b->next = nil;
+	b->list = nil;
+	b->flag = 0;
+	b->rp = b->lim - ROUND(MAXRPC, BLOCKALIGN);
+	b->wp = b->rp;
+	return b;
+}
+
+/*
+ * Tags are per Mnt.  An Mntrpc keeps its tag while on
+ * the free list; tags of those freed go on m->tagfree.
+ * Called with m->lk held.
+ */
+static int
+alloctag(Mnt *m)
+{
+	if(m->ntagfree > 0)
+		return m->tagfree[--m->ntagfree];
+	if(m->tagnext >= NOTAG)
+		panic("no friggin tags left");
+	return m->tagnext++;
 }
 
 static void
-freetag(int t)
+freetag(Mnt *m, int t)
 {
-	mntalloc.tagmask[t>>TAGSHIFT] &= ~(1<<(t&TAGMASK));
+	ushort *f;
+
+	if(m->ntagfree == m->natagfree){
+		f = realloc(m->tagfree, m->tagnext*sizeof(ushort));
+		if(f == nil)
+			return;		/* lose the tag */
+		m->tagfree = f;
+		m->natagfree = m->tagnext;
+	}
+	m->tagfree[m->ntagfree++] = t;
 }
 
 static Mntrpc*
-mntralloc(Chan *c)
+mntralloc(Mnt *m, Chan *c)
 {
 	Mntrpc *new;
 
-	if(mntalloc.nrpcfree == 0) {
-	Alloc:
+	lock(&m->lk);
+	new = m->rpcfree;
+	if(new != nil){
+		m->rpcfree = new->list;
+		m->nrpcfree--;
+		unlock(&m->lk);
+	} else {
+		unlock(&m->lk);
 		new = malloc(sizeof(Mntrpc));
 		if(new == nil)
 			exhausted("mount rpc header");
-		lock(&mntalloc.lk);
-		new->request.tag = alloctag();
-	} else {
-		lock(&mntalloc.lk);
-		new = mntalloc.rpcfree;
-		if(new == nil) {
-			unlock(&mntalloc.lk);
-			goto Alloc;
-		}
-		mntalloc.rpcfree = new->list;
-		mntalloc.nrpcfree--;
+		lock(&m->lk);
+		new->request.tag = alloctag(m);
+		unlock(&m->lk);
+		new->owner = m;
 	}
-	mntalloc.nrpcused++;
-	unlock(&mntalloc.lk);
 	new->c = c;
+	new->m = nil;
+	new->z = nil;
 	new->done = 0;
 	new->flushed = nil;
 	new->b = nil;
@@ -1034,38 +1713,102 @@ mntralloc(Chan *c)
 static void
 mntfree(Mntrpc *r)
 {
+	Mnt *m;
+
 	freeblist(r->b);
-	lock(&mntalloc.lk);
-	mntalloc.nrpcused--;
-	if(mntalloc.nrpcfree < 32) {
-		r->list = mntalloc.rpcfree;
-		mntalloc.rpcfree = r;
-		mntalloc.nrpcfree++;
-		unlock(&mntalloc.lk);
+	m = r->owner;
+	lock(&m->lk);
+	if(m->nrpcfree < NRPCFREE) {
+		r->list = m->rpcfree;
+		m->rpcfree = r;
+		m->nrpcfree++;
+		unlock(&m->lk);
 		return;
 	}
-	freetag(r->request.tag);
-	unlock(&mntalloc.lk);
+	freetag(m, r->request.tag);
+	unlock(&m->lk);
 	free(r);
 }
 
 static void
 mntqrm(Mnt *m, Mntrpc *r)
 {
-	Mntrpc **l, *f;
-
 	lock(&m->lk);
 	r->done = 1;
+	if(r->request.tag < m->ntags && m->tags[r->request.tag] == r)
+		mntqdel(m, r);
+	unlock(&m->lk);
+}
 
-	l = &m->queue;
-	for(f = *l; f != nil; f = f->list) {
-		if(f == r) {
-			*l = r->list;
-			break;
-		}
-		l = &f->list;
+/*
+ * Add r to the pending queue and the tag table.
+ * Called with m->lk held.
+ */
+static void
+mntqadd(Mnt *m, Mntrpc *r)
+{
+	Mntrpc **t;
+	int n;
+
+	if(r->request.tag >= m->ntags){
+		for(n = 64; n <= r->request.tag; n <<= 1)
+			;
+		t = realloc(m->tags, n*sizeof(Mntrpc*));
+		if(t == nil)
+			panic("mntqadd: no memory for tags");
+		memset(t+m->ntags, 0, (n-m->ntags)*sizeof(Mntrpc*));
+		m->tags = t;
+		m->ntags = n;
 	}
-	unlock(&m->lk);
+	m->tags[r->request.tag] = r;
+	r->prev = nil;
+	r->list = m->queue;
+	if(r->list != nil)
+		r->list->prev = r;
+	m->queue = r;
+	if(++m->nq > m->maxq)
+		m->maxq = m->nq;
+}
+
+static void
+mntqdel(Mnt *m, Mntrpc *r)
+{
+	m->tags[r->request.tag] = nil;
+	if(r->prev != nil)
+		r->prev->list = r->list;
+	else
+		m->queue = r->list;
+	if(r->list != nil)
+		r->list->prev = r->prev;
+	m->nq--;
+}
+
+/*
+ * Queue depth and round trip times of the mounts,
+ * one line each.
+ */
+int
+mntstats(char *buf, int nbuf)
+{
+	Mnt *m;
+	int n;
+	ulong avg;
+
+	n = 0;
+	lock(&mntalloc.lk);
+	for(m = mntalloc.list; m != nil; m = m->list){
+		lock(&m->lk);
+		avg = 0;
+		if(m->nrpc > 0)
+			avg = m->rpcms*1000/m->nrpc;
+		n += snprint(buf+n, nbuf-n, "%lud %s %s queue %lud max %lud rpc %lud ms %lud.%.3lud max %lud\n",
+			m->id, m->c != nil ? chanpath(m->c) : "-", m->kproc ? "kproc" : "gate",
+			m->nq, m->maxq, m->nrpc, avg/1000, avg%1000, m->maxms);
+		unlock(&m->lk);
+	}
+	unlock(&mntalloc.lk);
+	n += cstats(buf+n, nbuf-n);
+	return n;
 }
 
 static Mnt*
@@ -1113,7 +1856,22 @@ rpcattn(void *v)
 	Mntrpc *r;
 
 	r = v;
-	return r->done || r->m->rip == nil;
+	return r->done || r->m->rip == nil && !r->m->kproc;
+}
+
+static int
+mntreaderattn(void *v)
+{
+	Mnt *m;
+
+	m = v;
+	return m->closing || m->queue != nil && m->rip == nil;
+}
+
+static int
+mntreaderdone(void *v)
+{
+	return ((Mnt*)v)->kproc == 0;
 }
 
 Dev mntdevtab = {
@@ -9,6 +9,7 @@ int		canlock(Lock*);
 int		canputc(void*);
 int		canqlock(QLock*);
 int		canrlock(RWlock*);
+int		ccachable(Chan*);
 void		chandevinit(void);
 void		chandevreset(void);
 void		chandevshutdown(void);
@@ -27,8 +28,14 @@ void		closergrp(Rgrp*);
 void		cmderror(Cmdbuf*, char*);
 int		cmount(Chan*, Chan*, int, char*);
 Block*		concatblock(Block*);
+void		copen(Chan*);
 Block*		copyblock(Block*, int);
+long		cread(Chan*, uchar*, long, vlong);
+int		cstats(char*, int);
+void		ctrunc(Chan*);
 void		cunmount(Chan*, Chan*);
+void		cupdate(Chan*, uchar*, long, vlong);
+void		cwrite(Chan*, uchar*, long, vlong);
 int		decref(Ref*);
 Chan*		devattach(int, char*);
 Block*		devbread(Chan*, long, ulong);
@@ -64,6 +71,8 @@ Chan*		fdtochan(int, int, int, int);
 void		free(void*);
 void		freeb(Block*);
 void		freeblist(Block*);
+long		fssendrread(Chan*, int, int, long, vlong);
+int		fsregular(Chan*);
 uintptr		getmalloctag(void*);
 uintptr		getrealloctag(void*);
 void		gotolabel(Label*);
@@ -72,6 +81,7 @@ long		hostdomainwrite(char*, int);
 long		hostownerwrite(char*, int);
 Block*		iallocb(int);
 void		ilock(Lock*);
+int		iphostfd(Chan*);
 void		iunlock(Lock*);
 int		incref(Ref*);
 int		iprint(char*, ...);
@@ -103,6 +113,7 @@ Chan*		mntauth(Chan*, char*);
 void		mntdump(void);
 long		mntversion(Chan*, char*, int, int);
 Chan*		mntattach(Chan*, Chan*, char*, int);
+int		mntstats(char*, int);
 void		mountfree(Mount*);
 void		muxclose(Mnt*);
 Chan*		namec(char*, int, int, ulong);
@@ -189,6 +200,7 @@ int		return0(void*);
 void		rlock(RWlock*);
 void		runlock(RWlock*);
 extern void		(*screenputs)(char*, int);
+extern int		(*exportstats)(char*, int);
 void*		secalloc(ulong);
 void		secfree(void*);
 long		seconds(void);
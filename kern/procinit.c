@@ -4,6 +4,9 @@
 #include "fns.h"
 #include "error.h"
 
+#include <draw.h>
+#include <memdraw.h>
+
 void
 procinit0(void)
 {
@@ -87,6 +90,11 @@ pexit(char *msg, int freemem)
 	cclose(p->dot);
 	cclose(p->slash);
 
+	freememdrawscratch(p->drawscratch);
+
+	/* wakeup still holds p->rlock after procwakeup lets us run */
+	lock(&p->rlock);
+	unlock(&p->rlock);
 	free(p);
 	osexit();
 }
@@ -47,6 +47,7 @@ void	deletescreenimage(void);
 void	resetscreenimage(void);
 
 extern	QLock drawlock;
+extern	void	(*screenwait)(void);	/* called with drawlock held, before drawing on gscreen */
 #define	ishwimage(i)	0
 
 void	terminit(void);
@@ -665,7 +665,7 @@ bindmount(int ismount, int fd, int afd, char* arg0, char* arg1, int flag, char*
 		if(afd >= 0)
 			ac = fdtochan(afd, ORDWR, 0, 1);
 
-		c0 = mntattach(bc, ac, spec, flag&MCACHE);
+		c0 = mntattach(bc, ac, spec, flag&(MCACHE|MRAH|MWB|MKPROC|MWIN(0xF)));
 		poperror();	/* ac bc */
 		if(ac != nil)
 			cclose(ac);
@@ -1060,6 +1060,101 @@ sysread(int fd, void *buf, long n)
 	return n;
 }
 
+/*
+ * The host fd under a transport chan, or -1.
+ */
+static int
+hostfd(Chan *c)
+{
+	switch(devtab[c->type]->dc){
+	case 'L':
+		return (int)(uintptr)c->aux;
+	case 'I':
+		return iphostfd(c);
+	}
+	return -1;
+}
+
+static long
+_syssendrread(int ofd, int fd, int tag, long n, vlong off)
+{
+	Chan *c, *oc;
+	int hfd;
+
+	c = fdtochan(fd, -1, 1, 1);
+	if(waserror()){
+		cclose(c);
+		nexterror();
+	}
+	oc = fdtochan(ofd, -1, 1, 1);
+	if(waserror()){
+		cclose(oc);
+		nexterror();
+	}
+	hfd = hostfd(oc);
+	if(hfd < 0 || devtab[c->type]->dc != 'U' || off < 0
+	|| c->mode == OWRITE || oc->mode == OREAD)
+		n = -1;
+	else
+		n = fssendrread(c, hfd, tag, n, off);
+	poperror();
+	cclose(oc);
+	poperror();
+	cclose(c);
+	return n;
+}
+
+/*
+ * Write an Rread for tag with up to n bytes of fd at off
+ * straight to the transport ofd, for exportfs.  Returns -1
+ * with an empty error string, having written nothing, when
+ * the host can't move the data itself; the caller then
+ * replies the usual way.
+ */
+long
+syssendrread(int ofd, int fd, int tag, long n, vlong off)
+{
+	starterror();
+	if(waserror()){
+		_syserror();
+		return -1;
+	}
+	n = _syssendrread(ofd, fd, tag, n, off);
+	enderror();
+	return n;
+}
+
+static int
+_sysregularfile(int fd)
+{
+	Chan *c;
+	int r;
+
+	c = fdtochan(fd, -1, 0, 1);
+	r = devtab[c->type]->dc == 'U' && (c->flag&COPEN) != 0 && fsregular(c);
+	cclose(c);
+	return r;
+}
+
+/*
+ * Whether fd is open on a regular host file, for exportfs,
+ * which reads ahead only where reading consumes nothing.
+ */
+int
+sysregularfile(int fd)
+{
+	int n;
+
+	starterror();
+	if(waserror()){
+		_syserror();
+		return -1;
+	}
+	n = _sysregularfile(fd);
+	enderror();
+	return n;
+}
+
 int
 sysremove(char *path)
 {
@@ -95,6 +95,8 @@ resizeproc(void *arg)
 	for(;;){
 		sleep(&resize.z, isresized, nil);
 		qlock(&drawlock);
+		if(screenwait != nil)
+			screenwait();
 		resize.f = 0;
 		if(gscreen == nil
 		|| badrect(resize.r)
@@ -225,6 +227,8 @@ termscreenputs(char *s, int n)
 
 	lock(&screenlock);
 	locked = canqlock(&drawlock);
+	if(locked && screenwait != nil)
+		screenwait();
 	e = s + n;
 	while(s < e){
 		rb[nrb++] = *s++;
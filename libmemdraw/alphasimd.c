@@ -0,0 +1,367 @@
+/*
+ * Vector versions of the word-at-a-time (q) loops of
+ * alphacalc3679, alphacalc11 and alphacalcS in draw.c.
+ *
+ * They are only used when source and destination are
+ * both 32-bit pixels with matching channel layout
+ * (r8g8b8a8, x8r8g8b8, ...).  Each 32-bit lane holds
+ * one pixel and is computed exactly as CALC42 does it,
+ * carries between the 16-bit halves included, so the
+ * results are bit for bit those of the C code, which
+ * remains the reference and does any leftover pixels.
+ * Like the C word loops, they are free to scribble on
+ * the unused x byte of an x8r8g8b8 destination.
+ *
+ * On amd64 SSE2 is always there and AVX2 is used when
+ * cpuid says so; on arm64 NEON is always there, but
+ * that code has yet to be run on an arm64 cpu and is only
+ * compiled with -DARM64SIMD.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SIMDX86
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(ARM64SIMD)
+#include <arm_neon.h>
+#define SIMDNEON
+#endif
+
+#include <u.h>
+#include <libc.h>
+#include <draw.h>
+#include <memdraw.h>
+
+typedef int Simdcalc(ulong*, ulong*, uchar*, int, uchar*, int, uchar*, int, int, int);
+
+Simdcalc *_simdcalc3679;
+Simdcalc *_simdcalc11;
+Simdcalc *_simdcalcS;
+
+/*
+ * How the fs and fd factors are made from sa, ma and da;
+ * see alphacalc3679.
+ */
+enum {
+	Fsma		= 1<<0,	/* fs = ma */
+	Fsmada	= 1<<1,	/* fs = ma*da */
+	Fsmaida	= 1<<2,	/* fs = ma*(255-da) */
+	Fd255	= 1<<3,	/* fd = 255 */
+	Fdsama	= 1<<4,	/* fd = sa*ma */
+	Fdisama	= 1<<5,	/* fd = 255-sa*ma */
+	Fdima	= 1<<6,	/* fd = 255-ma */
+};
+
+static int
+opfactors(int op)
+{
+	switch(op){
+	case SatopD:
+		return Fsmada|Fdisama;
+	case DoverS:
+		return Fsmaida|Fd255;
+	case DatopS:
+		return Fsmaida|Fdsama;
+	case DxorS:
+		return Fsmaida|Fdisama;
+	}
+	return 0;
+}
+
+#ifdef SIMDX86
+
+static __m128i
+load4(uchar *p, int delta)
+{
+	u32int v;
+
+	if(delta == 1){
+		memmove(&v, p, 4);
+		return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), _mm_setzero_si128()),
+			_mm_setzero_si128());
+	}
+	return _mm_setr_epi32(p[0], p[delta], p[2*delta], p[3*delta]);
+}
+
+/*
+ * CALC11 on four lanes holding 0-255.
+ */
+static __m128i
+calc11x4(__m128i a, __m128i v)
+{
+	__m128i t;
+
+	t = _mm_add_epi32(_mm_mullo_epi16(a, v), _mm_set1_epi32(128));
+	return _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 8)), 8);
+}
+
+/*
+ * CALC42 on four pixels; f1 and f2 are 0-255 per lane.
+ */
+static __m128i
+calc42x4(__m128i f1, __m128i s, __m128i f2, __m128i d)
+{
+	__m128i m, r, t;
+
+	m = _mm_set1_epi32(0xFF00FF);
+	f1 = _mm_or_si128(f1, _mm_slli_epi32(f1, 16));
+	f2 = _mm_or_si128(f2, _mm_slli_epi32(f2, 16));
+
+	t = _mm_add_epi32(_mm_mullo_epi16(f1, _mm_and_si128(s, m)),
+		_mm_mullo_epi16(f2, _mm_and_si128(d, m)));
+	t = _mm_add_epi32(t, _mm_set1_epi32(0x00800080));
+	r = _mm_and_si128(_mm_srli_epi32(_mm_add_epi32(t, _mm_and_si128(_mm_srli_epi32(t, 8), m)), 8), m);
+
+	t = _mm_add_epi32(_mm_mullo_epi16(f1, _mm_and_si128(_mm_srli_epi32(s, 8), m)),
+		_mm_mullo_epi16(f2, _mm_and_si128(_mm_srli_epi32(d, 8), m)));
+	t = _mm_add_epi32(t, _mm_set1_epi32(0x00800080));
+	t = _mm_and_si128(_mm_srli_epi32(_mm_add_epi32(t, _mm_and_si128(_mm_srli_epi32(t, 8), m)), 8), m);
+
+	return _mm_or_si128(r, _mm_slli_epi32(t, 8));
+}
+
+static int
+sse2calc(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int f)
+{
+	__m128i vma, vda, fs, fd, c255;
+	int i;
+
+	c255 = _mm_set1_epi32(255);
+	for(i=0; i+4<=dx; i+=4){
+		vma = load4(ma, madelta);
+		if(f&Fsma)
+			fs = vma;
+		else{
+			vda = load4(da, dadelta);
+			if(f&Fsmaida)
+				vda = _mm_sub_epi32(c255, vda);
+			fs = calc11x4(vma, vda);
+		}
+		if(f&Fd255)
+			fd = c255;
+		else if(f&Fdima)
+			fd = _mm_sub_epi32(c255, vma);
+		else{
+			fd = calc11x4(load4(sa, sadelta), vma);
+			if(f&Fdisama)
+				fd = _mm_sub_epi32(c255, fd);
+		}
+		_mm_storeu_si128((__m128i*)d, calc42x4(fs, _mm_loadu_si128((__m128i*)s), fd, _mm_loadu_si128((__m128i*)d)));
+		d += 4;
+		s += 4;
+		sa += 4*sadelta;
+		ma += 4*madelta;
+		da += 4*dadelta;
+	}
+	return i;
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i
+load8(uchar *p, int delta)
+{
+	uvlong v;
+
+	if(delta == 1){
+		memmove(&v, p, 8);
+		return _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(v));
+	}
+	return _mm256_setr_epi32(p[0], p[delta], p[2*delta], p[3*delta],
+		p[4*delta], p[5*delta], p[6*delta], p[7*delta]);
+}
+
+AVX2 static __m256i
+calc11x8(__m256i a, __m256i v)
+{
+	__m256i t;
+
+	t = _mm256_add_epi32(_mm256_mullo_epi16(a, v), _mm256_set1_epi32(128));
+	return _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 8)), 8);
+}
+
+AVX2 static __m256i
+calc42x8(__m256i f1, __m256i s, __m256i f2, __m256i d)
+{
+	__m256i m, r, t;
+
+	m = _mm256_set1_epi32(0xFF00FF);
+	f1 = _mm256_or_si256(f1, _mm256_slli_epi32(f1, 16));
+	f2 = _mm256_or_si256(f2, _mm256_slli_epi32(f2, 16));
+
+	t = _mm256_add_epi32(_mm256_mullo_epi16(f1, _mm256_and_si256(s, m)),
+		_mm256_mullo_epi16(f2, _mm256_and_si256(d, m)));
+	t = _mm256_add_epi32(t, _mm256_set1_epi32(0x00800080));
+	r = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(t, _mm256_and_si256(_mm256_srli_epi32(t, 8), m)), 8), m);
+
+	t = _mm256_add_epi32(_mm256_mullo_epi16(f1, _mm256_and_si256(_mm256_srli_epi32(s, 8), m)),
+		_mm256_mullo_epi16(f2, _mm256_and_si256(_mm256_srli_epi32(d, 8), m)));
+	t = _mm256_add_epi32(t, _mm256_set1_epi32(0x00800080));
+	t = _mm256_and_si256(_mm256_srli_epi32(_mm256_add_epi32(t, _mm256_and_si256(_mm256_srli_epi32(t, 8), m)), 8), m);
+
+	return _mm256_or_si256(r, _mm256_slli_epi32(t, 8));
+}
+
+AVX2 static int
+avx2calc(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int f)
+{
+	__m256i vma, vda, fs, fd, c255;
+	int i;
+
+	c255 = _mm256_set1_epi32(255);
+	for(i=0; i+8<=dx; i+=8){
+		vma = load8(ma, madelta);
+		if(f&Fsma)
+			fs = vma;
+		else{
+			vda = load8(da, dadelta);
+			if(f&Fsmaida)
+				vda = _mm256_sub_epi32(c255, vda);
+			fs = calc11x8(vma, vda);
+		}
+		if(f&Fd255)
+			fd = c255;
+		else if(f&Fdima)
+			fd = _mm256_sub_epi32(c255, vma);
+		else{
+			fd = calc11x8(load8(sa, sadelta), vma);
+			if(f&Fdisama)
+				fd = _mm256_sub_epi32(c255, fd);
+		}
+		_mm256_storeu_si256((__m256i*)d, calc42x8(fs, _mm256_loadu_si256((__m256i*)s), fd, _mm256_loadu_si256((__m256i*)d)));
+		d += 8;
+		s += 8;
+		sa += 8*sadelta;
+		ma += 8*madelta;
+		da += 8*dadelta;
+	}
+	/* the last few go four at a time */
+	return i + sse2calc(d, s, sa, sadelta, ma, madelta, da, dadelta, dx-i, f);
+}
+
+static int
+vcalc(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int f)
+{
+	static int avx2 = -1;
+
+	if(avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2") != 0;
+	if(avx2)
+		return avx2calc(d, s, sa, sadelta, ma, madelta, da, dadelta, dx, f);
+	return sse2calc(d, s, sa, sadelta, ma, madelta, da, dadelta, dx, f);
+}
+
+#endif	/* SIMDX86 */
+
+#ifdef SIMDNEON
+
+static uint32x4_t
+load4(uchar *p, int delta)
+{
+	uint32x4_t v;
+
+	if(delta == 1)
+		return vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vld1_dup_u32((u32int*)p)))));
+	v = vdupq_n_u32(p[0]);
+	v = vsetq_lane_u32(p[delta], v, 1);
+	v = vsetq_lane_u32(p[2*delta], v, 2);
+	v = vsetq_lane_u32(p[3*delta], v, 3);
+	return v;
+}
+
+static uint32x4_t
+calc11x4(uint32x4_t a, uint32x4_t v)
+{
+	uint32x4_t t;
+
+	t = vmlaq_u32(vdupq_n_u32(128), a, v);
+	return vshrq_n_u32(vsraq_n_u32(t, t, 8), 8);
+}
+
+/*
+ * NEON has a real 32-bit multiply, so this is CALC22 as written.
+ */
+static uint32x4_t
+calc22x4(uint32x4_t f1, uint32x4_t x1, uint32x4_t f2, uint32x4_t x2)
+{
+	uint32x4_t m, t;
+
+	m = vdupq_n_u32(0xFF00FF);
+	t = vmlaq_u32(vmlaq_u32(vdupq_n_u32(0x00800080), f1, x1), f2, x2);
+	return vandq_u32(vshrq_n_u32(vaddq_u32(t, vandq_u32(vshrq_n_u32(t, 8), m)), 8), m);
+}
+
+static int
+vcalc(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int f)
+{
+	uint32x4_t vs, vd, vma, vda, fs, fd, m, c255;
+	int i;
+
+	m = vdupq_n_u32(0xFF00FF);
+	c255 = vdupq_n_u32(255);
+	for(i=0; i+4<=dx; i+=4){
+		vma = load4(ma, madelta);
+		if(f&Fsma)
+			fs = vma;
+		else{
+			vda = load4(da, dadelta);
+			if(f&Fsmaida)
+				vda = vsubq_u32(c255, vda);
+			fs = calc11x4(vma, vda);
+		}
+		if(f&Fd255)
+			fd = c255;
+		else if(f&Fdima)
+			fd = vsubq_u32(c255, vma);
+		else{
+			fd = calc11x4(load4(sa, sadelta), vma);
+			if(f&Fdisama)
+				fd = vsubq_u32(c255, fd);
+		}
+		vs = vld1q_u32((u32int*)s);
+		vd = vld1q_u32((u32int*)d);
+		vd = vorrq_u32(calc22x4(fs, vandq_u32(vs, m), fd, vandq_u32(vd, m)),
+			vshlq_n_u32(calc22x4(fs, vandq_u32(vshrq_n_u32(vs, 8), m), fd, vandq_u32(vshrq_n_u32(vd, 8), m)), 8));
+		vst1q_u32((u32int*)d, vd);
+		d += 4;
+		s += 4;
+		sa += 4*sadelta;
+		ma += 4*madelta;
+		da += 4*dadelta;
+	}
+	return i;
+}
+
+#endif	/* SIMDNEON */
+
+#if defined(SIMDX86) || defined(SIMDNEON)
+
+static int
+vcalc3679(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int op)
+{
+	return vcalc(d, s, sa, sadelta, ma, madelta, da, dadelta, dx, opfactors(op));
+}
+
+static int
+vcalc11(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int op)
+{
+	USED(op);
+	return vcalc(d, s, sa, sadelta, ma, madelta, da, dadelta, dx, Fsma|Fdisama);
+}
+
+static int
+vcalcS(ulong *d, ulong *s, uchar *sa, int sadelta, uchar *ma, int madelta, uchar *da, int dadelta, int dx, int op)
+{
+	USED(op);
+	return vcalc(d, s, sa, sadelta, ma, madelta, da, dadelta, dx, Fsma|Fdima);
+}
+
+#endif
+
+void
+_memsimdinit(void)
+{
+#if defined(SIMDX86) || defined(SIMDNEON)
+	_simdcalc3679 = vcalc3679;
+	_simdcalc11 = vcalc11;
+	_simdcalcS = vcalcS;
+#endif
+}
@@ -0,0 +1,836 @@
+/*
+ * memdrawbench - time libmemdraw and libmemlayer without a screen
+ *
+ *	memdrawbench [-cs] [-j nproc] [-t ms] [test ...]
+ *
+ * Tests are draw, ldraw, poly, ellipse, line, string, load, unload
+ * and cload, and spans, which checks results instead of timing
+ * them; the default is all of them.  Each case prints one line
+ *
+ *	test dst src mask op size Mpix/s
+ *
+ * in a fixed order, so that two runs can be compared with diff or
+ * join.  Images are filled from a fixed-seed generator.
+ *
+ *	-c	print memdrawcoverage afterward, each line prefixed "coverage",
+ *		then the scratch counters
+ *	-j	band draws across nproc threads (see memdrawbands)
+ *	-s	turn off the specialized kernels (memdrawspec=0)
+ *	-t	run each case for at least ms milliseconds (default 50)
+ */
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <u.h>
+#include <libc.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <memlayer.h>
+#include "args.h"
+
+#undef write
+#undef pread
+#undef close
+#undef getpid
+
+#define PI	3.14159265358979323846
+
+char	*argv0;
+
+static vlong	mintime = 50*1000000LL;
+static char	**tests;
+static int	ntests;
+static ulong	seed = 1;
+
+/*
+ * Normally supplied by the kernel.
+ */
+int
+print(char *fmt, ...)
+{
+	va_list arg;
+	int n;
+
+	va_start(arg, fmt);
+	n = vfprint(1, fmt, arg);
+	va_end(arg);
+	return n;
+}
+
+int
+iprint(char *fmt, ...)
+{
+	va_list arg;
+	int n;
+
+	va_start(arg, fmt);
+	n = vfprint(2, fmt, arg);
+	va_end(arg);
+	return n;
+}
+
+static char	errbuf[ERRMAX];
+
+void
+werrstr(char *fmt, ...)
+{
+	va_list arg;
+
+	va_start(arg, fmt);
+	vseprint(errbuf, errbuf+sizeof errbuf, fmt, arg);
+	va_end(arg);
+}
+
+int
+__errfmt(Fmt *f)
+{
+	return fmtstrcpy(f, errbuf);
+}
+
+int
+syswrite(int fd, void *buf, int n)
+{
+	return write(fd, buf, n);
+}
+
+vlong
+sysnsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (vlong)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+int
+sysgetpid(void)
+{
+	return getpid();
+}
+
+void
+osyield(void)
+{
+	sched_yield();
+}
+
+void
+osmsleep(int ms)
+{
+	usleep(ms*1000);
+}
+
+/*
+ * Band runner for -j, one thread per band.
+ */
+typedef struct Job Job;
+struct Job
+{
+	void	(*fn)(void*);
+	void	*arg;
+};
+
+static void*
+jobproc(void *a)
+{
+	Job *j;
+
+	j = a;
+	j->fn(j->arg);
+	return nil;
+}
+
+static void
+runbands(void (*fn)(void*), void **arg, int n)
+{
+	pthread_t t[64];
+	Job j[64];
+	int i;
+
+	for(i=1; i<n; i++){
+		j[i].fn = fn;
+		j[i].arg = arg[i];
+		pthread_create(&t[i], nil, jobproc, &j[i]);
+	}
+	fn(arg[0]);
+	for(i=1; i<n; i++)
+		pthread_join(t[i], nil);
+}
+
+/*
+ * Per-thread scratch, freed as each band thread exits.
+ */
+static pthread_key_t scratchkey;
+
+static void
+freescratch(void *a)
+{
+	void **slot;
+
+	slot = a;
+	freememdrawscratch(*slot);
+	free(slot);
+}
+
+static void**
+benchscratch(void)
+{
+	void **slot;
+
+	slot = pthread_getspecific(scratchkey);
+	if(slot == nil){
+		slot = mallocz(sizeof *slot, 1);
+		if(slot == nil || pthread_setspecific(scratchkey, slot) != 0)
+			sysfatal("scratch slot");
+	}
+	return slot;
+}
+
+static ulong
+rnd(void)
+{
+	seed = seed*1103515245 + 12345;
+	return seed>>8;
+}
+
+static Memimage*
+mkimage(Rectangle r, ulong chan, int repl)
+{
+	Memimage *i;
+	uchar *p, *e;
+
+	i = allocmemimage(r, chan);
+	if(i == nil)
+		sysfatal("allocmemimage %R %lux: %r", r, chan);
+	p = byteaddr(i, i->r.min);
+	e = p + Dy(r)*i->width*sizeof(ulong);
+	while(p < e)
+		*p++ = rnd();
+	if(repl){
+		i->flags |= Frepl;
+		i->clipr = Rect(-0x3FFFFFF, -0x3FFFFFF, 0x3FFFFFF, 0x3FFFFFF);
+	}
+	return i;
+}
+
+static Memimage*
+mksolid(ulong chan, ulong color)
+{
+	Memimage *i;
+
+	i = mkimage(Rect(0,0,1,1), chan, 1);
+	memfillcolor(i, color);
+	return i;
+}
+
+static int
+wanted(char *name)
+{
+	int i;
+
+	if(ntests == 0)
+		return 1;
+	for(i=0; i<ntests; i++)
+		if(strcmp(tests[i], name) == 0)
+			return 1;
+	return 0;
+}
+
+static char*
+channame(char *buf, ulong chan, char *suffix)
+{
+	char c[16];
+
+	if(chantostr(c, chan) == nil)
+		strcpy(c, "?");
+	snprint(buf, 32, "%s%s", c, suffix);
+	return buf;
+}
+
+static char *opname[Ncomp] = {
+	"Clear", "DoutS", "SoutD", "DxorS", "DinS", "D",
+	"DatopS", "DoverS", "SinD", "SatopD", "S", "SoverD",
+};
+
+/*
+ * Run fn(arg) until mintime has passed and report
+ * npix pixels per call as Mpix/s.
+ */
+static void
+bench(char *test, char *dst, char *src, char *mask, int op, Rectangle r, vlong npix, void (*fn)(void*), void *arg)
+{
+	vlong t0, t, n, i;
+
+	fn(arg);
+	n = 1;
+	for(;;){
+		t0 = nsec();
+		for(i=0; i<n; i++)
+			fn(arg);
+		t = nsec()-t0;
+		if(t >= mintime)
+			break;
+		n *= 2;
+	}
+	print("%s %s %s %s %s %dx%d %.1f\n", test, dst, src, mask,
+		op >= 0 ? opname[op] : "-", Dx(r), Dy(r), (double)npix*n*1000.0/t);
+}
+
+typedef struct Drawarg Drawarg;
+struct Drawarg
+{
+	Memimage	*dst;
+	Rectangle	r;
+	Memimage	*src;
+	Memimage	*mask;
+	int	op;
+};
+
+static void
+drawfn(void *a)
+{
+	Drawarg *d;
+
+	d = a;
+	memimagedraw(d->dst, d->r, d->src, ZP, d->mask, ZP, d->op);
+}
+
+static void
+ldrawfn(void *a)
+{
+	Drawarg *d;
+
+	d = a;
+	memdraw(d->dst, d->r, d->src, ZP, d->mask, ZP, d->op);
+}
+
+enum {
+	Srcdst = -1,	/* src has the dst chan */
+	Srcsolid = -2,	/* 1×1 repl, opaque */
+	Srcsolida = -3,	/* 1×1 repl, translucent */
+	Srcrepl = -4,	/* 32×32 ARGB32 tile */
+
+	Maskopaque = -1,
+	Maskrepl = -2,	/* 32×32 GREY8 tile */
+};
+
+static ulong dchans[] = { XRGB32, ARGB32, RGB24, RGB16, CMAP8, GREY8 };
+static long schans[] = { ARGB32, XRGB32, Srcdst, Srcsolid, Srcsolida, Srcrepl };
+static long mchans[] = { Maskopaque, GREY1, GREY8, Maskrepl };
+static int ops[] = { S, SoverD };
+static int sizes[] = { 16, 256 };
+
+/* whether Srcdst would repeat one of the plain schans */
+static int
+srcdstdup(ulong chan)
+{
+	int s;
+
+	for(s=0; s<nelem(schans); s++)
+		if(schans[s] == chan)
+			return 1;
+	return 0;
+}
+
+static void
+drawtests(void)
+{
+	int d, s, m, o, z;
+	char dn[32], sn[32], mn[32];
+	Rectangle r;
+	Drawarg a;
+
+	for(d=0; d<nelem(dchans); d++)
+	for(z=0; z<nelem(sizes); z++){
+		r = Rect(0, 0, sizes[z], sizes[z]);
+		a.dst = mkimage(r, dchans[d], 0);
+		a.r = r;
+		channame(dn, dchans[d], "");
+		for(s=0; s<nelem(schans); s++)
+		for(m=0; m<nelem(mchans); m++)
+		for(o=0; o<nelem(ops); o++){
+			if(schans[s] == Srcdst && srcdstdup(dchans[d]))
+				continue;
+			switch(schans[s]){
+			case Srcdst:
+				a.src = mkimage(r, dchans[d], 0);
+				channame(sn, dchans[d], "");
+				break;
+			case Srcsolid:
+				a.src = mksolid(XRGB32, 0x336699FF);
+				channame(sn, XRGB32, "/solid");
+				break;
+			case Srcsolida:
+				a.src = mksolid(ARGB32, 0x22334480);
+				channame(sn, ARGB32, "/solid");
+				break;
+			case Srcrepl:
+				a.src = mkimage(Rect(0,0,32,32), ARGB32, 1);
+				channame(sn, ARGB32, "/repl");
+				break;
+			default:
+				a.src = mkimage(r, schans[s], 0);
+				channame(sn, schans[s], "");
+				break;
+			}
+			switch(mchans[m]){
+			case Maskopaque:
+				a.mask = memopaque;
+				strcpy(mn, "opaque");
+				break;
+			case Maskrepl:
+				a.mask = mkimage(Rect(0,0,32,32), GREY8, 1);
+				channame(mn, GREY8, "/repl");
+				break;
+			default:
+				a.mask = mkimage(r, mchans[m], 0);
+				channame(mn, mchans[m], "");
+				break;
+			}
+			a.op = ops[o];
+			bench("draw", dn, sn, mn, a.op, r, (vlong)Dx(r)*Dy(r), drawfn, &a);
+			freememimage(a.src);
+			if(a.mask != memopaque)
+				freememimage(a.mask);
+		}
+		freememimage(a.dst);
+	}
+}
+
+/*
+ * Three overlapping windows on a screen; draw into the
+ * frontmost, which is clear, and the rearmost, which is
+ * partly obscured and so goes through its save image.
+ */
+static void
+ldrawtests(void)
+{
+	Memscreen scr;
+	Memimage *l[3], *src;
+	Rectangle r;
+	Drawarg a;
+	char dn[32], sn[32];
+	int i, d;
+	static ulong chans[] = { XRGB32, CMAP8 };
+
+	for(d=0; d<nelem(chans); d++){
+		memset(&scr, 0, sizeof scr);
+		scr.image = mkimage(Rect(0,0,1024,768), chans[d], 0);
+		scr.fill = memwhite;
+		for(i=0; i<3; i++){
+			l[i] = memlalloc(&scr, Rect(100*i, 100*i, 100*i+512, 100*i+512), nil, nil, DWhite);
+			if(l[i] == nil)
+				sysfatal("memlalloc: %r");
+		}
+		src = mkimage(Rect(0,0,512,512), ARGB32, 0);
+		channame(dn, chans[d], "");
+		channame(sn, ARGB32, "");
+		r = Rect(0, 0, 256, 256);
+		a.src = src;
+		a.mask = memopaque;
+		a.op = SoverD;
+		a.dst = l[2];
+		a.r = rectaddpt(r, l[2]->r.min);
+		bench("ldraw", dn, sn, "front", a.op, r, (vlong)Dx(r)*Dy(r), ldrawfn, &a);
+		a.dst = l[0];
+		a.r = rectaddpt(rectaddpt(r, Pt(128, 128)), l[0]->r.min);
+		bench("ldraw", dn, sn, "obscured", a.op, r, (vlong)Dx(r)*Dy(r), ldrawfn, &a);
+		for(i=2; i>=0; i--)
+			memlfree(l[i]);
+		freememimage(src);
+		freememimage(scr.image);
+	}
+}
+
+typedef struct Shapearg Shapearg;
+struct Shapearg
+{
+	Memimage	*dst;
+	Memimage	*src;
+	Point	*p;
+	int	np;
+	int	t;
+	int	wind;
+	char	*s;
+	Memsubfont	*f;
+};
+
+static void
+polyfn(void *a)
+{
+	Shapearg *s;
+
+	s = a;
+	memfillpoly(s->dst, s->p, s->np, s->wind, s->src, ZP, SoverD);
+}
+
+static void
+ellipsefn(void *a)
+{
+	Shapearg *s;
+
+	s = a;
+	memellipse(s->dst, Pt(128, 128), 120, 80, s->t, s->src, ZP, SoverD);
+}
+
+static void
+linefn(void *a)
+{
+	Shapearg *s;
+	int i;
+
+	s = a;
+	for(i=0; i+1<s->np; i++)
+		memline(s->dst, s->p[i], s->p[i+1], Endsquare, Endsquare, s->t, s->src, ZP, SoverD);
+}
+
+static void
+stringfn(void *a)
+{
+	Shapearg *s;
+
+	s = a;
+	memimagestring(s->dst, Pt(0, 0), s->src, ZP, s->f, s->s);
+}
+
+static ulong shapechans[] = { XRGB32, CMAP8 };
+
+static void
+shapetests(void)
+{
+	Shapearg a;
+	Point p[64];
+	Rectangle r;
+	char dn[32], sn[32];
+	int d, i, t, len;
+	static int thick[] = { 0, 1, 4 };
+
+	r = Rect(0, 0, 256, 256);
+	channame(sn, XRGB32, "/solid");
+	for(d=0; d<nelem(shapechans); d++){
+		a.dst = mkimage(r, shapechans[d], 0);
+		a.src = mksolid(XRGB32, 0x336699FF);
+		channame(dn, shapechans[d], "");
+
+		/* a 31-pointed star, self-intersecting */
+		for(i=0; i<31; i++){
+			p[i].x = 128 + 127*cos(i*2*PI*15/31);
+			p[i].y = 128 + 127*sin(i*2*PI*15/31);
+		}
+		a.p = p;
+		a.np = 31;
+		if(wanted("poly")){
+			a.wind = ~0;
+			bench("poly", dn, sn, "nonzero", SoverD, r, (vlong)Dx(r)*Dy(r), polyfn, &a);
+			a.wind = 1;
+			bench("poly", dn, sn, "evenodd", SoverD, r, (vlong)Dx(r)*Dy(r), polyfn, &a);
+		}
+
+		if(wanted("ellipse")){
+			a.t = -1;
+			bench("ellipse", dn, sn, "fill", SoverD, r, (vlong)241*161, ellipsefn, &a);
+			for(i=0; i<nelem(thick); i++){
+				a.t = thick[i];
+				/* perimeter is about 2π·100 */
+				bench("ellipse", dn, sn, thick[i]==0 ? "t0" : thick[i]==1 ? "t1" : "t4",
+					SoverD, r, (vlong)((2*thick[i]+1)*2*PI*100), ellipsefn, &a);
+			}
+		}
+
+		if(wanted("line")){
+			len = 0;
+			for(i=0; i<64; i++){
+				p[i] = Pt(rnd()%256, rnd()%256);
+				if(i > 0)
+					len += sqrt((p[i].x-p[i-1].x)*(p[i].x-p[i-1].x)
+						+ (p[i].y-p[i-1].y)*(p[i].y-p[i-1].y));
+			}
+			a.np = 64;
+			for(i=0; i<nelem(thick); i++){
+				t = thick[i];
+				a.t = t;
+				bench("line", dn, sn, t==0 ? "t0" : t==1 ? "t1" : "t4",
+					SoverD, r, (vlong)len*(2*t+1), linefn, &a);
+			}
+		}
+
+		if(wanted("string")){
+			a.f = getmemdefont();
+			a.s = "The quick brown fox jumps over the lazy dog 0123456789";
+			i = memsubfontwidth(a.f, a.s).x;
+			bench("string", dn, sn, "defont", SoverD, Rect(0, 0, i, a.f->height),
+				(vlong)i*a.f->height, stringfn, &a);
+		}
+		freememimage(a.src);
+		freememimage(a.dst);
+	}
+}
+
+/*
+ * Not a timing: check that memimagespans, which polygons,
+ * ellipses and thick lines batch their rows through, draws
+ * what memimagedraw of each span in turn does, spans
+ * clipped and empty included.  Prints ok or FAIL per case.
+ */
+static ulong spanchans[] = { XRGB32, ARGB32, RGB24, RGB16, CMAP8, GREY8, GREY1 };
+
+static int nspanfail;
+
+static void
+spantests(void)
+{
+	Memimage *a, *b, *src[3];
+	Memspan s[512], t[512];
+	Rectangle r;
+	Point p;
+	char dn[32], sn[32];
+	int d, i, k, n, o, x;
+	static char *srcname[] = { "/solid", "/solida", "/repl" };
+
+	r = Rect(0, 0, 200, 150);
+	src[0] = mksolid(XRGB32, 0x336699FF);
+	src[1] = mksolid(ARGB32, 0x22334480);
+	src[2] = mkimage(Rect(0,0,32,32), ARGB32, 1);
+	n = nelem(s);
+	for(i=0; i<n; i++){
+		/* rows and runs reaching past the image on every side */
+		s[i].y = (int)(rnd()%(Dy(r)+20)) - 10;
+		x = (int)(rnd()%(Dx(r)+40)) - 20;
+		s[i].x0 = x;
+		s[i].x1 = x + (int)(rnd()%80) - 4;	/* some empty */
+	}
+	for(d=0; d<nelem(spanchans); d++)
+	for(k=0; k<nelem(src); k++)
+	for(o=0; o<nelem(ops); o++){
+		a = mkimage(r, spanchans[d], 0);
+		a->clipr = Rect(5, 3, Dx(r)-7, Dy(r)-2);
+		b = allocmemimage(r, spanchans[d]);
+		if(b == nil)
+			sysfatal("allocmemimage: %r");
+		b->clipr = a->clipr;
+		memmove(byteaddr(b, r.min), byteaddr(a, r.min), Dy(r)*a->width*sizeof(ulong));
+
+		memmove(t, s, sizeof s);
+		memimagespans(a, t, n, src[k], Pt(3, 7), ops[o]);
+		for(i=0; i<n; i++){
+			p = addpt(Pt(3, 7), Pt(s[i].x0, s[i].y));
+			memimagedraw(b, Rect(s[i].x0, s[i].y, s[i].x1, s[i].y+1),
+				src[k], p, memopaque, p, ops[o]);
+		}
+		channame(dn, spanchans[d], "");
+		channame(sn, src[k]->chan, srcname[k]);
+		if(memcmp(byteaddr(a, r.min), byteaddr(b, r.min), Dy(r)*a->width*sizeof(ulong)) == 0)
+			print("spans %s %s - %s ok\n", dn, sn, opname[ops[o]]);
+		else{
+			print("spans %s %s - %s FAIL\n", dn, sn, opname[ops[o]]);
+			nspanfail++;
+		}
+		freememimage(a);
+		freememimage(b);
+	}
+	for(k=0; k<nelem(src); k++)
+		freememimage(src[k]);
+}
+
+typedef struct Cblock Cblock;
+struct Cblock
+{
+	Rectangle	r;
+	uchar	*data;
+	int	n;
+};
+
+typedef struct Loadarg Loadarg;
+struct Loadarg
+{
+	Memimage	*i;
+	uchar	*buf;
+	int	n;
+	Cblock	*b;
+	int	nb;
+};
+
+static void
+loadfn(void *a)
+{
+	Loadarg *l;
+
+	l = a;
+	if(memload(l->i, l->i->r, l->buf, l->n, 0) < 0)
+		sysfatal("memload failed");
+}
+
+static void
+unloadfn(void *a)
+{
+	Loadarg *l;
+
+	l = a;
+	if(memunload(l->i, l->i->r, l->buf, l->n) < 0)
+		sysfatal("memunload failed");
+}
+
+static void
+cloadfn(void *a)
+{
+	Loadarg *l;
+	int i;
+
+	l = a;
+	for(i=0; i<l->nb; i++)
+		if(cloadmemimage(l->i, l->b[i].r, l->b[i].data, l->b[i].n) < 0)
+			sysfatal("cloadmemimage failed");
+}
+
+/*
+ * Compress l->i with writememimage and split the
+ * result into its blocks for cloadmemimage.
+ */
+static void
+compress(Loadarg *l)
+{
+	char name[] = "/tmp/memdrawbench.XXXXXX";
+	uchar *p, *e;
+	int fd, n, miny;
+
+	fd = mkstemp(name);
+	if(fd < 0)
+		sysfatal("mkstemp failed");
+	unlink(name);
+	if(writememimage(fd, l->i) < 0)
+		sysfatal("writememimage: %r");
+	n = lseek(fd, 0, 2);
+	l->buf = malloc(n);
+	if(l->buf == nil || pread(fd, l->buf, n, 0) != n)
+		sysfatal("reading compressed image");
+	close(fd);
+
+	/* "compressed\n", 5*12 of header, then blocks of maxy, nbytes, data */
+	l->nb = 0;
+	l->b = nil;
+	miny = l->i->r.min.y;
+	e = l->buf+n;
+	for(p=l->buf+11+5*12; p+2*12 <= e; p+=2*12+n){
+		n = atoi((char*)p+12);
+		l->b = realloc(l->b, (l->nb+1)*sizeof(Cblock));
+		if(l->b == nil)
+			sysfatal("realloc failed");
+		l->b[l->nb].r = Rect(l->i->r.min.x, miny, l->i->r.max.x, atoi((char*)p));
+		l->b[l->nb].data = p+2*12;
+		l->b[l->nb].n = n;
+		miny = l->b[l->nb++].r.max.y;
+	}
+	if(miny != l->i->r.max.y)
+		sysfatal("short compressed image");
+}
+
+static void
+loadtests(void)
+{
+	Loadarg a;
+	Memimage *src;
+	Rectangle r;
+	char dn[32];
+	int d;
+	static ulong chans[] = { XRGB32, RGB24, RGB16, CMAP8, GREY1 };
+
+	r = Rect(0, 0, 256, 256);
+	for(d=0; d<nelem(chans); d++){
+		channame(dn, chans[d], "");
+		a.i = mkimage(r, chans[d], 0);
+		a.n = Dy(r)*bytesperline(r, a.i->depth);
+		a.buf = malloc(a.n);
+		if(a.buf == nil)
+			sysfatal("malloc failed");
+		memunload(a.i, r, a.buf, a.n);
+		if(wanted("load"))
+			bench("load", dn, "-", "-", -1, r, (vlong)Dx(r)*Dy(r), loadfn, &a);
+		if(wanted("unload"))
+			bench("unload", dn, "-", "-", -1, r, (vlong)Dx(r)*Dy(r), unloadfn, &a);
+		free(a.buf);
+
+		if(wanted("cload")){
+			/* something with runs in it to compress */
+			src = mkimage(r, ARGB32, 0);
+			memimagedraw(a.i, r, memwhite, ZP, nil, ZP, S);
+			memellipse(a.i, Pt(128, 128), 100, 60, -1, src, ZP, SoverD);
+			memimagestring(a.i, Pt(10, 10), memblack, ZP, getmemdefont(), "cloadmemimage");
+			freememimage(src);
+			compress(&a);
+			bench("cload", dn, "-", "-", -1, r, (vlong)Dx(r)*Dy(r), cloadfn, &a);
+			free(a.b);
+			free(a.buf);
+		}
+		freememimage(a.i);
+	}
+}
+
+static void
+usage(void)
+{
+	fprint(2, "usage: memdrawbench [-cs] [-j nproc] [-t ms] [test ...]\n");
+	exits("usage");
+}
+
+int
+main(int argc, char **argv)
+{
+	char *buf, *p, *q;
+	int cflag, n;
+
+	cflag = 0;
+	ARGBEGIN{
+	case 'c':
+		cflag = 1;
+		break;
+	case 'j':
+		memdrawnband = atoi(EARGF(usage()));
+		memdrawbands = runbands;
+		break;
+	case 's':
+		memdrawspec = 0;
+		break;
+	case 't':
+		mintime = atoi(EARGF(usage()))*1000000LL;
+		break;
+	default:
+		usage();
+	}ARGEND
+	tests = argv;
+	ntests = argc;
+
+	if(memimageinit() < 0)
+		sysfatal("memimageinit: %r");
+	if(pthread_key_create(&scratchkey, freescratch) != 0)
+		sysfatal("pthread_key_create");
+	memdrawscratch = benchscratch;
+
+	if(wanted("draw"))
+		drawtests();
+	if(wanted("ldraw"))
+		ldrawtests();
+	if(wanted("poly") || wanted("ellipse") || wanted("line") || wanted("string"))
+		shapetests();
+	if(wanted("load") || wanted("unload") || wanted("cload"))
+		loadtests();
+	if(wanted("spans"))
+		spantests();
+
+	if(cflag){
+		n = 64*1024;
+		buf = malloc(n);
+		if(buf == nil)
+			sysfatal("malloc failed");
+		buf[memdrawcoverage(buf, n-1)] = 0;
+		for(p=buf; (q=strchr(p, '\n')) != nil; p=q+1){
+			*q = 0;
+			print("coverage %s\n", p);
+		}
+		free(buf);
+		print("scratch %lud arenas %lud grown %lud max %lud temporary\n",
+			memdrawscratchn, memdrawscratchgrow, memdrawscratchmax, memdrawscratchtemp);
+	}
+	if(nspanfail > 0)
+		exits("fail");
+	exits(0);
+}
@@ -38,7 +38,9 @@
 
 static void mktables(void);
 typedef int Subdraw(Memdrawparam*);
-static Subdraw chardraw, alphadraw, memoptdraw;
+typedef int Simdcalc(ulong*, ulong*, uchar*, int, uchar*, int, uchar*, int, int, int);
+static Subdraw chardraw, alphadraw, memoptdraw, specdraw;
+static int banddraw(Memdrawparam*);
 
 static Memimage*	memones;
 static Memimage*	memzeros;
@@ -47,6 +49,14 @@ Memimage *memblack;
 Memimage *memtransparent;
 Memimage *memopaque;
 
+/*
+ * Vector versions of the word-at-a-time alpha loops,
+ * set by _memsimdinit if this processor has any (alphasimd.c).
+ * Each returns how many pixels it did; the C loop does the rest.
+ */
+extern Simdcalc	*_simdcalc3679, *_simdcalc11, *_simdcalcS;
+extern void	_memsimdinit(void);
+
 int	_ifmt(Fmt*);
 
 int
@@ -59,6 +69,7 @@ memimageinit(void)
 
 	mktables();
 	_memmkcmap();
+	_memsimdinit();
 
 	fmtinstall('R', Rfmt); 
 	fmtinstall('P', Pfmt);
@@ -152,6 +163,12 @@ memimagedraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask
 	if(hwdraw(&par))
 		return;
 
+	/*
+	 * Big enough to be worth splitting across procs?
+	 */
+	if(banddraw(&par))
+		return;
+
 	/*
 	 * Optimizations using memmove and memset.
 	 */
@@ -165,6 +182,12 @@ memimagedraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask
 	if(chardraw(&par))
 		return;
 
+	/*
+	 * Kernels for the common formats and ops.
+	 */
+	if(specdraw(&par))
+		return;
+
 	/*
 	 * General calculation-laden case that does alpha for each pixel.
 	 */
@@ -465,6 +488,13 @@ static Calcfn *boolcalc[Ncomp] =
 };
 
 /*
+ * Scratch for alphadraw: the three Params and the line buffers.
+ * Each thread keeps its own, in the slot memdrawscratch returns,
+ * so draws on different threads never share one; the buffer
+ * grows by doubling and is kept for the next draw.
+ * Without memdrawscratch there is one shared Dbuf, and a draw
+ * that finds it busy allocates a Dbuf just for itself.
+ *
  * Avoid standard Lock, QLock so that can be used in kernel.
  */
 typedef struct Dbuf Dbuf;
@@ -474,21 +504,126 @@ struct Dbuf
 	int n;
 	Param spar, mpar, dpar;
 	int inuse;
+	int temp;	/* free after this draw */
+};
+
+enum {
+	Mindbuf = 4096,
 };
-static Dbuf dbuf[10];
+
+void**	(*memdrawscratch)(void);
+ulong	memdrawscratchn;
+ulong	memdrawscratchgrow;
+ulong	memdrawscratchmax;
+ulong	memdrawscratchtemp;
+
+static Dbuf	*shareddbuf;
+static int	sharedlock;
+static int	scratchlock;
 
 static Dbuf*
 allocdbuf(void)
 {
-	int i;
+	Dbuf **zp, *z;
+
+	zp = nil;
+	if(memdrawscratch != nil)
+		zp = (Dbuf**)memdrawscratch();
+	else if(!tas(&sharedlock))
+		zp = &shareddbuf;
+	if(zp != nil && (z = *zp) != nil){
+		if(!z->inuse){
+			z->inuse = 1;
+			return z;
+		}
+		/* in use already: reentered from a hwdraw, say */
+	}else if(zp != nil){
+		if((z = mallocz(sizeof(Dbuf), 1)) == nil)
+			goto Temp;
+		z->inuse = 1;
+		*zp = z;
+		while(tas(&scratchlock))
+			;
+		memdrawscratchn++;
+		scratchlock = 0;
+		return z;
+	}
+    Temp:
+	if(zp == &shareddbuf)
+		sharedlock = 0;
+	if((z = mallocz(sizeof(Dbuf), 1)) == nil)
+		return nil;
+	z->inuse = 1;
+	z->temp = 1;
+	while(tas(&scratchlock))
+		;
+	memdrawscratchtemp++;
+	scratchlock = 0;
+	return z;
+}
 
-	for(i=0; i<nelem(dbuf); i++){
-		if(dbuf[i].inuse)
-			continue;
-		if(!tas(&dbuf[i].inuse))
-			return &dbuf[i];
+static void
+freedbuf(Dbuf *z)
+{
+	if(z->temp){
+		free(z->p);
+		free(z);
+		return;
 	}
-	return nil;
+	z->inuse = 0;
+	if(z == shareddbuf)
+		sharedlock = 0;
+}
+
+/*
+ * Make room for n bytes of line buffers, at least doubling.
+ */
+static int
+growdbuf(Dbuf *z, int n)
+{
+	int m;
+
+	if(z->n >= n)
+		return 1;
+	m = z->temp ? n : 2*z->n;
+	if(m < Mindbuf && !z->temp)
+		m = Mindbuf;
+	if(m < n)
+		m = n;
+	free(z->p);
+	if((z->p = mallocz(m, 0)) == nil){
+		z->n = 0;
+		return 0;
+	}
+	z->n = m;
+	if(z->temp)
+		return 1;
+	while(tas(&scratchlock))
+		;
+	memdrawscratchgrow++;
+	if(m > memdrawscratchmax)
+		memdrawscratchmax = m;
+	scratchlock = 0;
+	return 1;
+}
+
+/*
+ * Free a thread's scratch, from the slot memdrawscratch gave.
+ */
+void
+freememdrawscratch(void *a)
+{
+	Dbuf *z;
+
+	z = a;
+	if(z == nil)
+		return;
+	free(z->p);
+	free(z);
+	while(tas(&scratchlock))
+		;
+	memdrawscratchn--;
+	scratchlock = 0;
 }
 
 static void
@@ -554,8 +689,25 @@ clipy(Memimage *img, int *y)
  * the calculator, and that buffer is passed to a function to write it to the destination.
  * If the buffer is already pointing at the destination, the writing function is a no-op.
  */
+static int alphadrawz(Memdrawparam*, Dbuf*);
+static void countgeneric(Memdrawparam*);
+
 static int
 alphadraw(Memdrawparam *par)
+{
+	Dbuf *z;
+	int ok;
+
+	z = allocdbuf();
+	if(z == nil)
+		return 0;
+	ok = alphadrawz(par, z);
+	freedbuf(z);
+	return ok;
+}
+
+static int
+alphadrawz(Memdrawparam *par, Dbuf *z)
 {
 	int isgrey, starty, endy, op;
 	int needbuf, dsty, srcy, masky;
@@ -567,16 +719,13 @@ alphadraw(Memdrawparam *par)
 	Writefn *wrdst;
 	Memimage *src, *mask, *dst;
 	Rectangle r, sr, mr;
-	Dbuf *z;
+
+	countgeneric(par);
 
 	r = par->r;
 	dx = Dx(r);
 	dy = Dy(r);
 
-	z = allocdbuf();
-	if(z == nil)
-		return 0;
-
 	src = par->src;
 	mask = par->mask;	
 	dst = par->dst;
@@ -670,14 +819,8 @@ alphadraw(Memdrawparam *par)
 		rdmask = replread;
 	}
 
-	if(z->n < ndrawbuf){
-		free(z->p);
-		if((z->p = mallocz(ndrawbuf, 0)) == nil){
-			z->inuse = 0;
-			return 0;
-		}
-		z->n = ndrawbuf;
-	}
+	if(!growdbuf(z, ndrawbuf))
+		return 0;
 	drawbuf = z->p;
 
 	/*
@@ -723,7 +866,95 @@ alphadraw(Memdrawparam *par)
 		wrdst(&z->dpar, z->dpar.bytermin+dsty*z->dpar.bwidth, bdst);
 	}
 
-	z->inuse = 0;
+	return 1;
+}
+
+/*
+ * Band-parallel drawing.  A big enough draw is cut into horizontal
+ * bands which are handed to memdrawbands to run at the same time.
+ * Each band runs with the scratch of the thread that draws it;
+ * only one banded draw runs at a time, and any other that comes
+ * along meanwhile is simply drawn unbanded.
+ */
+enum {
+	Maxband = 32,
+	Minbandrows = 8,
+};
+
+int	memdrawnband;
+int	memdrawbandmin = 256*1024;
+void	(*memdrawbands)(void (*)(void*), void**, int);
+
+typedef struct Band Band;
+struct Band
+{
+	Memdrawparam	par;
+};
+
+static int	bandinuse;
+
+static void
+bandproc(void *a)
+{
+	Band *b;
+
+	b = a;
+	if(memoptdraw(&b->par))
+		return;
+	if(chardraw(&b->par))
+		return;
+	if(specdraw(&b->par))
+		return;
+	alphadraw(&b->par);
+}
+
+static int
+banddraw(Memdrawparam *par)
+{
+	Band band[Maxband];
+	void *arg[Maxband];
+	int i, n, dy, y0, y1;
+	Memimage *src, *mask;
+
+	src = par->src;
+	mask = par->mask;
+	dy = Dy(par->r);
+	n = memdrawnband;
+	if(n > Maxband)
+		n = Maxband;
+	if(n > dy/Minbandrows)
+		n = dy/Minbandrows;
+	if(memdrawbands == nil || n < 2 || Dx(par->r)*dy < memdrawbandmin)
+		return 0;
+
+	/*
+	 * Bands overlapping in memory would have to be done
+	 * in the right order, which is the opposite of parallel.
+	 */
+	if(src->data == par->dst->data || mask->data == par->dst->data)
+		return 0;
+
+	if(bandinuse || tas(&bandinuse))
+		return 0;
+
+	for(i=0; i<n; i++){
+		y0 = dy*i/n;
+		y1 = dy*(i+1)/n;
+		band[i].par = *par;
+		band[i].par.r.min.y = par->r.min.y+y0;
+		band[i].par.r.max.y = par->r.min.y+y1;
+		band[i].par.sr.min.y = par->sr.min.y+y0;
+		if(src->flags&Frepl)
+			band[i].par.sr.min.y = drawreplxy(src->r.min.y, src->r.max.y, band[i].par.sr.min.y);
+		band[i].par.sr.max.y = band[i].par.sr.min.y+y1-y0;
+		band[i].par.mr.min.y = par->mr.min.y+y0;
+		if(mask->flags&Frepl)
+			band[i].par.mr.min.y = drawreplxy(mask->r.min.y, mask->r.max.y, band[i].par.mr.min.y);
+		band[i].par.mr.max.y = band[i].par.mr.min.y+y1-y0;
+		arg[i] = &band[i];
+	}
+	memdrawbands(bandproc, arg, n);
+	bandinuse = 0;
 	return 1;
 }
 
@@ -833,11 +1064,12 @@ alphacalc14(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 static void
 alphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 {
-	int fs, sadelta;
+	int fs, sadelta, dadelta;
 	int i, ma, da, q;
 	ulong t, t1;
 
 	sadelta = bsrc.alpha == &ones ? 0 : bsrc.delta;
+	dadelta = bdst.alpha == &ones ? 0 : bdst.delta;
 	q = bsrc.delta == 4 && bdst.delta == 4 && chanmatch(&bdst, &bsrc);
 
 	for(i=0; i<dx; i++){
@@ -859,7 +1091,7 @@ alphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 				bsrc.rgba++;
 				bdst.rgba++;
 				bmask.alpha += bmask.delta;
-				bdst.alpha += bdst.delta;
+				bdst.alpha += dadelta;
 				continue;
 			}
 			*bdst.red = CALC11(fs, *bsrc.red, t);
@@ -884,14 +1116,25 @@ alphacalc2810(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 static void
 alphacalc3679(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 {
-	int fs, fd, sadelta;
+	int fs, fd, sadelta, dadelta;
 	int i, sa, ma, da, q;
 	ulong t, t1;
 
 	sadelta = bsrc.alpha == &ones ? 0 : bsrc.delta;
+	dadelta = bdst.alpha == &ones ? 0 : bdst.delta;
 	q = bsrc.delta == 4 && bdst.delta == 4 && chanmatch(&bdst, &bsrc);
 
-	for(i=0; i<dx; i++){
+	i = 0;
+	if(q && _simdcalc3679 != nil){
+		i = _simdcalc3679(bdst.rgba, bsrc.rgba, bsrc.alpha, sadelta,
+			bmask.alpha, bmask.delta, bdst.alpha, dadelta, dx, op);
+		bsrc.rgba += i;
+		bdst.rgba += i;
+		bsrc.alpha += i*sadelta;
+		bmask.alpha += i*bmask.delta;
+		bdst.alpha += i*dadelta;
+	}
+	for(; i<dx; i++){
 		sa = *bsrc.alpha;
 		ma = *bmask.alpha;
 		da = *bdst.alpha;
@@ -918,7 +1161,7 @@ alphacalc3679(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 				bdst.rgba++;
 				bsrc.alpha += sadelta;
 				bmask.alpha += bmask.delta;
-				bdst.alpha += bdst.delta;
+				bdst.alpha += dadelta;
 				continue;
 			}
 			*bdst.red = CALC12(fs, *bsrc.red, fd, *bdst.red, t);
@@ -962,7 +1205,16 @@ alphacalc11(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 	sadelta = bsrc.alpha == &ones ? 0 : bsrc.delta;
 	q = bsrc.delta == 4 && bdst.delta == 4 && chanmatch(&bdst, &bsrc);
 
-	for(i=0; i<dx; i++){
+	i = 0;
+	if(q && _simdcalc11 != nil){
+		i = _simdcalc11(bdst.rgba, bsrc.rgba, bsrc.alpha, sadelta,
+			bmask.alpha, bmask.delta, nil, 0, dx, op);
+		bsrc.rgba += i;
+		bdst.rgba += i;
+		bsrc.alpha += i*sadelta;
+		bmask.alpha += i*bmask.delta;
+	}
+	for(; i<dx; i++){
 		sa = *bsrc.alpha;
 		ma = *bmask.alpha;
 		fd = 255-CALC11(sa, ma, t);
@@ -1045,7 +1297,22 @@ alphacalcS(Buffer bdst, Buffer bsrc, Buffer bmask, int dx, int grey, int op)
 	ulong t;
 
 	USED(op);
-	for(i=0; i<dx; i++){
+	i = 0;
+	if(!grey && _simdcalcS != nil
+	&& bsrc.delta == 4 && bdst.delta == 4 && chanmatch(&bdst, &bsrc)){
+		i = _simdcalcS(bdst.rgba, bsrc.rgba, nil, 0,
+			bmask.alpha, bmask.delta, nil, 0, dx, op);
+		if(i == dx)
+			return;
+		bsrc.red += i*4;
+		bsrc.grn += i*4;
+		bsrc.blu += i*4;
+		bdst.red += i*4;
+		bdst.grn += i*4;
+		bdst.blu += i*4;
+		bmask.alpha += i*bmask.delta;
+	}
+	for(; i<dx; i++){
 		ma = *bmask.alpha;
 		fd = 255-ma;
 
@@ -2265,6 +2532,65 @@ memoptdraw(Memdrawparam *par)
 	return 0;	
 }
 
+/*
+ * Draw src through an opaque mask onto each span in turn,
+ * as memimagedraw(dst, r, src, p, memopaque, p, op) would
+ * with r the span and p = sp+r.min.  When src is a single opaque
+ * color being copied, as it usually is for polygons and thick lines,
+ * clip once and fill the spans directly, as memoptdraw does.
+ */
+void
+memimagespans(Memimage *dst, Memspan *s, int n, Memimage *src, Point sp, int op)
+{
+	Memspan *e;
+	Rectangle r;
+	Point p;
+	ulong v;
+	int x0, x1;
+
+	e = s+n;
+	if(!(src->flags&Frepl) || Dx(src->r)!=1 || Dy(src->r)!=1
+	|| (op!=S && op!=SoverD) || dst->depth < 8){
+    Slow:
+		for(; s<e; s++){
+			r = Rect(s->x0, s->y, s->x1, s->y+1);
+			p = addpt(sp, r.min);
+			memimagedraw(dst, r, src, p, memopaque, p, op);
+		}
+		return;
+	}
+	v = imgtorgba(src, pixelbits(src, src->r.min));
+	if((v&0xFF) != 0xFF)	/* as memoptdraw: S of a translucent color isn't a fill either */
+		goto Slow;
+	v = rgbatoimg(dst, v);
+
+	r = dst->r;
+	if(!rectclip(&r, dst->clipr) || !rectclip(&r, rectsubpt(src->clipr, sp)))
+		return;
+	for(; s<e; s++){
+		if(s->y < r.min.y || s->y >= r.max.y)
+			continue;
+		x0 = s->x0 < r.min.x ? r.min.x : s->x0;
+		x1 = s->x1 > r.max.x ? r.max.x : s->x1;
+		if(x0 >= x1)
+			continue;
+		switch(dst->depth){
+		case 8:
+			memset(byteaddr(dst, Pt(x0, s->y)), v, x1-x0);
+			break;
+		case 16:
+			memsets(byteaddr(dst, Pt(x0, s->y)), v, x1-x0);
+			break;
+		case 24:
+			memset24(byteaddr(dst, Pt(x0, s->y)), v, x1-x0);
+			break;
+		case 32:
+			memsetl(byteaddr(dst, Pt(x0, s->y)), v, x1-x0);
+			break;
+		}
+	}
+}
+
 /*
  * Boolean character drawing.
  * Solid opaque color through a 1-bit greyscale mask.
@@ -2381,6 +2707,336 @@ chardraw(Memdrawparam *par)
 	return 1;	
 }
 
+/*
+ * Specialized drawing.  Most of what rio and acme draw is one of
+ * a handful of (src, mask, dst, op) combinations; for those, do the
+ * same arithmetic as the alphadraw calculators straight on the
+ * pixels rather than going through the per-scan-line buffers.
+ * Each kernel must give exactly what alphadraw would.
+ *
+ * Solid and Solidalpha stand for any 1×1 replicated source, without
+ * and with an alpha channel; Opaque for the all-ones 1×1 mask.
+ * Pixels are little-endian: blue is byte 0, alpha (or x) byte 3.
+ */
+enum {
+	Solid = 1,
+	Solidalpha,
+	Opaque,
+};
+
+typedef struct Specarg Specarg;
+struct Specarg
+{
+	int	mx;	/* bit offset of the first mask pixel */
+	uchar	c[4];	/* solid source: b, g, r, a */
+};
+
+typedef void Specrow(Specarg*, uchar*, uchar*, uchar*, int);
+
+#define DB(i)	d[4*x+(i)]
+#define SB(i)	s[4*x+(i)]
+#define CB(i)	a->c[i]
+#define DW	((ulong*)d)[x]
+#define SW	((ulong*)s)[x]
+
+#define M8	m[x]
+#define M1	(((m[(a->mx+x)>>3]>>(7-((a->mx+x)&7)))&1) ? 255 : 0)
+#define MOP	255
+
+/* alphacalc11, word at a time */
+#define OVERW \
+	fd = 255-CALC11(SB(3), ma, t); \
+	DW = CALC42(ma, SW, fd, DW, t, t1);
+
+/* alphacalc11 */
+#define OVER(src, da) \
+	fd = 255-CALC11(src(3), ma, t); \
+	DB(0) = CALC12(ma, src(0), fd, DB(0), t); \
+	DB(1) = CALC12(ma, src(1), fd, DB(1), t); \
+	DB(2) = CALC12(ma, src(2), fd, DB(2), t); \
+	if(da) \
+		DB(3) = CALC12(ma, src(3), fd, DB(3), t);
+
+/* alphacalcS */
+#define OVERS(src, da) \
+	fd = 255-ma; \
+	DB(0) = CALC12(ma, src(0), fd, DB(0), t); \
+	DB(1) = CALC12(ma, src(1), fd, DB(1), t); \
+	DB(2) = CALC12(ma, src(2), fd, DB(2), t); \
+	if(da) \
+		DB(3) = ma+CALC11(fd, DB(3), t);
+
+/* boolcopy32 */
+#define COPYW \
+	if(ma) \
+		DW = SW;
+
+/* boolcalc1011 for S */
+#define BOOLS \
+	if(ma){ \
+		DB(0) = SB(0); \
+		DB(1) = SB(1); \
+		DB(2) = SB(2); \
+	}else \
+		DB(0) = DB(1) = DB(2) = 0;
+
+#define SPECROW(name, mask, pixel) \
+static void \
+name(Specarg *a, uchar *d, uchar *s, uchar *m, int dx) \
+{ \
+	int x, ma, fd; \
+	ulong t, t1; \
+	\
+	USED(a); USED(s); USED(m); USED(fd); USED(t); USED(t1); \
+	for(x=0; x<dx; x++){ \
+		ma = mask; \
+		pixel \
+	} \
+}
+
+/*
+ * Run the vector calculator over as much of the row as it
+ * will take, then the C kernel over the rest, as alphacalc11
+ * and alphacalcS do.
+ */
+#define SIMDROW(name, row, simd, sa, mdelta) \
+static void \
+name(Specarg *a, uchar *d, uchar *s, uchar *m, int dx) \
+{ \
+	int n; \
+	\
+	n = 0; \
+	if(simd != nil) \
+		n = simd((ulong*)d, (ulong*)s, sa, 4, m, mdelta, nil, 0, dx, SoverD); \
+	row(a, d+4*n, s+4*n, m+n*mdelta, dx-n); \
+}
+
+SPECROW(a32m8over1, M8, OVERW)
+SPECROW(a32opover1, MOP, OVERW)
+SPECROW(x32m8overx1, M8, OVERS(SB, 0))
+SPECROW(x32m8overa, M8, OVERS(SB, 1))
+SPECROW(x32b1copy, M1, COPYW)
+SPECROW(x32b1s, M1, BOOLS)
+SPECROW(solm8overx, M8, OVERS(CB, 0))
+SPECROW(solm8overa, M8, OVERS(CB, 1))
+SPECROW(sola8m8overx, M8, OVER(CB, 0))
+SPECROW(sola8m8overa, M8, OVER(CB, 1))
+SPECROW(sola8b1overx, M1, OVER(CB, 0))
+SPECROW(sola8b1overa, M1, OVER(CB, 1))
+SPECROW(sola8opoverx, MOP, OVER(CB, 0))
+SPECROW(sola8opovera, MOP, OVER(CB, 1))
+
+SIMDROW(a32m8over, a32m8over1, _simdcalc11, s+3, 1)
+SIMDROW(a32opover, a32opover1, _simdcalc11, s+3, 0)
+SIMDROW(x32m8overx, x32m8overx1, _simdcalcS, nil, 1)
+
+#undef DB
+#undef SB
+#undef CB
+#undef DW
+#undef SW
+
+typedef struct Spec Spec;
+struct Spec
+{
+	ulong	src;
+	ulong	mask;
+	ulong	dst;
+	int	op;
+	Specrow	*row;
+};
+
+static Spec spec[] =
+{
+	ARGB32,	GREY8,	XRGB32,	SoverD,	a32m8over,
+	ARGB32,	GREY8,	ARGB32,	SoverD,	a32m8over,
+	ARGB32,	Opaque,	XRGB32,	SoverD,	a32opover,
+	ARGB32,	Opaque,	ARGB32,	SoverD,	a32opover,
+	XRGB32,	GREY8,	XRGB32,	SoverD,	x32m8overx,
+	XRGB32,	GREY8,	ARGB32,	SoverD,	x32m8overa,
+	XRGB32,	GREY1,	XRGB32,	SoverD,	x32b1copy,
+	XRGB32,	GREY1,	XRGB32,	S,	x32b1s,
+	Solid,	GREY8,	XRGB32,	SoverD,	solm8overx,
+	Solid,	GREY8,	ARGB32,	SoverD,	solm8overa,
+	Solidalpha,	GREY8,	XRGB32,	SoverD,	sola8m8overx,
+	Solidalpha,	GREY8,	ARGB32,	SoverD,	sola8m8overa,
+	Solidalpha,	GREY1,	XRGB32,	SoverD,	sola8b1overx,
+	Solidalpha,	GREY1,	ARGB32,	SoverD,	sola8b1overa,
+	Solidalpha,	Opaque,	XRGB32,	SoverD,	sola8opoverx,
+	Solidalpha,	Opaque,	ARGB32,	SoverD,	sola8opovera,
+};
+
+int	memdrawspec = 1;
+
+static int
+specdraw(Memdrawparam *par)
+{
+	int y, dx, dy;
+	ulong sc, mc, v, swid, mwid, dwid;
+	uchar *sp, *mp, *dp;
+	Memimage *src, *mask, *dst;
+	Specarg a;
+	Spec *p;
+
+	src = par->src;
+	mask = par->mask;
+	dst = par->dst;
+
+	if(!memdrawspec || dst->depth != 32 || (dst->flags&Frepl)
+	|| src->data == dst->data || mask->data == dst->data)
+		return 0;
+
+	if(par->state&Simplesrc)
+		sc = (src->flags&Falpha) ? Solidalpha : Solid;
+	else if(par->state&Replsrc)
+		return 0;
+	else
+		sc = src->chan;
+	if(par->state&Fullmask)
+		mc = Opaque;
+	else if(par->state&Replmask)
+		return 0;
+	else
+		mc = mask->chan;
+
+	for(p=spec; p<spec+nelem(spec); p++)
+		if(p->src == sc && p->mask == mc && p->dst == dst->chan && p->op == par->op)
+			break;
+	if(p == spec+nelem(spec))
+		return 0;
+
+	v = par->srgba;
+	a.c[0] = v>>8;
+	a.c[1] = v>>16;
+	a.c[2] = v>>24;
+	a.c[3] = v;
+	a.mx = par->mr.min.x&7;
+
+	dx = Dx(par->r);
+	dy = Dy(par->r);
+	dp = byteaddr(dst, par->r.min);
+	dwid = dst->width*sizeof(ulong);
+	sp = mp = &ones;
+	swid = mwid = 0;
+	if(sc != Solid && sc != Solidalpha){
+		sp = byteaddr(src, par->sr.min);
+		swid = src->width*sizeof(ulong);
+	}
+	if(mc != Opaque){
+		mp = byteaddr(mask, par->mr.min);
+		mwid = mask->width*sizeof(ulong);
+	}
+	for(y=0; y<dy; y++, dp+=dwid, sp+=swid, mp+=mwid)
+		p->row(&a, dp, sp, mp, dx);
+	return 1;
+}
+
+/*
+ * Count what falls through to alphadraw, so we know
+ * which combinations might be worth a kernel above.
+ * A banded draw counts once per band.
+ */
+typedef struct Gencount Gencount;
+struct Gencount
+{
+	ulong	src;
+	ulong	mask;
+	ulong	dst;
+	int	op;
+	int	state;
+	uvlong	ndraw;
+	uvlong	npix;
+};
+
+enum {
+	Ngencount = 128,
+};
+
+static Gencount	gencount[Ngencount];
+static int	genlock;
+
+static void
+countgeneric(Memdrawparam *par)
+{
+	Gencount *g;
+	ulong h;
+	int i, state;
+
+	state = par->state&(Replsrc|Simplesrc|Replmask|Simplemask|Fullmask);
+	h = par->src->chan ^ par->mask->chan*3 ^ par->dst->chan*7 ^ par->op*31 ^ state*127;
+	while(tas(&genlock))
+		;
+	for(i=0; i<Ngencount; i++){
+		g = &gencount[(h+i)%Ngencount];
+		if(g->ndraw == 0){
+			g->src = par->src->chan;
+			g->mask = par->mask->chan;
+			g->dst = par->dst->chan;
+			g->op = par->op;
+			g->state = state;
+		}else if(g->src != par->src->chan || g->mask != par->mask->chan
+		|| g->dst != par->dst->chan || g->op != par->op || g->state != state)
+			continue;
+		g->ndraw++;
+		g->npix += (uvlong)Dx(par->r)*Dy(par->r);
+		break;
+	}
+	genlock = 0;
+}
+
+static int
+gencmp(const void *a, const void *b)
+{
+	uvlong na, nb;
+
+	na = ((Gencount*)a)->npix;
+	nb = ((Gencount*)b)->npix;
+	return na < nb ? 1 : na > nb ? -1 : 0;
+}
+
+static char *opname[Ncomp] = {
+	"Clear", "DoutS", "SoutD", "DxorS", "DinS", "D",
+	"DatopS", "DoverS", "SinD", "SatopD", "S", "SoverD",
+};
+
+/*
+ * Format the fall-through counts into buf, biggest first,
+ * one line per combination:
+ *	dst src mask op ndraw npixel
+ * with "/solid" or "/repl" on a replicated src or mask.
+ */
+int
+memdrawcoverage(char *buf, int n)
+{
+	Gencount g[Ngencount];
+	char s[3][32], *p, *e;
+	int i, ng;
+
+	while(tas(&genlock))
+		;
+	ng = 0;
+	for(i=0; i<Ngencount; i++)
+		if(gencount[i].ndraw)
+			g[ng++] = gencount[i];
+	genlock = 0;
+	qsort(g, ng, sizeof g[0], gencmp);
+
+	p = buf;
+	e = buf+n;
+	for(i=0; i<ng; i++){
+		chantostr(s[0], g[i].dst);
+		chantostr(s[1], g[i].src);
+		chantostr(s[2], g[i].mask);
+		p = seprint(p, e, "%s %s%s %s%s %s %llud %llud\n",
+			s[0],
+			s[1], (g[i].state&Simplesrc) ? "/solid" : (g[i].state&Replsrc) ? "/repl" : "",
+			s[2], (g[i].state&Fullmask) ? "/opaque" : (g[i].state&Simplemask) ? "/solid" : (g[i].state&Replmask) ? "/repl" : "",
+			g[i].op < Ncomp ? opname[g[i].op] : "?",
+			g[i].ndraw, g[i].npix);
+	}
+	return p-buf;
+}
+
 
 void
 memfillcolor(Memimage *i, ulong val)
@@ -19,8 +19,14 @@
 typedef struct Param	Param;
 typedef struct State	State;
 
+enum {
+	Nspan = 256,
+};
+
 static	void	bellipse(int, State*, Param*);
 static	void	erect(int, int, int, int, Param*);
+static	void	espan(int, int, int, Param*);
+static	void	eflush(Param*);
 static	void	eline(int, int, int, int, Param*);
 
 struct Param {
@@ -31,6 +37,8 @@ struct Param {
 	Point			sp;
 	Memimage	*disc;
 	int			op;
+	int			n;
+	Memspan		s[Nspan];	/* rows waiting for eflush */
 };
 
 /*
@@ -122,6 +130,7 @@ memellipse(Memimage *dst, Point c, int a, int b, int t, Memimage *src, Point sp,
 	p.sp = subpt(sp, c);
 	p.disc = nil;
 	p.op = op;
+	p.n = 0;
 
 	u = (t<<1)*(a-b);
 	if((b<a && u>b*b) || (a<b && -u>a*a)) {
@@ -143,9 +152,9 @@ memellipse(Memimage *dst, Point c, int a, int b, int t, Memimage *src, Point sp,
 	for( ; y>=0; y--) {
 		outx = step(&out);
 		if(y > inb) {
-			erect(-outx, y, outx, y, &p);
+			espan(-outx, outx, y, &p);
 			if(y != 0)
-				erect(-outx, -y, outx, -y, &p);
+				espan(-outx, outx, -y, &p);
 			continue;
 		}
 		if(t > 0) {
@@ -154,14 +163,15 @@ memellipse(Memimage *dst, Point c, int a, int b, int t, Memimage *src, Point sp,
 				inx = 0;
 		} else if(inx > outx)
 			inx = outx;
-		erect(inx, y, outx, y, &p);
+		espan(inx, outx, y, &p);
 		if(y != 0)
-			erect(inx, -y, outx, -y, &p);
-		erect(-outx, y, -inx, y, &p);
+			espan(inx, outx, -y, &p);
+		espan(-outx, -inx, y, &p);
 		if(y != 0)
-			erect(-outx, -y, -inx, -y, &p);
+			espan(-outx, -inx, -y, &p);
 		inx = outx + 1;
 	}
+	eflush(&p);
 }
 
 /*
@@ -212,6 +222,33 @@ erect(int x0, int y0, int x1, int y1, Param *p)
 	memdraw(p->dst, r, p->src, addpt(p->sp, r.min), memopaque, ZP, p->op);
 }
 
+/*
+ * a one-row erect, saved up and drawn in batches
+ */
+static
+void
+espan(int x0, int x1, int y, Param *p)
+{
+	Memspan *s;
+
+	if(x0 > x1)
+		return;
+	if(p->n == Nspan)
+		eflush(p);
+	s = &p->s[p->n++];
+	s->x0 = p->c.x+x0;
+	s->x1 = p->c.x+x1+1;
+	s->y = p->c.y+y;
+}
+
+static
+void
+eflush(Param *p)
+{
+	memdrawspans(p->dst, p->s, p->n, p->src, p->sp, p->op);
+	p->n = 0;
+}
+
 /*
  * a brushed point similarly specified
  */
@@ -19,39 +19,61 @@ struct Seg
 	long	d;
 };
 
+/*
+ * Spans are collected here and drawn a batch at a time,
+ * so that the clipping and the choice of how to draw
+ * are done once per batch rather than once per span.
+ */
+typedef struct Spans	Spans;
+
+enum {
+	Nspan = 256,
+	Nvert = 16,
+	Nsmall = 8,
+};
+
+struct Spans
+{
+	Memimage	*dst;
+	Memimage	*src;
+	Point	sp;
+	int	op;
+	int	n;
+	Memspan	s[Nspan];
+};
+
 static	void	zsort(Seg **seg, Seg **ep);
 static	int	ycompare(const void*, const void*);
 static	int	xcompare(const void*, const void*);
 static	int	zcompare(const void*, const void*);
-static	void	xscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src, Point sp, int, int, int, int);
-static	void	yscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src, Point sp, int, int);
+static	void	sscan(Spans *f, Seg *segtab, int nseg, int wind, int fixshift);
+static	void	xscan(Spans *f, Seg **seg, Seg *segtab, int nseg, int wind, int, int, int);
+static	void	yscan(Spans *f, Seg **seg, Seg *segtab, int nseg, int wind, int);
+
+static void
+flushspans(Spans *f)
+{
+	memdrawspans(f->dst, f->s, f->n, f->src, f->sp, f->op);
+	f->n = 0;
+}
 
 static void
-fillline(Memimage *dst, int left, int right, int y, Memimage *src, Point p, int op)
+fillline(Spans *f, int left, int right, int y)
 {
-	Rectangle r;
-
-	r.min.x = left;
-	r.min.y = y;
-	r.max.x = right;
-	r.max.y = y+1;
-	p.x += left;
-	p.y += y;
-	memdraw(dst, r, src, p, memopaque, p, op);
+	Memspan *s;
+
+	if(f->n == Nspan)
+		flushspans(f);
+	s = &f->s[f->n++];
+	s->x0 = left;
+	s->x1 = right;
+	s->y = y;
 }
 
 static void
-fillpoint(Memimage *dst, int x, int y, Memimage *src, Point p, int op)
+fillpoint(Spans *f, int x, int y)
 {
-	Rectangle r;
-
-	r.min.x = x;
-	r.min.y = y;
-	r.max.x = x+1;
-	r.max.y = y+1;
-	p.x += x;
-	p.y += y;
-	memdraw(dst, r, src, p, memopaque, p, op);
+	fillline(f, x, x+1, y);
 }
 
 void
@@ -64,20 +86,29 @@ void
 _memfillpolysc(Memimage *dst, Point *vert, int nvert, int w, Memimage *src, Point sp, int detail, int fixshift, int clipped, int op)
 {
 	Seg **seg, *segtab;
+	Seg *segbuf[Nvert+2], segtabbuf[Nvert+1];
+	Spans f0, *f;
 	Point p0;
 	int i;
 
 	if(nvert <= 0)
 		return;
 
-	seg = malloc((nvert+2)*sizeof(Seg*));
-	if(seg == nil)
-		return;
-	segtab = malloc((nvert+1)*sizeof(Seg));
-	if(segtab == nil) {
-		free(seg);
-		return;
+	/* lines and other small polygons need not touch the heap */
+	if(nvert <= Nvert){
+		seg = segbuf;
+		segtab = segtabbuf;
+	}else{
+		seg = malloc((nvert+2)*sizeof(Seg*));
+		if(seg == nil)
+			return;
+		segtab = malloc((nvert+1)*sizeof(Seg));
+		if(segtab == nil) {
+			free(seg);
+			return;
+		}
 	}
+	f = &f0;
 
 	sp.x = (sp.x - vert[0].x) >> fixshift;
 	sp.y = (sp.y - vert[0].y) >> fixshift;
@@ -99,12 +130,23 @@ _memfillpolysc(Memimage *dst, Point *vert, int nvert, int w, Memimage *src, Poin
 	if(!fixshift)
 		fixshift = 1;
 
-	xscan(dst, seg, segtab, nvert, w, src, sp, detail, fixshift, clipped, op);
+	f->dst = dst;
+	f->src = src;
+	f->sp = sp;
+	f->op = op;
+	f->n = 0;
+	if(!detail && nvert <= Nsmall)
+		sscan(f, segtab, nvert, w, fixshift);
+	else
+		xscan(f, seg, segtab, nvert, w, detail, fixshift, clipped);
 	if(detail)
-		yscan(dst, seg, segtab, nvert, w, src, sp, fixshift, op);
+		yscan(f, seg, segtab, nvert, w, fixshift);
+	flushspans(f);
 
-	free(seg);
-	free(segtab);
+	if(seg != segbuf){
+		free(seg);
+		free(segtab);
+	}
 }
 
 static long
@@ -146,15 +188,124 @@ smuldivmod(long x, long y, long z, long *mod)
 	return -((-vx)/z);
 }
 
+/*
+ * xscan without the bookkeeping, for the few edges of a thin line
+ * or other small polygon: look at every edge on every row.
+ * The arithmetic is that of xscan, so the pixels are the same.
+ */
+static void
+sscan(Spans *f, Seg *segtab, int nseg, int wind, int fixshift)
+{
+	long y, maxy, onehalf, iy, ix, ix2, minx, maxx, z;
+	Seg *s, *es, *t, *act[Nsmall];
+	int i, n, c, cnt;
+	Memimage *dst;
+	Point pt;
+
+	dst = f->dst;
+	es = segtab+nseg;
+	y = maxy = 0;
+	n = 0;
+	for(s=segtab; s<es; s++) {
+		if(s->p0.y == s->p1.y) {
+			s->d = 0;
+			continue;
+		}
+		if(s->p0.y > s->p1.y) {
+			pt = s->p0;
+			s->p0 = s->p1;
+			s->p1 = pt;
+			s->d = -s->d;
+		}
+		s->num = s->p1.x - s->p0.x;
+		s->den = s->p1.y - s->p0.y;
+		s->dz = sdiv(s->num, s->den) << fixshift;
+		s->dzrem = mod(s->num, s->den) << fixshift;
+		s->dz += sdiv(s->dzrem, s->den);
+		s->dzrem = mod(s->dzrem, s->den);
+		s->zerr = -1;	/* not yet started */
+		if(n++ == 0 || s->p0.y < y)
+			y = s->p0.y;
+		if(s->p1.y > maxy)
+			maxy = s->p1.y;
+	}
+	if(n == 0)
+		return;
+
+	onehalf = 0;
+	if(fixshift)
+		onehalf = 1 << (fixshift-1);
+
+	minx = dst->clipr.min.x;
+	maxx = dst->clipr.max.x;
+
+	if(y < (dst->clipr.min.y << fixshift))
+		y = dst->clipr.min.y << fixshift;
+	iy = (y + onehalf) >> fixshift;
+	y = (iy << fixshift) + onehalf;
+	if(maxy >= dst->clipr.max.y << fixshift)
+		maxy = (dst->clipr.max.y << fixshift) - 1;
+
+	for(; y<=maxy; y += 1<<fixshift, iy++) {
+		n = 0;
+		for(s=segtab; s<es; s++) {
+			if(s->d == 0 || s->p0.y >= y || s->p1.y < y)
+				continue;
+			if(s->zerr < 0) {
+				s->z = s->p0.x;
+				s->z += smuldivmod(y - s->p0.y, s->num, s->den, &s->zerr);
+			} else {
+				/* without a branch: the carry is unpredictable */
+				s->zerr += s->dzrem;
+				c = s->zerr >= s->den;
+				s->z += s->dz + c;
+				s->zerr -= s->den & -c;
+			}
+			/* insertion sort by z */
+			for(i=n++; i>0 && act[i-1]->z > s->z; i--)
+				act[i] = act[i-1];
+			act[i] = s;
+		}
+
+		for(i=0; i<n; i++) {
+			cnt = act[i]->d;
+			z = act[i]->z;
+			for(;;) {
+				if(++i == n) {
+					print("sscan: fill to infinity");
+					return;
+				}
+				cnt += act[i]->d;
+				if((cnt&wind) == 0)
+					break;
+			}
+			t = act[i];
+			ix = (z + onehalf) >> fixshift;
+			ix2 = (t->z + onehalf) >> fixshift;
+			if(ix >= maxx)
+				break;
+			if(ix < minx)
+				ix = minx;
+			if(ix2 <= minx)
+				continue;
+			if(ix2 > maxx)
+				ix2 = maxx;
+			fillline(f, ix, ix2, iy);
+		}
+	}
+}
+
 static void
-xscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src, Point sp, int detail, int fixshift, int clipped, int op)
+xscan(Spans *f, Seg **seg, Seg *segtab, int nseg, int wind, int detail, int fixshift, int clipped)
 {
 	long y, maxy, x, x2, xerr, xden, onehalf;
 	Seg **ep, **next, **p, **q, *s;
 	long n, i, iy, cnt, ix, ix2, minx, maxx;
+	Memimage *dst;
 	Point pt;
 
 	USED(clipped);
+	dst = f->dst;
 
 	for(i=0, s=segtab, p=seg; i<nseg; i++, s++) {
 		*p = s;
@@ -271,7 +422,7 @@ xscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src,
 				ix = (x + x2) >> (fixshift+1);
 				ix2 = ix+1;
 			}
-			fillline(dst, ix, ix2, iy, src, sp, op);
+			fillline(f, ix, ix2, iy);
 		}
 		y += (1<<fixshift);
 		iy++;
@@ -279,13 +430,16 @@ xscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src,
 }
 
 static void
-yscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src, Point sp, int fixshift, int op)
+yscan(Spans *f, Seg **seg, Seg *segtab, int nseg, int wind, int fixshift)
 {
 	long x, maxx, y, y2, yerr, yden, onehalf;
 	Seg **ep, **next, **p, **q, *s;
 	int n, i, ix, cnt, iy, iy2, miny, maxy;
+	Memimage *dst;
 	Point pt;
 
+	dst = f->dst;
+
 	for(i=0, s=segtab, p=seg; i<nseg; i++, s++) {
 		*p = s;
 		if(s->p0.x == s->p1.x)
@@ -399,7 +553,7 @@ yscan(Memimage *dst, Seg **seg, Seg *segtab, int nseg, int wind, Memimage *src,
 				if(yerr*p[0]->den + p[0]->zerr*yden > p[0]->den*yden)
 					y++;
 				iy = (y + y2) >> (fixshift+1);
-				fillpoint(dst, ix, iy, src, sp, op);
+				fillpoint(f, ix, iy);
 			}
 		}
 		x += (1<<fixshift);
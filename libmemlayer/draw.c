@@ -183,3 +183,49 @@ memdraw(Memimage *dst, Rectangle r, Memimage *src, Point p0, Memimage *mask, Poi
 	d.mask = mask;
 	_memlayerop(ldrawop, dst, r, r, &d);
 }
+
+/*
+ * Spans drawn through a mask of memopaque, as by memdraw
+ * for each Rect(x0, y, x1, y+1) with source point sp+min.
+ * A clear layer is clipped once and handed to memimagespans
+ * on the screen; obscured layers fall back to memdraw.
+ */
+void
+memdrawspans(Memimage *dst, Memspan *s, int n, Memimage *src, Point sp, int op)
+{
+	Memlayer *dl;
+	Memspan *e, *t, *s0;
+	Rectangle r, cr;
+	Point p;
+
+	dl = dst->layer;
+	if(dl == nil){
+		memimagespans(dst, s, n, src, sp, op);
+		return;
+	}
+	if(dl->clear && src->layer == nil){
+		cr = dst->r;
+		if(!rectclip(&cr, dst->clipr))
+			return;
+		s0 = t = s;
+		for(e=s+n; s<e; s++){
+			if(s->y < cr.min.y || s->y >= cr.max.y)
+				continue;
+			t->x0 = s->x0 < cr.min.x ? cr.min.x : s->x0;
+			t->x1 = s->x1 > cr.max.x ? cr.max.x : s->x1;
+			if(t->x0 >= t->x1)
+				continue;
+			t->x0 += dl->delta.x;
+			t->x1 += dl->delta.x;
+			t->y = s->y + dl->delta.y;
+			t++;
+		}
+		memimagespans(dl->screen->image, s0, t-s0, src, subpt(sp, dl->delta), op);
+		return;
+	}
+	for(e=s+n; s<e; s++){
+		r = Rect(s->x0, s->y, s->x1, s->y+1);
+		p = addpt(sp, r.min);
+		memdraw(dst, r, src, p, memopaque, p, op);
+	}
+}
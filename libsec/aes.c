@@ -1231,6 +1231,11 @@ AESdecrypt(ulong rk[/* 4*(Nr + 1) */], int Nr, uchar ct[16], uchar pt[16])
 
 void (*aes_encrypt)(ulong rk[], int Nr, uchar pt[16], uchar ct[16]) = AESencrypt;
 void (*aes_decrypt)(ulong rk[], int Nr, uchar ct[16], uchar pt[16]) = AESdecrypt;
+void (*aes_cbcencrypt)(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n);
+void (*aes_cbcdecrypt)(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n);
+void (*aes_ctr32)(ulong rk[], int Nr, uchar ctr[16], uchar *p, ulong n);
+void (*aes_ghashinit)(uchar h[16], uchar *tab);
+void (*aes_ghash)(uchar *tab, uchar y[16], uchar *p, ulong n);
 
 void
 setupAESstate(AESstate *s, uchar key[], int nkey, uchar *ivec)
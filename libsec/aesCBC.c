@@ -11,7 +11,14 @@ aesCBCencrypt(uchar *p, int len, AESstate *s)
 {
 	uchar *p2, *ip, *eip;
 	uchar q[AESbsize];
+	int n;
 
+	if(aes_cbcencrypt != nil && len >= AESbsize){
+		n = len - len%AESbsize;
+		aes_cbcencrypt(s->ekey, s->rounds, s->ivec, p, n);
+		p += n;
+		len -= n;
+	}
 	for(; len >= AESbsize; len -= AESbsize){
 		p2 = p;
 		ip = s->ivec;
@@ -37,7 +44,14 @@ aesCBCdecrypt(uchar *p, int len, AESstate *s)
 {
 	uchar *ip, *eip, *tp;
 	uchar tmp[AESbsize], q[AESbsize];
+	int n;
 
+	if(aes_cbcdecrypt != nil && len >= AESbsize){
+		n = len - len%AESbsize;
+		aes_cbcdecrypt(s->dkey, s->rounds, s->ivec, p, n);
+		p += n;
+		len -= n;
+	}
 	for(; len >= AESbsize; len -= AESbsize){
 		memmove(tmp, p, AESbsize);
 		aes_decrypt(s->dkey, s->rounds, p, q);
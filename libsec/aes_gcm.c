@@ -1,98 +1,122 @@
 #include "os.h"
 #include <libsec.h>
 
-static void
-load128(uchar b[16], ulong W[4])
+/*
+ * GHASH is done with the cpu's carry-less multiply
+ * through aes_ghash when there is one, otherwise four
+ * bits at a time with M holding the 16 multiples of H
+ * (Shoup's method) and last4 the reductions of the
+ * four bits shifted out.
+ */
+static ushort last4[16] = {
+	0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+	0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0,
+};
+
+static uvlong
+get64(uchar *b)
 {
-	W[0] = (ulong)b[15] | (ulong)b[14]<<8 | (ulong)b[13]<<16 | (ulong)b[12]<<24;
-	W[1] = (ulong)b[11] | (ulong)b[10]<<8 | (ulong)b[ 9]<<16 | (ulong)b[ 8]<<24;
-	W[2] = (ulong)b[ 7] | (ulong)b[ 6]<<8 | (ulong)b[ 5]<<16 | (ulong)b[ 4]<<24;
-	W[3] = (ulong)b[ 3] | (ulong)b[ 2]<<8 | (ulong)b[ 1]<<16 | (ulong)b[ 0]<<24;
+	return (uvlong)b[0]<<56 | (uvlong)b[1]<<48 | (uvlong)b[2]<<40 | (uvlong)b[3]<<32
+		| (uvlong)b[4]<<24 | (uvlong)b[5]<<16 | (uvlong)b[6]<<8 | b[7];
 }
 
 static void
-store128(ulong W[4], uchar b[16])
+put64(uchar *b, uvlong v)
 {
-	b[15] = W[0], b[14] = W[0]>>8, b[13] = W[0]>>16, b[12] = W[0]>>24;
-	b[11] = W[1], b[10] = W[1]>>8, b[ 9] = W[1]>>16, b[ 8] = W[1]>>24;
-	b[ 7] = W[2], b[ 6] = W[2]>>8, b[ 5] = W[2]>>16, b[ 4] = W[2]>>24;
-	b[ 3] = W[3], b[ 2] = W[3]>>8, b[ 1] = W[3]>>16, b[ 0] = W[3]>>24;
+	b[0] = v>>56, b[1] = v>>48, b[2] = v>>40, b[3] = v>>32;
+	b[4] = v>>24, b[5] = v>>16, b[6] = v>>8, b[7] = v;
 }
 
 static void
-gfmul(ulong X[4], ulong Y[4], ulong Z[4])
+prepareM(uchar H[16], uvlong M[16][2])
 {
-	long m, i;
-
-	Z[0] = Z[1] = Z[2] = Z[3] = 0;
-	for(i=127; i>=0; i--){
-		m = ((long)Y[i>>5] << (31-(i&31))) >> 31;
-		Z[0] ^= X[0] & m;
-		Z[1] ^= X[1] & m;
-		Z[2] ^= X[2] & m;
-		Z[3] ^= X[3] & m;
-		m = ((long)X[0]<<31) >> 31;
-		X[0] = X[0]>>1 | X[1]<<31;
-		X[1] = X[1]>>1 | X[2]<<31;
-		X[2] = X[2]>>1 | X[3]<<31;
-		X[3] = X[3]>>1 ^ (0xE1000000 & m);
+	uvlong hi, lo, r;
+	int i, j;
+
+	hi = get64(H);
+	lo = get64(H+8);
+	M[0][0] = M[0][1] = 0;
+	M[8][0] = hi;
+	M[8][1] = lo;
+	for(i = 4; i > 0; i >>= 1){
+		r = (lo & 1) * 0xE100000000000000ULL;
+		lo = hi<<63 | lo>>1;
+		hi = hi>>1 ^ r;
+		M[i][0] = hi;
+		M[i][1] = lo;
 	}
-}
-
-static void
-prepareM(ulong H[4], ulong M[16][256][4])
-{
-	ulong X[4], i, j;
-
-	for(i=0; i<16; i++){
-		for(j=0; j<256; j++){
-			X[0] = X[1] = X[2] = X[3] = 0;
-			X[i>>2] = j<<((i&3)<<3);
-			gfmul(X, H, M[i][j]);
+	for(i = 2; i < 16; i <<= 1)
+		for(j = 1; j < i; j++){
+			M[i+j][0] = M[i][0] ^ M[j][0];
+			M[i+j][1] = M[i][1] ^ M[j][1];
 		}
-	}
 }
 
+/* Y = (Y ^ X) * H */
 static void
-ghash1(AESGCMstate *s, ulong X[4], ulong Y[4])
+ghash1(AESGCMstate *s, uchar X[16], uchar Y[16])
 {
-	ulong *Xi, i;
+	uvlong hi, lo;
+	int i, b, r;
 
-	X[0] ^= Y[0], X[1] ^= Y[1], X[2] ^= Y[2], X[3] ^= Y[3];
-	if(0){
-		gfmul(X, s->H, Y);
+	if(aes_ghash != nil){
+		aes_ghash((uchar*)s->M, Y, X, 16);
 		return;
 	}
-
-	Y[0] = Y[1] = Y[2] = Y[3] = 0;
-	for(i=0; i<16; i++){
-		Xi = s->M[i][(X[i>>2]>>((i&3)<<3))&0xFF];
-		Y[0] ^= Xi[0];
-		Y[1] ^= Xi[1];
-		Y[2] ^= Xi[2];
-		Y[3] ^= Xi[3];
+	for(i=0; i<16; i++)
+		Y[i] ^= X[i];
+
+	hi = lo = 0;
+	for(i=15; i>=0; i--){
+		b = Y[i];
+		if(i != 15){
+			r = lo & 15;
+			lo = hi<<60 | lo>>4;
+			hi = hi>>4 ^ (uvlong)last4[r]<<48;
+		}
+		hi ^= s->M[b&15][0];
+		lo ^= s->M[b&15][1];
+		r = lo & 15;
+		lo = hi<<60 | lo>>4;
+		hi = hi>>4 ^ (uvlong)last4[r]<<48;
+		hi ^= s->M[b>>4][0];
+		lo ^= s->M[b>>4][1];
 	}
+	put64(Y, hi);
+	put64(Y+8, lo);
 }
 
 static void
-ghashn(AESGCMstate *s, uchar *dat, ulong len, ulong Y[4])
+ghashn(AESGCMstate *s, uchar *dat, ulong len, uchar Y[16])
 {
 	uchar tmp[16];
-	ulong X[4];
+	ulong n;
 
+	if(aes_ghash != nil && len >= 16){
+		n = len - len%16;
+		aes_ghash((uchar*)s->M, Y, dat, n);
+		dat += n, len -= n;
+	}
 	while(len >= 16){
-		load128(dat, X);
-		ghash1(s, X, Y);
+		memmove(tmp, dat, 16);
+		ghash1(s, tmp, Y);
 		dat += 16, len -= 16;
 	}
 	if(len > 0){
 		memmove(tmp, dat, len);
 		memset(tmp+len, 0, 16-len);
-		load128(tmp, X);
-		ghash1(s, X, Y);
+		ghash1(s, tmp, Y);
 	}
 }
 
+/* the lengths block: bit counts of a and b */
+static void
+lenblock(uchar L[16], ulong a, ulong b)
+{
+	put64(L, (uvlong)a<<3);
+	put64(L+8, (uvlong)b<<3);
+}
+
 static ulong
 aesxctr1(AESstate *s, uchar ctr[AESbsize], uchar *dat, ulong len)
 {
@@ -111,9 +135,15 @@ static void
 aesxctrn(AESstate *s, uchar *dat, ulong len)
 {
 	uchar ctr[AESbsize];
-	ulong i;
+	ulong i, n;
 
 	memmove(ctr, s->ivec, AESbsize);
+	if(aes_ctr32 != nil && len >= AESbsize){
+		n = len - len%AESbsize;
+		aes_ctr32(s->ekey, s->rounds, ctr, dat, n);
+		dat += n;
+		len -= n;
+	}
 	while(len > 0){
 		for(i=AESbsize-1; i>=AESbsize-4; i--)
 			if(++ctr[i] != 0)
@@ -134,14 +164,12 @@ aesgcm_setiv(AESGCMstate *s, uchar *iv, int ivlen)
 		memset(s->a.ivec+ivlen, 0, AESbsize-ivlen);
 		s->a.ivec[AESbsize-1] = 1;
 	} else {
-		ulong L[4], Y[4] = {0};
+		uchar L[16], Y[16] = {0};
 
 		ghashn(s, iv, ivlen, Y);
-		L[0] = ivlen << 3;
-		L[1] = ivlen >> 29;
-		L[2] = L[3] = 0;
+		lenblock(L, 0, ivlen);
 		ghash1(s, L, Y);
-		store128(Y, s->a.ivec);
+		memmove(s->a.ivec, Y, AESbsize);
 	}
 }
 
@@ -152,9 +180,11 @@ setupAESGCMstate(AESGCMstate *s, uchar *key, int keylen, uchar *iv, int ivlen)
 
 	memset(s->a.ivec, 0, AESbsize);
 	aes_encrypt(s->a.ekey, s->a.rounds, s->a.ivec, s->a.ivec);
-	load128(s->a.ivec, s->H);
+	if(aes_ghashinit != nil)
+		aes_ghashinit(s->a.ivec, (uchar*)s->M);
+	else
+		prepareM(s->a.ivec, s->M);
 	memset(s->a.ivec, 0, AESbsize);
-	prepareM(s->H, s->M);
 
 	if(iv != nil && ivlen > 0)
 		aesgcm_setiv(s, iv, ivlen);
@@ -163,36 +193,28 @@ setupAESGCMstate(AESGCMstate *s, uchar *key, int keylen, uchar *iv, int ivlen)
 void
 aesgcm_encrypt(uchar *dat, ulong ndat, uchar *aad, ulong naad, uchar tag[16], AESGCMstate *s)
 {
-	ulong L[4], Y[4] = {0};
+	uchar L[16], Y[16] = {0};
 
 	ghashn(s, aad, naad, Y);
 	aesxctrn(&s->a, dat, ndat);
 	ghashn(s, dat, ndat, Y);
-	L[0] = ndat << 3;
-	L[1] = ndat >> 29;
-	L[2] = naad << 3;
-	L[3] = naad >> 29;
+	lenblock(L, naad, ndat);
 	ghash1(s, L, Y);
-	store128(Y, tag);
+	memmove(tag, Y, 16);
 	aesxctr1(&s->a, s->a.ivec, tag, 16);
 }
 
 int
 aesgcm_decrypt(uchar *dat, ulong ndat, uchar *aad, ulong naad, uchar tag[16], AESGCMstate *s)
 {
-	ulong L[4], Y[4] = {0};
-	uchar tmp[16];
+	uchar L[16], Y[16] = {0};
 
 	ghashn(s, aad, naad, Y);
 	ghashn(s, dat, ndat, Y);
-	L[0] = ndat << 3;
-	L[1] = ndat >> 29;
-	L[2] = naad << 3;
-	L[3] = naad >> 29;
+	lenblock(L, naad, ndat);
 	ghash1(s, L, Y);
-	store128(Y, tmp);
-	aesxctr1(&s->a, s->a.ivec, tmp, 16);
-	if(tsmemcmp(tag, tmp, 16) != 0)
+	aesxctr1(&s->a, s->a.ivec, Y, 16);
+	if(tsmemcmp(tag, Y, 16) != 0)
 		return -1;
 	aesxctrn(&s->a, dat, ndat);
 	return 0;
@@ -1,5 +1,712 @@
+/*
+ * AES with the cpu's AES instructions: AES-NI on amd64
+ * and the ARMv8 Cryptography Extension on arm64.
+ *
+ * The round keys are the FIPS-197 key schedule in byte
+ * order, one 16-byte vector per round, and the decryption
+ * keys are those of the equivalent inverse cipher.  Both
+ * need the 16-byte alignment setupAESstate gives them.
+ *
+ * Besides the single block functions, aesni_init sets the
+ * CBC and counter mode hooks, which keep eight blocks in
+ * flight where the mode allows it, and the GHASH hooks for
+ * GCM when the cpu has a carry-less multiply.  There are
+ * no table lookups, so the timing does not depend on key
+ * or data.
+ *
+ * The arm64 code has yet to be run on an arm64 cpu, so it
+ * is only compiled with -DARM64SIMD; otherwise arm64 uses
+ * the portable AES and GCM code.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define AESX86
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(ARM64SIMD)
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define AESARM
+#endif
+
+#include "os.h"
+#include <libsec.h>
+
+enum
+{
+	Nwide	= 8,	/* blocks in flight */
+};
+
+#if defined(AESX86) || defined(AESARM)
+
+static u32int	subword(u32int);
+
+#define ROR8(x)	((x)>>8 | (x)<<24)
+
+/*
+ * FIPS-197 key expansion into w, the words in
+ * memory order.  Returns the number of rounds.
+ */
+static int
+expand(u32int w[4*(AESmaxrounds+1)], uchar key[], int nkey)
+{
+	u32int t, rcon;
+	int Nr, Nk, i;
+
+	switch(nkey){
+	case 16:
+		Nr = 10;
+		break;
+	case 24:
+		Nr = 12;
+		break;
+	case 32:
+		Nr = 14;
+		break;
+	default:
+		return 0;
+	}
+	Nk = nkey/4;
+	memmove(w, key, nkey);
+	rcon = 1;
+	for(i = Nk; i < 4*(Nr+1); i++){
+		t = w[i-1];
+		if(i%Nk == 0){
+			t = ROR8(subword(t)) ^ rcon;
+			rcon = rcon<<1 ^ (rcon>>7)*0x11b;
+		}else if(Nk > 6 && i%Nk == 4)
+			t = subword(t);
+		w[i] = w[i-Nk] ^ t;
+	}
+	return Nr;
+}
+
+#endif
+
+#ifdef AESX86
+
+#define AESNI __attribute__((target("aes,ssse3")))
+
+/* SubWord from the first word of aeskeygenassist */
+AESNI static u32int
+subword(u32int t)
+{
+	return _mm_cvtsi128_si32(_mm_aeskeygenassist_si128(_mm_set1_epi32(t), 0));
+}
+
+AESNI static int
+setup(ulong erk[], ulong drk[], uchar key[], int nkey)
+{
+	u32int w[4*(AESmaxrounds+1)];
+	__m128i *ek, *dk;
+	int Nr, i;
+
+	Nr = expand(w, key, nkey);
+	if(Nr == 0)
+		return 0;
+	ek = (__m128i*)erk;
+	dk = (__m128i*)drk;
+	for(i = 0; i <= Nr; i++)
+		ek[i] = _mm_loadu_si128((__m128i*)(w+4*i));
+	dk[0] = ek[Nr];
+	for(i = 1; i < Nr; i++)
+		dk[i] = _mm_aesimc_si128(ek[Nr-i]);
+	dk[Nr] = ek[0];
+	memset(w, 0, sizeof w);
+	return Nr;
+}
+
+AESNI static __m128i
+enc1(__m128i *k, int Nr, __m128i x)
+{
+	int i;
+
+	x = _mm_xor_si128(x, k[0]);
+	for(i = 1; i < Nr; i++)
+		x = _mm_aesenc_si128(x, k[i]);
+	return _mm_aesenclast_si128(x, k[Nr]);
+}
+
+AESNI static __m128i
+dec1(__m128i *k, int Nr, __m128i x)
+{
+	int i;
+
+	x = _mm_xor_si128(x, k[0]);
+	for(i = 1; i < Nr; i++)
+		x = _mm_aesdec_si128(x, k[i]);
+	return _mm_aesdeclast_si128(x, k[Nr]);
+}
+
+/*
+ * Eight blocks through the rounds together.  The loops
+ * over them are unrolled so that x stays in registers.
+ */
+AESNI static inline void
+enc8(__m128i *k, int Nr, __m128i x[Nwide])
+{
+	__m128i r;
+	int i, j;
+
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		x[j] = _mm_xor_si128(x[j], k[0]);
+	for(i = 1; i < Nr; i++){
+		r = k[i];
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			x[j] = _mm_aesenc_si128(x[j], r);
+	}
+	r = k[Nr];
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		x[j] = _mm_aesenclast_si128(x[j], r);
+}
+
+AESNI static inline void
+dec8(__m128i *k, int Nr, __m128i x[Nwide])
+{
+	__m128i r;
+	int i, j;
+
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		x[j] = _mm_xor_si128(x[j], k[0]);
+	for(i = 1; i < Nr; i++){
+		r = k[i];
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			x[j] = _mm_aesdec_si128(x[j], r);
+	}
+	r = k[Nr];
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		x[j] = _mm_aesdeclast_si128(x[j], r);
+}
+
+AESNI static void
+encblk(ulong rk[], int Nr, uchar pt[16], uchar ct[16])
+{
+	_mm_storeu_si128((__m128i*)ct, enc1((__m128i*)rk, Nr, _mm_loadu_si128((__m128i*)pt)));
+}
+
+AESNI static void
+decblk(ulong rk[], int Nr, uchar ct[16], uchar pt[16])
+{
+	_mm_storeu_si128((__m128i*)pt, dec1((__m128i*)rk, Nr, _mm_loadu_si128((__m128i*)ct)));
+}
+
+AESNI static void
+cbcenc(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n)
+{
+	__m128i *k, v;
+
+	k = (__m128i*)rk;
+	v = _mm_loadu_si128((__m128i*)ivec);
+	for(; n >= 16; n -= 16, p += 16){
+		v = enc1(k, Nr, _mm_xor_si128(v, _mm_loadu_si128((__m128i*)p)));
+		_mm_storeu_si128((__m128i*)p, v);
+	}
+	_mm_storeu_si128((__m128i*)ivec, v);
+}
+
+AESNI static void
+cbcdec(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n)
+{
+	__m128i *k, v, c, x[Nwide], y[Nwide];
+	int j;
+
+	k = (__m128i*)rk;
+	v = _mm_loadu_si128((__m128i*)ivec);
+	for(; n >= Nwide*16; n -= Nwide*16, p += Nwide*16){
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			x[j] = y[j] = _mm_loadu_si128((__m128i*)p+j);
+		dec8(k, Nr, x);
+		_mm_storeu_si128((__m128i*)p, _mm_xor_si128(x[0], v));
+#pragma GCC unroll 8
+		for(j = 1; j < Nwide; j++)
+			_mm_storeu_si128((__m128i*)p+j, _mm_xor_si128(x[j], y[j-1]));
+		v = y[Nwide-1];
+	}
+	for(; n >= 16; n -= 16, p += 16){
+		c = _mm_loadu_si128((__m128i*)p);
+		_mm_storeu_si128((__m128i*)p, _mm_xor_si128(dec1(k, Nr, c), v));
+		v = c;
+	}
+	_mm_storeu_si128((__m128i*)ivec, v);
+}
+
+/*
+ * For each block, increment the big-endian low word
+ * of ctr, encrypt it and xor the result into p.  The
+ * counter is kept byte reversed so that its low word
+ * is the first lane and plain adds do the increment.
+ */
+AESNI static void
+ctr32(ulong rk[], int Nr, uchar ctr[16], uchar *p, ulong n)
+{
+	__m128i *k, rev, one, c, x[Nwide];
+	int j;
+
+	k = (__m128i*)rk;
+	rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	one = _mm_set_epi32(0, 0, 0, 1);
+	c = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)ctr), rev);
+	for(; n >= Nwide*16; n -= Nwide*16, p += Nwide*16){
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++){
+			c = _mm_add_epi32(c, one);
+			x[j] = _mm_shuffle_epi8(c, rev);
+		}
+		enc8(k, Nr, x);
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			_mm_storeu_si128((__m128i*)p+j, _mm_xor_si128(x[j], _mm_loadu_si128((__m128i*)p+j)));
+	}
+	for(; n >= 16; n -= 16, p += 16){
+		c = _mm_add_epi32(c, one);
+		x[0] = enc1(k, Nr, _mm_shuffle_epi8(c, rev));
+		_mm_storeu_si128((__m128i*)p, _mm_xor_si128(x[0], _mm_loadu_si128((__m128i*)p)));
+	}
+	_mm_storeu_si128((__m128i*)ctr, _mm_shuffle_epi8(c, rev));
+}
+
+/*
+ * GHASH with pclmulqdq, after Intel's "Carry-Less
+ * Multiplication and its Usage for Computing the GCM
+ * Mode".  Blocks are byte reversed on the way in and
+ * out; clmul multiplies without reducing, so Nwide
+ * products can be summed and reduced once.
+ */
+#define CLMUL __attribute__((target("pclmul,ssse3")))
+
+CLMUL static inline void
+clmul(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+	__m128i m;
+
+	*lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+	*hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+	m = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+	*lo = _mm_xor_si128(*lo, _mm_slli_si128(m, 8));
+	*hi = _mm_xor_si128(*hi, _mm_srli_si128(m, 8));
+}
+
+/* shift the 256-bit lo, hi left one bit for the bit reflection, then reduce */
+CLMUL static inline __m128i
+reduce(__m128i lo, __m128i hi)
+{
+	__m128i a, b, c;
+
+	a = _mm_srli_epi32(lo, 31);
+	b = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	c = _mm_srli_si128(a, 12);
+	b = _mm_slli_si128(b, 4);
+	a = _mm_slli_si128(a, 4);
+	lo = _mm_or_si128(lo, a);
+	hi = _mm_or_si128(_mm_or_si128(hi, b), c);
+
+	a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+	b = _mm_srli_si128(a, 4);
+	lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+	a = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+	lo = _mm_xor_si128(lo, _mm_xor_si128(a, b));
+	return _mm_xor_si128(hi, lo);
+}
+
+/* tab gets H, H², ... H⁸ */
+CLMUL static void
+ghashinit(uchar h[16], uchar *tab)
+{
+	__m128i rev, H, p, lo, hi;
+	int i;
+
+	rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	H = p = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)h), rev);
+	_mm_storeu_si128((__m128i*)tab, p);
+	for(i = 1; i < Nwide; i++){
+		lo = hi = _mm_setzero_si128();
+		clmul(p, H, &lo, &hi);
+		p = reduce(lo, hi);
+		_mm_storeu_si128((__m128i*)tab+i, p);
+	}
+}
+
+/* fold the whole blocks of p into the hash y */
+CLMUL static void
+ghash(uchar *tab, uchar y[16], uchar *p, ulong n)
+{
+	__m128i rev, Y, lo, hi, h[Nwide];
+	int j;
+
+	rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		h[j] = _mm_loadu_si128((__m128i*)tab+j);
+	Y = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)y), rev);
+	for(; n >= Nwide*16; n -= Nwide*16, p += Nwide*16){
+		lo = hi = _mm_setzero_si128();
+		Y = _mm_xor_si128(Y, _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)p), rev));
+		clmul(Y, h[Nwide-1], &lo, &hi);
+#pragma GCC unroll 8
+		for(j = 1; j < Nwide; j++)
+			clmul(_mm_shuffle_epi8(_mm_loadu_si128((__m128i*)p+j), rev), h[Nwide-1-j], &lo, &hi);
+		Y = reduce(lo, hi);
+	}
+	for(; n >= 16; n -= 16, p += 16){
+		lo = hi = _mm_setzero_si128();
+		Y = _mm_xor_si128(Y, _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)p), rev));
+		clmul(Y, h[0], &lo, &hi);
+		Y = reduce(lo, hi);
+	}
+	_mm_storeu_si128((__m128i*)y, _mm_shuffle_epi8(Y, rev));
+}
+
+static int
+hasclmul(void)
+{
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+}
+
+static int
+hasaes(void)
+{
+	return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+}
+
+#endif	/* AESX86 */
+
+#ifdef AESARM
+
+#ifdef __clang__
+#define AESCE __attribute__((target("crypto")))
+#else
+#define AESCE __attribute__((target("+crypto")))
+#endif
+
+/*
+ * aese on a vector of four copies of t: ShiftRows
+ * moves nothing when the columns are all the same.
+ */
+AESCE static u32int
+subword(u32int t)
+{
+	return vgetq_lane_u32(vreinterpretq_u32_u8(
+		vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(t)), vdupq_n_u8(0))), 0);
+}
+
+AESCE static int
+setup(ulong erk[], ulong drk[], uchar key[], int nkey)
+{
+	u32int w[4*(AESmaxrounds+1)];
+	uint8x16_t *ek, *dk;
+	int Nr, i;
+
+	Nr = expand(w, key, nkey);
+	if(Nr == 0)
+		return 0;
+	ek = (uint8x16_t*)erk;
+	dk = (uint8x16_t*)drk;
+	for(i = 0; i <= Nr; i++)
+		ek[i] = vld1q_u8((uchar*)(w+4*i));
+	dk[0] = ek[Nr];
+	for(i = 1; i < Nr; i++)
+		dk[i] = vaesimcq_u8(ek[Nr-i]);
+	dk[Nr] = ek[0];
+	memset(w, 0, sizeof w);
+	return Nr;
+}
+
+/* aese adds the round key first, so the last one is a plain xor */
+AESCE static uint8x16_t
+enc1(uint8x16_t *k, int Nr, uint8x16_t x)
+{
+	int i;
+
+	for(i = 0; i < Nr-1; i++)
+		x = vaesmcq_u8(vaeseq_u8(x, k[i]));
+	return veorq_u8(vaeseq_u8(x, k[Nr-1]), k[Nr]);
+}
+
+AESCE static uint8x16_t
+dec1(uint8x16_t *k, int Nr, uint8x16_t x)
+{
+	int i;
+
+	for(i = 0; i < Nr-1; i++)
+		x = vaesimcq_u8(vaesdq_u8(x, k[i]));
+	return veorq_u8(vaesdq_u8(x, k[Nr-1]), k[Nr]);
+}
+
+AESCE static inline void
+enc8(uint8x16_t *k, int Nr, uint8x16_t x[Nwide])
+{
+	uint8x16_t r;
+	int i, j;
+
+	for(i = 0; i < Nr-1; i++){
+		r = k[i];
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			x[j] = vaesmcq_u8(vaeseq_u8(x[j], r));
+	}
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		x[j] = veorq_u8(vaeseq_u8(x[j], k[Nr-1]), k[Nr]);
+}
+
+AESCE static inline void
+dec8(uint8x16_t *k, int Nr, uint8x16_t x[Nwide])
+{
+	uint8x16_t r;
+	int i, j;
+
+	for(i = 0; i < Nr-1; i++){
+		r = k[i];
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			x[j] = vaesimcq_u8(vaesdq_u8(x[j], r));
+	}
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		x[j] = veorq_u8(vaesdq_u8(x[j], k[Nr-1]), k[Nr]);
+}
+
+AESCE static void
+encblk(ulong rk[], int Nr, uchar pt[16], uchar ct[16])
+{
+	vst1q_u8(ct, enc1((uint8x16_t*)rk, Nr, vld1q_u8(pt)));
+}
+
+AESCE static void
+decblk(ulong rk[], int Nr, uchar ct[16], uchar pt[16])
+{
+	vst1q_u8(pt, dec1((uint8x16_t*)rk, Nr, vld1q_u8(ct)));
+}
+
+AESCE static void
+cbcenc(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n)
+{
+	uint8x16_t *k, v;
+
+	k = (uint8x16_t*)rk;
+	v = vld1q_u8(ivec);
+	for(; n >= 16; n -= 16, p += 16){
+		v = enc1(k, Nr, veorq_u8(v, vld1q_u8(p)));
+		vst1q_u8(p, v);
+	}
+	vst1q_u8(ivec, v);
+}
+
+AESCE static void
+cbcdec(ulong rk[], int Nr, uchar ivec[16], uchar *p, ulong n)
+{
+	uint8x16_t *k, v, c, x[Nwide], y[Nwide];
+	int j;
+
+	k = (uint8x16_t*)rk;
+	v = vld1q_u8(ivec);
+	for(; n >= Nwide*16; n -= Nwide*16, p += Nwide*16){
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			x[j] = y[j] = vld1q_u8(p+16*j);
+		dec8(k, Nr, x);
+		vst1q_u8(p, veorq_u8(x[0], v));
+#pragma GCC unroll 8
+		for(j = 1; j < Nwide; j++)
+			vst1q_u8(p+16*j, veorq_u8(x[j], y[j-1]));
+		v = y[Nwide-1];
+	}
+	for(; n >= 16; n -= 16, p += 16){
+		c = vld1q_u8(p);
+		vst1q_u8(p, veorq_u8(dec1(k, Nr, c), v));
+		v = c;
+	}
+	vst1q_u8(ivec, v);
+}
+
+AESCE static uint8x16_t
+rev128(uint8x16_t x)
+{
+	x = vrev64q_u8(x);
+	return vextq_u8(x, x, 8);
+}
+
+/* the counter is kept byte reversed, as on amd64 */
+AESCE static void
+ctr32(ulong rk[], int Nr, uchar ctr[16], uchar *p, ulong n)
+{
+	uint8x16_t *k, x[Nwide];
+	uint32x4_t c, one;
+	int j;
+
+	k = (uint8x16_t*)rk;
+	one = vsetq_lane_u32(1, vdupq_n_u32(0), 0);
+	c = vreinterpretq_u32_u8(rev128(vld1q_u8(ctr)));
+	for(; n >= Nwide*16; n -= Nwide*16, p += Nwide*16){
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++){
+			c = vaddq_u32(c, one);
+			x[j] = rev128(vreinterpretq_u8_u32(c));
+		}
+		enc8(k, Nr, x);
+#pragma GCC unroll 8
+		for(j = 0; j < Nwide; j++)
+			vst1q_u8(p+16*j, veorq_u8(x[j], vld1q_u8(p+16*j)));
+	}
+	for(; n >= 16; n -= 16, p += 16){
+		c = vaddq_u32(c, one);
+		vst1q_u8(p, veorq_u8(enc1(k, Nr, rev128(vreinterpretq_u8_u32(c))), vld1q_u8(p)));
+	}
+	vst1q_u8(ctr, rev128(vreinterpretq_u8_u32(c)));
+}
+
+/*
+ * GHASH with pmull, the amd64 code with NEON shifts:
+ * a byte shift left by n is vext from zero at 16-n.
+ */
+#define LANE(x, i)	vgetq_lane_p64(vreinterpretq_p64_u64(x), i)
+
+AESCE static inline void
+clmul(uint64x2_t a, uint64x2_t b, uint64x2_t *lo, uint64x2_t *hi)
+{
+	uint64x2_t m;
+	uint8x16_t z;
+
+	z = vdupq_n_u8(0);
+	*lo = veorq_u64(*lo, vreinterpretq_u64_p128(vmull_p64(LANE(a, 0), LANE(b, 0))));
+	*hi = veorq_u64(*hi, vreinterpretq_u64_p128(vmull_p64(LANE(a, 1), LANE(b, 1))));
+	m = veorq_u64(vreinterpretq_u64_p128(vmull_p64(LANE(a, 0), LANE(b, 1))),
+		vreinterpretq_u64_p128(vmull_p64(LANE(a, 1), LANE(b, 0))));
+	*lo = veorq_u64(*lo, vreinterpretq_u64_u8(vextq_u8(z, vreinterpretq_u8_u64(m), 8)));
+	*hi = veorq_u64(*hi, vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(m), z, 8)));
+}
+
+AESCE static inline uint64x2_t
+reduce(uint64x2_t lo64, uint64x2_t hi64)
+{
+	uint32x4_t lo, hi, a, b, c;
+	uint8x16_t z;
+
+	z = vdupq_n_u8(0);
+	lo = vreinterpretq_u32_u64(lo64);
+	hi = vreinterpretq_u32_u64(hi64);
+	a = vshrq_n_u32(lo, 31);
+	b = vshrq_n_u32(hi, 31);
+	lo = vshlq_n_u32(lo, 1);
+	hi = vshlq_n_u32(hi, 1);
+	c = vreinterpretq_u32_u8(vextq_u8(vreinterpretq_u8_u32(a), z, 12));
+	b = vreinterpretq_u32_u8(vextq_u8(z, vreinterpretq_u8_u32(b), 12));
+	a = vreinterpretq_u32_u8(vextq_u8(z, vreinterpretq_u8_u32(a), 12));
+	lo = vorrq_u32(lo, a);
+	hi = vorrq_u32(vorrq_u32(hi, b), c);
+
+	a = veorq_u32(veorq_u32(vshlq_n_u32(lo, 31), vshlq_n_u32(lo, 30)), vshlq_n_u32(lo, 25));
+	b = vreinterpretq_u32_u8(vextq_u8(vreinterpretq_u8_u32(a), z, 4));
+	lo = veorq_u32(lo, vreinterpretq_u32_u8(vextq_u8(z, vreinterpretq_u8_u32(a), 4)));
+	a = veorq_u32(veorq_u32(vshrq_n_u32(lo, 1), vshrq_n_u32(lo, 2)), vshrq_n_u32(lo, 7));
+	lo = veorq_u32(lo, veorq_u32(a, b));
+	return vreinterpretq_u64_u32(veorq_u32(hi, lo));
+}
+
+#define LOADR(p)	vreinterpretq_u64_u8(rev128(vld1q_u8(p)))
+#define STORER(p, x)	vst1q_u8(p, rev128(vreinterpretq_u8_u64(x)))
+
+AESCE static void
+ghashinit(uchar h[16], uchar *tab)
+{
+	uint64x2_t H, p, lo, hi;
+	int i;
+
+	H = p = LOADR(h);
+	vst1q_u8(tab, vreinterpretq_u8_u64(p));
+	for(i = 1; i < Nwide; i++){
+		lo = hi = vdupq_n_u64(0);
+		clmul(p, H, &lo, &hi);
+		p = reduce(lo, hi);
+		vst1q_u8(tab+16*i, vreinterpretq_u8_u64(p));
+	}
+}
+
+AESCE static void
+ghash(uchar *tab, uchar y[16], uchar *p, ulong n)
+{
+	uint64x2_t Y, lo, hi, h[Nwide];
+	int j;
+
+#pragma GCC unroll 8
+	for(j = 0; j < Nwide; j++)
+		h[j] = vreinterpretq_u64_u8(vld1q_u8(tab+16*j));
+	Y = LOADR(y);
+	for(; n >= Nwide*16; n -= Nwide*16, p += Nwide*16){
+		lo = hi = vdupq_n_u64(0);
+		Y = veorq_u64(Y, LOADR(p));
+		clmul(Y, h[Nwide-1], &lo, &hi);
+#pragma GCC unroll 8
+		for(j = 1; j < Nwide; j++)
+			clmul(LOADR(p+16*j), h[Nwide-1-j], &lo, &hi);
+		Y = reduce(lo, hi);
+	}
+	for(; n >= 16; n -= 16, p += 16){
+		lo = hi = vdupq_n_u64(0);
+		Y = veorq_u64(Y, LOADR(p));
+		clmul(Y, h[0], &lo, &hi);
+		Y = reduce(lo, hi);
+	}
+	STORER(y, Y);
+}
+
+#undef LANE
+#undef LOADR
+#undef STORER
+
+static int
+hasclmul(void)
+{
+#if defined(__linux__) && defined(HWCAP_PMULL)
+	return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#elif defined(__APPLE__)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static int
+hasaes(void)
+{
+#if defined(__linux__) && defined(HWCAP_AES)
+	return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__APPLE__)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+#endif	/* AESARM */
+
 void*
 aesni_init(void)
 {
-	return 0;
+#if defined(AESX86) || defined(AESARM)
+	if(hasclmul()){
+		aes_ghashinit = ghashinit;
+		aes_ghash = ghash;
+	}
+	if(!hasaes())
+		return nil;
+	aes_encrypt = encblk;
+	aes_decrypt = decblk;
+	aes_cbcencrypt = cbcenc;
+	aes_cbcdecrypt = cbcdec;
+	aes_ctr32 = ctr32;
+	return setup;
+#else
+	return nil;
+#endif
 }
@@ -12,6 +12,8 @@ and including the changes to block number and nonce defined in RFC7539
 
 /* from chachablock.$O */
 extern void _chachablock(u32int x[16], int rounds);
+/* from chachasimd.$O */
+extern ulong _chachaxor(u32int input[16], int rounds, uchar *src, uchar *dst, ulong nblk);
 
 /* little-endian data order */
 #define	GET4(p)		((p)[0]|((p)[1]<<8)|((p)[2]<<16)|((p)[3]<<24))
@@ -192,7 +194,19 @@ void
 chacha_encrypt2(uchar *src, uchar *dst, ulong bytes, Chachastate *s)
 {
 	uchar tmp[ChachaBsize];
-
+	ulong n;
+
+	/* whole blocks short of the low counter word wrapping */
+	n = bytes/ChachaBsize;
+	if(n > ~s->input[12])
+		n = ~s->input[12];
+	if(n > 0){
+		n = _chachaxor(s->input, s->rounds, src, dst, n);
+		s->input[12] += n;
+		src += n*ChachaBsize;
+		dst += n*ChachaBsize;
+		bytes -= n*ChachaBsize;
+	}
 	for(; bytes >= ChachaBsize; bytes -= ChachaBsize){
 		encryptblock(s, src, dst);
 		src += ChachaBsize;
@@ -0,0 +1,233 @@
+/*
+ * ChaCha key stream for several blocks at once:
+ * four with SSE2 or NEON, eight with AVX2 when cpuid
+ * says so.  Vector x[i] holds word i of every block,
+ * so the rounds are _chachablock's, lane by lane; the
+ * blocks are transposed back only to be xored out.
+ * chacha.c does whatever is left over with the scalar
+ * code, which stays the reference.
+ *
+ * The NEON code has yet to be run on an arm64 cpu and is
+ * only compiled with -DARM64SIMD.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SIMDX86
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(ARM64SIMD)
+#include <arm_neon.h>
+#define SIMDNEON
+#endif
+
+#include "os.h"
+
+#define QUARTERROUND(a, b, c, d) \
+	a = ADD(a, b); d = ROT16(XOR(d, a)); \
+	c = ADD(c, d); b = ROT(XOR(b, c), 12); \
+	a = ADD(a, b); d = ROT8(XOR(d, a)); \
+	c = ADD(c, d); b = ROT(XOR(b, c), 7);
+
+#define ROUNDS(x, rounds) \
+	for(i = rounds; i > 0; i -= 2){ \
+		QUARTERROUND(x[0], x[4], x[8], x[12]) \
+		QUARTERROUND(x[1], x[5], x[9], x[13]) \
+		QUARTERROUND(x[2], x[6], x[10], x[14]) \
+		QUARTERROUND(x[3], x[7], x[11], x[15]) \
+		QUARTERROUND(x[0], x[5], x[10], x[15]) \
+		QUARTERROUND(x[1], x[6], x[11], x[12]) \
+		QUARTERROUND(x[2], x[7], x[8], x[13]) \
+		QUARTERROUND(x[3], x[4], x[9], x[14]) \
+	}
+
+#ifdef SIMDX86
+
+#define ADD	_mm_add_epi32
+#define XOR	_mm_xor_si128
+#define ROT(v, c)	_mm_or_si128(_mm_slli_epi32(v, c), _mm_srli_epi32(v, 32-(c)))
+#define ROT16(v)	ROT(v, 16)
+#define ROT8(v)	ROT(v, 8)
+
+/* blocks ctr to ctr+3 */
+static void
+chacha4(u32int *input, u32int ctr, int rounds, uchar *src, uchar *dst)
+{
+	__m128i x[16], c, t0, t1, t2, t3;
+	int i, j;
+
+	c = _mm_add_epi32(_mm_set1_epi32(ctr), _mm_setr_epi32(0, 1, 2, 3));
+	for(i = 0; i < 16; i++)
+		x[i] = _mm_set1_epi32(input[i]);
+	x[12] = c;
+	ROUNDS(x, rounds)
+	for(i = 0; i < 16; i++)
+		if(i != 12)
+			x[i] = _mm_add_epi32(x[i], _mm_set1_epi32(input[i]));
+	x[12] = _mm_add_epi32(x[12], c);
+
+	for(i = 0; i < 16; i += 4){
+		t0 = _mm_unpacklo_epi32(x[i], x[i+1]);
+		t1 = _mm_unpacklo_epi32(x[i+2], x[i+3]);
+		t2 = _mm_unpackhi_epi32(x[i], x[i+1]);
+		t3 = _mm_unpackhi_epi32(x[i+2], x[i+3]);
+		x[i] = _mm_unpacklo_epi64(t0, t1);
+		x[i+1] = _mm_unpackhi_epi64(t0, t1);
+		x[i+2] = _mm_unpacklo_epi64(t2, t3);
+		x[i+3] = _mm_unpackhi_epi64(t2, t3);
+	}
+	for(j = 0; j < 4; j++)
+		for(i = 0; i < 4; i++)
+			_mm_storeu_si128((__m128i*)(dst+64*j+16*i),
+				_mm_xor_si128(x[4*i+j], _mm_loadu_si128((__m128i*)(src+64*j+16*i))));
+}
+
+#undef ADD
+#undef XOR
+#undef ROT
+#undef ROT16
+#undef ROT8
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define ADD	_mm256_add_epi32
+#define XOR	_mm256_xor_si256
+#define ROT(v, c)	_mm256_or_si256(_mm256_slli_epi32(v, c), _mm256_srli_epi32(v, 32-(c)))
+#define ROT16(v)	_mm256_shuffle_epi8(v, r16)
+#define ROT8(v)	_mm256_shuffle_epi8(v, r8)
+
+/*
+ * Blocks ctr to ctr+7.  After the 4×4 transposes each
+ * vector has a block in its low half and the block four
+ * on in its high half.
+ */
+AVX2 static void
+chacha8(u32int *input, u32int ctr, int rounds, uchar *src, uchar *dst)
+{
+	__m256i x[16], c, r16, r8, t0, t1, t2, t3;
+	__m128i lo, hi;
+	int i, j;
+
+	r16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+		2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	r8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+		3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+	c = _mm256_add_epi32(_mm256_set1_epi32(ctr), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	for(i = 0; i < 16; i++)
+		x[i] = _mm256_set1_epi32(input[i]);
+	x[12] = c;
+	ROUNDS(x, rounds)
+	for(i = 0; i < 16; i++)
+		if(i != 12)
+			x[i] = _mm256_add_epi32(x[i], _mm256_set1_epi32(input[i]));
+	x[12] = _mm256_add_epi32(x[12], c);
+
+	for(i = 0; i < 16; i += 4){
+		t0 = _mm256_unpacklo_epi32(x[i], x[i+1]);
+		t1 = _mm256_unpacklo_epi32(x[i+2], x[i+3]);
+		t2 = _mm256_unpackhi_epi32(x[i], x[i+1]);
+		t3 = _mm256_unpackhi_epi32(x[i+2], x[i+3]);
+		x[i] = _mm256_unpacklo_epi64(t0, t1);
+		x[i+1] = _mm256_unpackhi_epi64(t0, t1);
+		x[i+2] = _mm256_unpacklo_epi64(t2, t3);
+		x[i+3] = _mm256_unpackhi_epi64(t2, t3);
+	}
+	for(j = 0; j < 4; j++)
+		for(i = 0; i < 4; i++){
+			lo = _mm256_castsi256_si128(x[4*i+j]);
+			hi = _mm256_extracti128_si256(x[4*i+j], 1);
+			_mm_storeu_si128((__m128i*)(dst+64*j+16*i),
+				_mm_xor_si128(lo, _mm_loadu_si128((__m128i*)(src+64*j+16*i))));
+			_mm_storeu_si128((__m128i*)(dst+64*(j+4)+16*i),
+				_mm_xor_si128(hi, _mm_loadu_si128((__m128i*)(src+64*(j+4)+16*i))));
+		}
+}
+
+#undef ADD
+#undef XOR
+#undef ROT
+#undef ROT16
+#undef ROT8
+
+#endif	/* SIMDX86 */
+
+#ifdef SIMDNEON
+
+#define ADD	vaddq_u32
+#define XOR	veorq_u32
+#define ROT(v, c)	vsriq_n_u32(vshlq_n_u32(v, c), v, 32-(c))
+#define ROT16(v)	vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(v)))
+#define ROT8(v)	ROT(v, 8)
+
+static void
+chacha4(u32int *input, u32int ctr, int rounds, uchar *src, uchar *dst)
+{
+	static const u32int lanes[4] = {0, 1, 2, 3};
+	uint32x4_t x[16], c, t0, t1, t2, t3;
+	int i, j;
+
+	c = vaddq_u32(vdupq_n_u32(ctr), vld1q_u32(lanes));
+	for(i = 0; i < 16; i++)
+		x[i] = vdupq_n_u32(input[i]);
+	x[12] = c;
+	ROUNDS(x, rounds)
+	for(i = 0; i < 16; i++)
+		if(i != 12)
+			x[i] = vaddq_u32(x[i], vdupq_n_u32(input[i]));
+	x[12] = vaddq_u32(x[12], c);
+
+	for(i = 0; i < 16; i += 4){
+		t0 = vtrn1q_u32(x[i], x[i+1]);
+		t1 = vtrn2q_u32(x[i], x[i+1]);
+		t2 = vtrn1q_u32(x[i+2], x[i+3]);
+		t3 = vtrn2q_u32(x[i+2], x[i+3]);
+		x[i] = vreinterpretq_u32_u64(vtrn1q_u64(vreinterpretq_u64_u32(t0), vreinterpretq_u64_u32(t2)));
+		x[i+1] = vreinterpretq_u32_u64(vtrn1q_u64(vreinterpretq_u64_u32(t1), vreinterpretq_u64_u32(t3)));
+		x[i+2] = vreinterpretq_u32_u64(vtrn2q_u64(vreinterpretq_u64_u32(t0), vreinterpretq_u64_u32(t2)));
+		x[i+3] = vreinterpretq_u32_u64(vtrn2q_u64(vreinterpretq_u64_u32(t1), vreinterpretq_u64_u32(t3)));
+	}
+	for(j = 0; j < 4; j++)
+		for(i = 0; i < 4; i++)
+			vst1q_u8(dst+64*j+16*i, veorq_u8(vreinterpretq_u8_u32(x[4*i+j]), vld1q_u8(src+64*j+16*i)));
+}
+
+#undef ADD
+#undef XOR
+#undef ROT
+#undef ROT16
+#undef ROT8
+
+#endif	/* SIMDNEON */
+
+/*
+ * Xor the key stream of up to nblk blocks, starting at
+ * input's block counter, into src and store it at dst.
+ * The caller keeps the low counter word from wrapping.
+ * Returns the number of blocks done.
+ */
+ulong
+_chachaxor(u32int input[16], int rounds, uchar *src, uchar *dst, ulong nblk)
+{
+	ulong n;
+
+	n = 0;
+#ifdef SIMDX86
+	{
+		static int avx2 = -1;
+
+		if(avx2 < 0)
+			avx2 = __builtin_cpu_supports("avx2") != 0;
+		if(avx2)
+			for(; nblk-n >= 8; n += 8)
+				chacha8(input, input[12]+n, rounds, src+64*n, dst+64*n);
+	}
+#endif
+#if defined(SIMDX86) || defined(SIMDNEON)
+	for(; nblk-n >= 4; n += 4)
+		chacha4(input, input[12]+n, rounds, src+64*n, dst+64*n);
+#else
+	USED(input);
+	USED(rounds);
+	USED(src);
+	USED(dst);
+	USED(nblk);
+#endif
+	return n;
+}
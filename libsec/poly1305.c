@@ -2,73 +2,187 @@
 #include <libsec.h>
 
 /*
-	poly1305 implementation using 32 bit * 32 bit = 64 bit multiplication and 64 bit addition
+	poly1305 implementation using 64 bit * 64 bit = 128 bit multiplication
+	where the compiler has it, otherwise 32 bit * 32 bit = 64 bit multiplication
+	and 64 bit addition
 
 	derived from http://github.com/floodberry/poly1305-donna
 */
 
 #define U8TO32(p)	((u32int)(p)[0] | (u32int)(p)[1]<<8 | (u32int)(p)[2]<<16 | (u32int)(p)[3]<<24)
 #define U32TO8(p, v)	(p)[0]=(v), (p)[1]=(v)>>8, (p)[2]=(v)>>16, (p)[3]=(v)>>24
+#define U8TO64(p)	((u64int)U8TO32(p) | (u64int)U8TO32((p)+4)<<32)
+#define U64TO8(p, v)	U32TO8((p), (u32int)(v)), U32TO8((p)+4, (u32int)((v)>>32))
 
-/* (r,s) = (key[0:15],key[16:31]), the one time key */
-DigestState*
-poly1305(uchar *m, ulong len, uchar *key, ulong klen, uchar *digest, DigestState *s)
+#ifdef __SIZEOF_INT128__
+
+typedef unsigned __int128 u128int;
+
+/* from poly1305simd.$O */
+extern ulong _poly1305blocks(u64int r[3], u64int h[3], uchar *m, ulong nblk);
+
+/*
+ * 44, 44 and 42 bit limbs: bstate[0-2] is r,
+ * bstate[3-5] is h and bstate[6-7] is the pad.
+ */
+static void
+poly1305key(DigestState *s, uchar *key)
 {
-	u32int r0,r1,r2,r3,r4, s1,s2,s3,s4, h0,h1,h2,h3,h4, g0,g1,g2,g3,g4;
-	u64int d0,d1,d2,d3,d4, f;
-	u32int hibit, mask, c;
+	u64int t0, t1;
 
-	if(s == nil){
-		s = malloc(sizeof(*s));
-		if(s == nil)
-			return nil;
-		memset(s, 0, sizeof(*s));
-		s->malloced = 1;
-	}
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	t0 = U8TO64(&key[0]);
+	t1 = U8TO64(&key[8]);
+	s->bstate[0] = t0 & 0xffc0fffffffULL;
+	s->bstate[1] = (t0 >> 44 | t1 << 20) & 0xfffffc0ffffULL;
+	s->bstate[2] = (t1 >> 24) & 0x00ffffffc0fULL;
 
-	if(s->seeded == 0){
-		assert(klen == 32);
+	/* h = 0 */
+	s->bstate[3] = 0;
+	s->bstate[4] = 0;
+	s->bstate[5] = 0;
 
-		/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
-		s->state[0] = (U8TO32(&key[ 0])     ) & 0x3ffffff;
-		s->state[1] = (U8TO32(&key[ 3]) >> 2) & 0x3ffff03;
-		s->state[2] = (U8TO32(&key[ 6]) >> 4) & 0x3ffc0ff;
-		s->state[3] = (U8TO32(&key[ 9]) >> 6) & 0x3f03fff;
-		s->state[4] = (U8TO32(&key[12]) >> 8) & 0x00fffff;
-
-		/* h = 0 */
-		s->state[5] = 0;
-		s->state[6] = 0;
-		s->state[7] = 0;
-		s->state[8] = 0;
-		s->state[9] = 0;
-
-		/* save pad for later */
-		s->state[10] = U8TO32(&key[16]);
-		s->state[11] = U8TO32(&key[20]);
-		s->state[12] = U8TO32(&key[24]);
-		s->state[13] = U8TO32(&key[28]);
+	/* save pad for later */
+	s->bstate[6] = U8TO64(&key[16]);
+	s->bstate[7] = U8TO64(&key[24]);
+}
 
-		s->seeded = 1;
+static void
+poly1305blocks(DigestState *s, uchar *m, ulong len, int final)
+{
+	u64int r0,r1,r2, s1,s2, h0,h1,h2, t0,t1, c, hibit;
+	u128int d0,d1,d2;
+	ulong n;
+
+	if(!final){
+		n = _poly1305blocks(&s->bstate[0], &s->bstate[3], m, len/16);
+		len -= n*16, m += n*16;
 	}
 
-	if(s->blen){
-		c = 16 - s->blen;
-		if(c > len)
-			c = len;
-		memmove(s->buf + s->blen, m, c);
-		len -= c, m += c;
-		s->blen += c;
-		if(s->blen == 16){
-			s->blen = 0;
-			poly1305(s->buf, 16, key, klen, nil, s);
-		} else if(len == 0){
-			m = s->buf;
-			len = s->blen;
-			s->blen = 0;
-		}
+	r0 = s->bstate[0];
+	r1 = s->bstate[1];
+	r2 = s->bstate[2];
+
+	h0 = s->bstate[3];
+	h1 = s->bstate[4];
+	h2 = s->bstate[5];
+
+	s1 = r1 * (5 << 2);
+	s2 = r2 * (5 << 2);
+
+	hibit = final ? 0 : 1ULL<<40;	/* 1<<128 */
+
+	while(len >= 16){
+		/* h += m[i] */
+		t0 = U8TO64(&m[0]);
+		t1 = U8TO64(&m[8]);
+		h0 += t0 & 0xfffffffffffULL;
+		h1 += (t0 >> 44 | t1 << 20) & 0xfffffffffffULL;
+		h2 += (t1 >> 24) & 0x3ffffffffffULL | hibit;
+
+		/* h *= r */
+		d0 = (u128int)h0*r0 + (u128int)h1*s2 + (u128int)h2*s1;
+		d1 = (u128int)h0*r1 + (u128int)h1*r0 + (u128int)h2*s2;
+		d2 = (u128int)h0*r2 + (u128int)h1*r1 + (u128int)h2*r0;
+
+		/* (partial) h %= p */
+		             c = (u64int)(d0 >> 44); h0 = (u64int)d0 & 0xfffffffffffULL;
+		d1 += c;     c = (u64int)(d1 >> 44); h1 = (u64int)d1 & 0xfffffffffffULL;
+		d2 += c;     c = (u64int)(d2 >> 42); h2 = (u64int)d2 & 0x3ffffffffffULL;
+		h0 += c * 5; c = h0 >> 44; h0 = h0 & 0xfffffffffffULL;
+		h1 += c;
+
+		len -= 16, m += 16;
 	}
 
+	s->bstate[3] = h0;
+	s->bstate[4] = h1;
+	s->bstate[5] = h2;
+}
+
+static void
+poly1305finish(DigestState *s, uchar *digest)
+{
+	u64int h0,h1,h2, g0,g1,g2, t0,t1, c, mask;
+
+	h0 = s->bstate[3];
+	h1 = s->bstate[4];
+	h2 = s->bstate[5];
+
+	             c = h1 >> 44; h1 &= 0xfffffffffffULL;
+	h2 +=     c; c = h2 >> 42; h2 &= 0x3ffffffffffULL;
+	h0 += c * 5; c = h0 >> 44; h0 &= 0xfffffffffffULL;
+	h1 +=     c; c = h1 >> 44; h1 &= 0xfffffffffffULL;
+	h2 +=     c; c = h2 >> 42; h2 &= 0x3ffffffffffULL;
+	h0 += c * 5; c = h0 >> 44; h0 &= 0xfffffffffffULL;
+	h1 +=     c;
+
+	/* compute h + -p */
+	g0 = h0 + 5; c = g0 >> 44; g0 &= 0xfffffffffffULL;
+	g1 = h1 + c; c = g1 >> 44; g1 &= 0xfffffffffffULL;
+	g2 = h2 + c - (1ULL << 42);
+
+	/* select h if h < p, or h + -p if h >= p */
+	mask = (g2 >> 63) - 1;
+	g0 &= mask;
+	g1 &= mask;
+	g2 &= mask;
+	mask = ~mask;
+	h0 = (h0 & mask) | g0;
+	h1 = (h1 & mask) | g1;
+	h2 = (h2 & mask) | g2;
+
+	/* digest = (h + pad) % (2^128) */
+	t0 = s->bstate[6];
+	t1 = s->bstate[7];
+	h0 += t0 & 0xfffffffffffULL;
+	c = h0 >> 44; h0 &= 0xfffffffffffULL;
+	h1 += ((t0 >> 44 | t1 << 20) & 0xfffffffffffULL) + c;
+	c = h1 >> 44; h1 &= 0xfffffffffffULL;
+	h2 += ((t1 >> 24) & 0x3ffffffffffULL) + c;
+	h2 &= 0x3ffffffffffULL;
+
+	/* h = h % (2^128) */
+	h0 = h0 | h1 << 44;
+	h1 = h1 >> 20 | h2 << 24;
+
+	U64TO8(&digest[0], h0);
+	U64TO8(&digest[8], h1);
+}
+
+#else
+
+static void
+poly1305key(DigestState *s, uchar *key)
+{
+	/* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+	s->state[0] = (U8TO32(&key[ 0])     ) & 0x3ffffff;
+	s->state[1] = (U8TO32(&key[ 3]) >> 2) & 0x3ffff03;
+	s->state[2] = (U8TO32(&key[ 6]) >> 4) & 0x3ffc0ff;
+	s->state[3] = (U8TO32(&key[ 9]) >> 6) & 0x3f03fff;
+	s->state[4] = (U8TO32(&key[12]) >> 8) & 0x00fffff;
+
+	/* h = 0 */
+	s->state[5] = 0;
+	s->state[6] = 0;
+	s->state[7] = 0;
+	s->state[8] = 0;
+	s->state[9] = 0;
+
+	/* save pad for later */
+	s->state[10] = U8TO32(&key[16]);
+	s->state[11] = U8TO32(&key[20]);
+	s->state[12] = U8TO32(&key[24]);
+	s->state[13] = U8TO32(&key[28]);
+}
+
+static void
+poly1305blocks(DigestState *s, uchar *m, ulong len, int final)
+{
+	u32int r0,r1,r2,r3,r4, s1,s2,s3,s4, h0,h1,h2,h3,h4;
+	u64int d0,d1,d2,d3,d4;
+	u32int hibit, c;
+
 	r0 = s->state[0];
 	r1 = s->state[1];
 	r2 = s->state[2];
@@ -86,10 +200,9 @@ poly1305(uchar *m, ulong len, uchar *key, ulong klen, uchar *digest, DigestState
 	s3 = r3 * 5;
 	s4 = r4 * 5;
 
-	hibit = 1<<24;	/* 1<<128 */
+	hibit = final ? 0 : 1<<24;	/* 1<<128 */
 
 	while(len >= 16){
-Block:
 		/* h += m[i] */
 		h0 += (U8TO32(&m[0])     ) & 0x3ffffff;
 		h1 += (U8TO32(&m[3]) >> 2) & 0x3ffffff;
@@ -116,28 +229,25 @@ Block:
 		len -= 16, m += 16;
 	}
 
-	if(len){
-		s->blen = len;
-		memmove(s->buf, m, len);
-	}
+	s->state[5] = h0;
+	s->state[6] = h1;
+	s->state[7] = h2;
+	s->state[8] = h3;
+	s->state[9] = h4;
+}
 
-	if(digest == nil){
-		s->state[5] = h0;
-		s->state[6] = h1;
-		s->state[7] = h2;
-		s->state[8] = h3;
-		s->state[9] = h4;
-		return s;
-	}
+static void
+poly1305finish(DigestState *s, uchar *digest)
+{
+	u32int h0,h1,h2,h3,h4, g0,g1,g2,g3,g4;
+	u64int f;
+	u32int mask, c;
 
-	if(len){
-		m = s->buf;
-		m[len++] = 1;
-		while(len < 16)
-			m[len++] = 0;
-		hibit = 0;
-		goto Block;
-	}
+	h0 = s->state[5];
+	h1 = s->state[6];
+	h2 = s->state[7];
+	h3 = s->state[8];
+	h4 = s->state[9];
 
 	             c = h1 >> 26; h1 = h1 & 0x3ffffff;
 	h2 +=     c; c = h2 >> 26; h2 = h2 & 0x3ffffff;
@@ -183,6 +293,66 @@ Block:
 	U32TO8(&digest[4], h1);
 	U32TO8(&digest[8], h2);
 	U32TO8(&digest[12], h3);
+}
+
+#endif
+
+/* (r,s) = (key[0:15],key[16:31]), the one time key */
+DigestState*
+poly1305(uchar *m, ulong len, uchar *key, ulong klen, uchar *digest, DigestState *s)
+{
+	ulong c;
+
+	if(s == nil){
+		s = malloc(sizeof(*s));
+		if(s == nil)
+			return nil;
+		memset(s, 0, sizeof(*s));
+		s->malloced = 1;
+	}
+
+	if(s->seeded == 0){
+		assert(klen == 32);
+		poly1305key(s, key);
+		s->seeded = 1;
+	}
+
+	if(s->blen){
+		c = 16 - s->blen;
+		if(c > len)
+			c = len;
+		memmove(s->buf + s->blen, m, c);
+		len -= c, m += c;
+		s->blen += c;
+		if(s->blen == 16){
+			s->blen = 0;
+			poly1305blocks(s, s->buf, 16, 0);
+		}
+	}
+
+	if(len >= 16){
+		c = len & ~15;
+		poly1305blocks(s, m, c, 0);
+		len -= c, m += c;
+	}
+
+	if(len){
+		s->blen = len;
+		memmove(s->buf, m, len);
+	}
+
+	if(digest == nil)
+		return s;
+
+	if(s->blen){
+		m = s->buf;
+		len = s->blen;
+		m[len++] = 1;
+		while(len < 16)
+			m[len++] = 0;
+		poly1305blocks(s, m, 16, 1);
+	}
+	poly1305finish(s, digest);
 
 	if(s->malloced){
 		memset(s, 0, sizeof(*s));
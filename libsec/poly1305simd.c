@@ -0,0 +1,196 @@
+/*
+ * Poly1305 four blocks at a time with AVX2.
+ * Lane j of the accumulator takes blocks j, j+4, ...
+ * and is multiplied by r⁴ after each, except after the
+ * last, when lane j is multiplied by r^(4-j) and the
+ * lanes are added.  The vectors hold 26 bit limbs in
+ * 64 bit lanes; poly1305.c's 44 bit limbs are converted
+ * on the way in and out.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SIMDX86
+#endif
+
+#include "os.h"
+
+#ifdef SIMDX86
+
+#define AVX2 __attribute__((target("avx2")))
+
+enum {
+	M26 = 0x3ffffff,
+};
+
+/* h = a*b, partially reduced */
+static void
+mul26(u32int h[5], u32int a[5], u32int b[5])
+{
+	u64int d[5], c;
+	u32int s[5];
+	int i, j;
+
+	for(i = 1; i < 5; i++)
+		s[i] = b[i] * 5;
+	for(i = 0; i < 5; i++){
+		d[i] = 0;
+		for(j = 0; j < 5; j++)
+			d[i] += (u64int)a[j] * (j <= i ? b[i-j] : s[5+i-j]);
+	}
+	c = 0;
+	for(i = 0; i < 5; i++){
+		d[i] += c;
+		c = d[i] >> 26;
+		h[i] = d[i] & M26;
+	}
+	h[0] += c * 5;
+	h[1] += h[0] >> 26;
+	h[0] &= M26;
+}
+
+/* the message limbs of blocks m to m+3, with 1<<128 added */
+#define LOAD(m) \
+	a = _mm256_loadu_si256((__m256i*)(m)); \
+	b = _mm256_loadu_si256((__m256i*)((m)+32)); \
+	lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xd8); \
+	hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xd8); \
+	h0 = _mm256_add_epi64(h0, _mm256_and_si256(lo, mask)); \
+	h1 = _mm256_add_epi64(h1, _mm256_and_si256(_mm256_srli_epi64(lo, 26), mask)); \
+	h2 = _mm256_add_epi64(h2, _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(lo, 52), _mm256_slli_epi64(hi, 12)), mask)); \
+	h3 = _mm256_add_epi64(h3, _mm256_and_si256(_mm256_srli_epi64(hi, 14), mask)); \
+	h4 = _mm256_add_epi64(h4, _mm256_or_si256(_mm256_srli_epi64(hi, 40), hibit));
+
+#define MUL(a, b)	_mm256_mul_epu32(a, b)
+#define ADD(a, b)	_mm256_add_epi64(a, b)
+
+/* h *= r, (partial) h %= p */
+#define MULR(r0, r1, r2, r3, r4, s1, s2, s3, s4) \
+	d0 = ADD(ADD(ADD(ADD(MUL(h0, r0), MUL(h1, s4)), MUL(h2, s3)), MUL(h3, s2)), MUL(h4, s1)); \
+	d1 = ADD(ADD(ADD(ADD(MUL(h0, r1), MUL(h1, r0)), MUL(h2, s4)), MUL(h3, s3)), MUL(h4, s2)); \
+	d2 = ADD(ADD(ADD(ADD(MUL(h0, r2), MUL(h1, r1)), MUL(h2, r0)), MUL(h3, s4)), MUL(h4, s3)); \
+	d3 = ADD(ADD(ADD(ADD(MUL(h0, r3), MUL(h1, r2)), MUL(h2, r1)), MUL(h3, r0)), MUL(h4, s4)); \
+	d4 = ADD(ADD(ADD(ADD(MUL(h0, r4), MUL(h1, r3)), MUL(h2, r2)), MUL(h3, r1)), MUL(h4, r0)); \
+	c = _mm256_srli_epi64(d0, 26); h0 = _mm256_and_si256(d0, mask); \
+	d1 = ADD(d1, c); c = _mm256_srli_epi64(d1, 26); h1 = _mm256_and_si256(d1, mask); \
+	d2 = ADD(d2, c); c = _mm256_srli_epi64(d2, 26); h2 = _mm256_and_si256(d2, mask); \
+	d3 = ADD(d3, c); c = _mm256_srli_epi64(d3, 26); h3 = _mm256_and_si256(d3, mask); \
+	d4 = ADD(d4, c); c = _mm256_srli_epi64(d4, 26); h4 = _mm256_and_si256(d4, mask); \
+	h0 = ADD(h0, ADD(c, _mm256_slli_epi64(c, 2))); \
+	c = _mm256_srli_epi64(h0, 26); h0 = _mm256_and_si256(h0, mask); \
+	h1 = ADD(h1, c);
+
+/* nblk is a multiple of 4 */
+AVX2 static void
+blocks4(u32int h[5], u32int r[5], uchar *m, ulong nblk)
+{
+	__m256i h0, h1, h2, h3, h4, d0, d1, d2, d3, d4, a, b, c, lo, hi, mask, hibit;
+	__m256i r0, r1, r2, r3, r4, s1, s2, s3, s4;
+	u32int r2p[5], r3p[5], r4p[5];
+	u64int v[5][4], t;
+	int i;
+
+	mul26(r2p, r, r);
+	mul26(r3p, r2p, r);
+	mul26(r4p, r2p, r2p);
+
+	mask = _mm256_set1_epi64x(M26);
+	hibit = _mm256_set1_epi64x(1<<24);
+	h0 = _mm256_setr_epi64x(h[0], 0, 0, 0);
+	h1 = _mm256_setr_epi64x(h[1], 0, 0, 0);
+	h2 = _mm256_setr_epi64x(h[2], 0, 0, 0);
+	h3 = _mm256_setr_epi64x(h[3], 0, 0, 0);
+	h4 = _mm256_setr_epi64x(h[4], 0, 0, 0);
+
+	r0 = _mm256_set1_epi64x(r4p[0]);
+	r1 = _mm256_set1_epi64x(r4p[1]);
+	r2 = _mm256_set1_epi64x(r4p[2]);
+	r3 = _mm256_set1_epi64x(r4p[3]);
+	r4 = _mm256_set1_epi64x(r4p[4]);
+	s1 = _mm256_set1_epi64x(r4p[1]*5);
+	s2 = _mm256_set1_epi64x(r4p[2]*5);
+	s3 = _mm256_set1_epi64x(r4p[3]*5);
+	s4 = _mm256_set1_epi64x(r4p[4]*5);
+	for(; nblk > 4; nblk -= 4, m += 64){
+		LOAD(m)
+		MULR(r0, r1, r2, r3, r4, s1, s2, s3, s4)
+	}
+
+#define RLANES(i)	_mm256_setr_epi64x(r4p[i], r3p[i], r2p[i], r[i])
+#define SLANES(i)	_mm256_setr_epi64x(r4p[i]*5, r3p[i]*5, r2p[i]*5, r[i]*5)
+	LOAD(m)
+	MULR(RLANES(0), RLANES(1), RLANES(2), RLANES(3), RLANES(4), SLANES(1), SLANES(2), SLANES(3), SLANES(4))
+
+	_mm256_storeu_si256((__m256i*)v[0], h0);
+	_mm256_storeu_si256((__m256i*)v[1], h1);
+	_mm256_storeu_si256((__m256i*)v[2], h2);
+	_mm256_storeu_si256((__m256i*)v[3], h3);
+	_mm256_storeu_si256((__m256i*)v[4], h4);
+	t = 0;
+	for(i = 0; i < 5; i++){
+		t += v[i][0] + v[i][1] + v[i][2] + v[i][3];
+		h[i] = t & M26;
+		t >>= 26;
+	}
+	t = h[0] + t*5;
+	for(i = 0; i < 4; i++){
+		h[i] = t & M26;
+		t = h[i+1] + (t >> 26);
+	}
+	h[4] = t;
+}
+
+#undef MUL
+#undef ADD
+
+static void
+to26(u32int d[5], u64int s[3])
+{
+	d[0] = s[0] & M26;
+	d[1] = (s[0] >> 26 | s[1] << 18) & M26;
+	d[2] = (s[1] >> 8) & M26;
+	d[3] = (s[1] >> 34 | s[2] << 10) & M26;
+	d[4] = s[2] >> 16;
+}
+
+/* s[0-3] < 2^26 */
+static void
+to44(u64int d[3], u32int s[5])
+{
+	d[0] = (s[0] | (u64int)s[1] << 26) & 0xfffffffffffULL;
+	d[1] = (s[1] >> 18 | (u64int)s[2] << 8 | (u64int)s[3] << 34) & 0xfffffffffffULL;
+	d[2] = s[3] >> 10 | (u64int)s[4] << 16;
+}
+
+#endif	/* SIMDX86 */
+
+/*
+ * Add nblk whole blocks at m to h, given in 44 bit limbs,
+ * if the vector code can.  Returns the number of blocks done.
+ */
+ulong
+_poly1305blocks(u64int r[3], u64int h[3], uchar *m, ulong nblk)
+{
+#ifdef SIMDX86
+	static int avx2 = -1;
+	u32int r26[5], h26[5];
+
+	if(avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2") != 0;
+	if(!avx2 || nblk < 16)
+		return 0;
+	nblk &= ~3;
+	h[2] += h[1] >> 44;
+	h[1] &= 0xfffffffffffULL;
+	to26(r26, r);
+	to26(h26, h);
+	blocks4(h26, r26, m, nblk);
+	to44(h, h26);
+	return nblk;
+#else
+	USED(r);
+	USED(h);
+	USED(m);
+	USED(nblk);
+	return 0;
+#endif
+}
@@ -0,0 +1,403 @@
+/*
+ * poly1305test - check poly1305 against RFC 8439 and libmp
+ *
+ *	poly1305test [-n trials]
+ *
+ * First the vectors of RFC 8439 §2.5.2 and appendix A.3,
+ * whole and a byte at a time.  Then random keys and
+ * messages of lengths around the block and vector sizes,
+ * each digested three ways and compared with h = (h+c)·r
+ * mod 2¹³⁰-5 done with libmp:
+ *
+ *	whole	one call, so runs of 16 blocks or more take
+ *		the AVX2 path where the processor has it
+ *	pieces	random pieces of under 256 bytes, which the
+ *		44 bit limb code does alone
+ *	split	random pieces of any length, so blocks are
+ *		carried in s->buf between the two
+ *
+ * Prints one line per failure and a summary; exits
+ * "fail" if anything failed.
+ */
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <u.h>
+#include <libc.h>
+#include <mp.h>
+#include <libsec.h>
+#include "args.h"
+
+#undef write
+#undef getpid
+
+char	*argv0;
+
+static ulong	seed = 1;
+static int	nfail;
+
+/*
+ * Normally supplied by the kernel.
+ */
+int
+print(char *fmt, ...)
+{
+	va_list arg;
+	int n;
+
+	va_start(arg, fmt);
+	n = vfprint(1, fmt, arg);
+	va_end(arg);
+	return n;
+}
+
+int
+iprint(char *fmt, ...)
+{
+	va_list arg;
+	int n;
+
+	va_start(arg, fmt);
+	n = vfprint(2, fmt, arg);
+	va_end(arg);
+	return n;
+}
+
+static char	errbuf[ERRMAX];
+
+void
+werrstr(char *fmt, ...)
+{
+	va_list arg;
+
+	va_start(arg, fmt);
+	vseprint(errbuf, errbuf+sizeof errbuf, fmt, arg);
+	va_end(arg);
+}
+
+int
+__errfmt(Fmt *f)
+{
+	return fmtstrcpy(f, errbuf);
+}
+
+int
+syswrite(int fd, void *buf, int n)
+{
+	return write(fd, buf, n);
+}
+
+vlong
+sysnsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (vlong)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+int
+sysgetpid(void)
+{
+	return getpid();
+}
+
+void
+osyield(void)
+{
+	sched_yield();
+}
+
+void
+osmsleep(int ms)
+{
+	usleep(ms*1000);
+}
+
+void
+setmalloctag(void *v, uintptr tag)
+{
+	USED(v);
+	USED(tag);
+}
+
+static ulong
+rnd(void)
+{
+	seed = seed*1103515245 + 12345;
+	return seed >> 8;
+}
+
+static void
+fill(uchar *p, ulong n)
+{
+	while(n-- > 0)
+		*p++ = rnd();
+}
+
+/* key, message and tag, in hex */
+static char *vectors[][3] = {
+	/* §2.5.2 */
+	"85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b",
+	"43727970746f6772617068696320466f72756d2052657365617263682047726f7570",
+	"a8061dc1305136c6c22b8baf0c0127a9",
+
+	/* A.3 #1 */
+	"0000000000000000000000000000000000000000000000000000000000000000",
+	"0000000000000000000000000000000000000000000000000000000000000000"
+	"0000000000000000000000000000000000000000000000000000000000000000",
+	"00000000000000000000000000000000",
+
+	/* A.3 #2 */
+	"0000000000000000000000000000000036e5f6b5c5e06070f0efca96227a863e",
+	"416e79207375626d697373696f6e20746f20746865204945544620696e74656e"
+	"6465642062792074686520436f6e7472696275746f7220666f72207075626c69"
+	"636174696f6e20617320616c6c206f722070617274206f6620616e2049455446"
+	"20496e7465726e65742d4472616674206f722052464320616e6420616e792073"
+	"746174656d656e74206d6164652077697468696e2074686520636f6e74657874"
+	"206f6620616e204945544620616374697669747920697320636f6e7369646572"
+	"656420616e20224945544620436f6e747269627574696f6e222e205375636820"
+	"73746174656d656e747320696e636c756465206f72616c2073746174656d656e"
+	"747320696e20494554462073657373696f6e732c2061732077656c6c20617320"
+	"7772697474656e20616e6420656c656374726f6e696320636f6d6d756e696361"
+	"74696f6e73206d61646520617420616e792074696d65206f7220706c6163652c"
+	"207768696368206172652061646472657373656420746f",
+	"36e5f6b5c5e06070f0efca96227a863e",
+
+	/* A.3 #3 */
+	"36e5f6b5c5e06070f0efca96227a863e00000000000000000000000000000000",
+	"416e79207375626d697373696f6e20746f20746865204945544620696e74656e"
+	"6465642062792074686520436f6e7472696275746f7220666f72207075626c69"
+	"636174696f6e20617320616c6c206f722070617274206f6620616e2049455446"
+	"20496e7465726e65742d4472616674206f722052464320616e6420616e792073"
+	"746174656d656e74206d6164652077697468696e2074686520636f6e74657874"
+	"206f6620616e204945544620616374697669747920697320636f6e7369646572"
+	"656420616e20224945544620436f6e747269627574696f6e222e205375636820"
+	"73746174656d656e747320696e636c756465206f72616c2073746174656d656e"
+	"747320696e20494554462073657373696f6e732c2061732077656c6c20617320"
+	"7772697474656e20616e6420656c656374726f6e696320636f6d6d756e696361"
+	"74696f6e73206d61646520617420616e792074696d65206f7220706c6163652c"
+	"207768696368206172652061646472657373656420746f",
+	"f3477e7cd95417af89a6b8794c310cf0",
+
+	/* A.3 #4 */
+	"1c9240a5eb55d38af333888604f6b5f0473917c1402b80099dca5cbc207075c0",
+	"2754776173206272696c6c69672c20616e642074686520736c6974687920746f"
+	"7665730a446964206779726520616e642067696d626c6520696e207468652077"
+	"6162653a0a416c6c206d696d737920776572652074686520626f726f676f7665"
+	"732c0a416e6420746865206d6f6d65207261746873206f757467726162652e",
+	"4541669a7eaaee61e708dc7cbcc5eb62",
+
+	/* A.3 #5: h reaches p */
+	"0200000000000000000000000000000000000000000000000000000000000000",
+	"ffffffffffffffffffffffffffffffff",
+	"03000000000000000000000000000000",
+
+	/* A.3 #6: h + s overflows 2¹²⁸ */
+	"02000000000000000000000000000000ffffffffffffffffffffffffffffffff",
+	"02000000000000000000000000000000",
+	"03000000000000000000000000000000",
+
+	/* A.3 #7: h ≥ 2¹³⁰ after the last block */
+	"0100000000000000000000000000000000000000000000000000000000000000",
+	"fffffffffffffffffffffffffffffffff0ffffffffffffffffffffffffffffff"
+	"11000000000000000000000000000000",
+	"05000000000000000000000000000000",
+
+	/* A.3 #8: h ≥ p after the last block */
+	"0100000000000000000000000000000000000000000000000000000000000000",
+	"fffffffffffffffffffffffffffffffffbfefefefefefefefefefefefefefefe"
+	"01010101010101010101010101010101",
+	"00000000000000000000000000000000",
+
+	/* A.3 #9: h = p-5 before the pad */
+	"0200000000000000000000000000000000000000000000000000000000000000",
+	"fdffffffffffffffffffffffffffffff",
+	"faffffffffffffffffffffffffffffff",
+
+	/* A.3 #10 and #11: carries out of the top limb */
+	"0100000000000000040000000000000000000000000000000000000000000000",
+	"e33594d7505e43b900000000000000003394d7505e4379cd0100000000000000"
+	"0000000000000000000000000000000001000000000000000000000000000000",
+	"14000000000000005500000000000000",
+
+	"0100000000000000040000000000000000000000000000000000000000000000",
+	"e33594d7505e43b900000000000000003394d7505e4379cd0100000000000000"
+	"00000000000000000000000000000000",
+	"13000000000000000000000000000000",
+};
+
+static int
+unhex(uchar *d, char *s)
+{
+	int n;
+
+	n = dec16(d, strlen(s)/2, s, strlen(s));
+	if(n < 0)
+		sysfatal("bad hex %s", s);
+	return n;
+}
+
+static void
+check(char *what, int i, ulong len, uchar *got, uchar *want)
+{
+	if(memcmp(got, want, 16) == 0)
+		return;
+	print("FAIL %s %d len %lud: got %.*H want %.*H\n", what, i, len, 16, got, 16, want);
+	nfail++;
+}
+
+static void
+vectortest(void)
+{
+	uchar key[32], msg[512], tag[16], d[16];
+	DigestState s;
+	int i, j, n;
+
+	for(i = 0; i < nelem(vectors); i++){
+		unhex(key, vectors[i][0]);
+		n = unhex(msg, vectors[i][1]);
+		unhex(tag, vectors[i][2]);
+		poly1305(msg, n, key, 32, d, nil);
+		check("vector", i, n, d, tag);
+
+		memset(&s, 0, sizeof s);
+		for(j = 0; j < n; j++)
+			poly1305(msg+j, 1, key, 32, nil, &s);
+		poly1305(nil, 0, key, 32, d, &s);
+		check("vector bytes", i, n, d, tag);
+	}
+	print("%d vectors\n", nelem(vectors));
+}
+
+/* the tag computed the long way, with libmp */
+static void
+reference(uchar *m, ulong len, uchar *key, uchar *digest)
+{
+	uchar k[16], blk[17];
+	mpint *r, *s, *h, *c, *p;
+	ulong n;
+
+	memmove(k, key, 16);
+	k[3] &= 15, k[7] &= 15, k[11] &= 15, k[15] &= 15;
+	k[4] &= 252, k[8] &= 252, k[12] &= 252;
+	r = letomp(k, 16, nil);
+	s = letomp(key+16, 16, nil);
+	p = mpnew(0);
+	mpleft(mpone, 130, p);
+	mpsub(p, itomp(5, c = mpnew(0)), p);
+	h = mpnew(0);
+	for(; len > 0; len -= n, m += n){
+		n = len < 16 ? len : 16;
+		memmove(blk, m, n);
+		blk[n] = 1;
+		letomp(blk, n+1, c);
+		mpadd(h, c, h);
+		mpmul(h, r, h);
+		mpmod(h, p, h);
+	}
+	mpadd(h, s, h);
+	mptolel(h, digest, 16);
+	mpfree(r);
+	mpfree(s);
+	mpfree(h);
+	mpfree(c);
+	mpfree(p);
+}
+
+/* len bytes in pieces of at most max */
+static void
+pieces(uchar *m, ulong len, uchar *key, uchar *digest, ulong max)
+{
+	DigestState s;
+	ulong n;
+
+	memset(&s, 0, sizeof s);
+	for(; len > 0; len -= n, m += n){
+		n = rnd() % (max+1);
+		if(n > len)
+			n = len;
+		poly1305(m, n, key, 32, nil, &s);
+	}
+	poly1305(nil, 0, key, 32, digest, &s);
+}
+
+static void
+randomtest(int trials)
+{
+	static ulong lens[] = {
+		0, 1, 15, 16, 17, 31, 32, 63, 64, 65,
+		255, 256, 257, 271, 272, 319, 320, 511, 512, 513,
+		1000, 1024, 4096, 8192+13, 16384+5,
+	};
+	static uchar buf[16384+5];
+	uchar key[32], want[16], d[16];
+	int i, j;
+	ulong n;
+
+	for(i = 0; i < trials; i++){
+		for(j = 0; j < nelem(lens); j++){
+			n = lens[j];
+			fill(key, sizeof key);
+			fill(buf, n);
+			switch(i){
+			case 1:
+				memset(buf, 0xff, n);
+				break;
+			case 2:
+				memset(key, 0xff, sizeof key);
+				break;
+			case 3:
+				memset(buf, 0xff, n);
+				memset(key, 0xff, sizeof key);
+				break;
+			}
+			reference(buf, n, key, want);
+
+			poly1305(buf, n, key, 32, d, nil);
+			check("whole", i, n, d, want);
+			pieces(buf, n, key, d, 255);
+			check("pieces", i, n, d, want);
+			pieces(buf, n, key, d, n);
+			check("split", i, n, d, want);
+		}
+	}
+	print("%d random trials of %d lengths\n", trials, nelem(lens));
+}
+
+static void
+usage(void)
+{
+	fprint(2, "usage: poly1305test [-n trials]\n");
+	exits("usage");
+}
+
+int
+main(int argc, char **argv)
+{
+	int trials;
+
+	trials = 50;
+	ARGBEGIN{
+	case 'n':
+		trials = atoi(EARGF(usage()));
+		break;
+	default:
+		usage();
+	}ARGEND
+	if(argc != 0)
+		usage();
+
+	fmtinstall('H', encodefmt);
+#if defined(__GNUC__) && defined(__x86_64__)
+	print("avx2 %s\n", __builtin_cpu_supports("avx2") ? "yes" : "no");
+#endif
+	vectortest();
+	randomtest(trials);
+	if(nfail){
+		print("%d failed\n", nfail);
+		exits("fail");
+	}
+	print("ok\n");
+	exits(0);
+}
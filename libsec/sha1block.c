@@ -7,6 +7,9 @@
 #define F2(x,y,z)	(0x8f1bbcdc + (((x) & (y)) | (((x) | (y)) & (z))))
 #define F3(x,y,z)	(0xca62c1d6 + ((x) ^ (y) ^ (z)))
 
+/* from shani.$O */
+extern int _sha1ni(uchar*, ulong, u32int*);
+
 void
 _sha1block(uchar *p, ulong len, u32int *s)
 {
@@ -14,6 +17,8 @@ _sha1block(uchar *p, ulong len, u32int *s)
 	uchar *end;
 
 	/* at this point, we have a multiple of 64 bytes */
+	if(_sha1ni(p, len, s))
+		return;
 	for(end = p+len; p < end;){
 		a = s[0];
 		b = s[1];
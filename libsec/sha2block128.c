@@ -42,6 +42,9 @@ static u64int K512[80] = {
 	0x4cc5d4becb3e42b6LL, 0x597f299cfc657e2aLL, 0x5fcb6fab3ad6faecLL, 0x6c44198c4a475817LL
 };
 
+/* from sha512simd.$O */
+extern int _sha512avx2(uchar*, ulong, u64int*);
+
 void
 _sha2block128(uchar *p, ulong len, u64int *s)
 {
@@ -49,6 +52,8 @@ _sha2block128(uchar *p, ulong len, u64int *s)
 	uchar *end;
 
 	/* at this point, we have a multiple of 64 bytes */
+	if(_sha512avx2(p, len, s))
+		return;
 	for(end = p+len; p < end;){
 		a = s[0];
 		b = s[1];
@@ -62,7 +67,7 @@ _sha2block128(uchar *p, ulong len, u64int *s)
 #define STEP(a,b,c,d,e,f,g,h,i) \
 	if(i < 16) { \
 		w[i] = 	(u64int)(p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3])<<32 | \
-			(p[4]<<24 | p[5]<<16 | p[6]<<8 | p[7]); \
+			(u32int)(p[4]<<24 | p[5]<<16 | p[6]<<8 | p[7]); \
 		p += 8; \
 	} else { \
 		u64int s0, s1; \
@@ -38,6 +38,9 @@ static u32int K256[64] = {
 	0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2,
 };
 
+/* from shani.$O */
+extern int _sha256ni(uchar*, ulong, u32int*);
+
 void
 _sha2block64(uchar *p, ulong len, u32int *s)
 {
@@ -45,6 +48,8 @@ _sha2block64(uchar *p, ulong len, u32int *s)
 	uchar *end;
 
 	/* at this point, we have a multiple of 64 bytes */
+	if(_sha256ni(p, len, s))
+		return;
 	for(end = p+len; p < end;){
 		a = s[0];
 		b = s[1];
@@ -0,0 +1,159 @@
+/*
+ * SHA-512 blocks with the message schedule in AVX2.
+ * Each step makes four words: w[t-16], σ0(w[t-15]) and
+ * w[t-7] are known for all four, but σ1 wants w[t-2],
+ * so the two low words are finished first and feed the
+ * two high ones.  K is added in the vectors too, and the
+ * rounds, still scalar, take w+K from memory.  Each group
+ * of eight rounds makes the eight words needed sixteen
+ * rounds on, so the vector work fills the gaps in the
+ * rounds' dependency chain; with BMI2 the compiler can
+ * do their rotates with rorx.
+ * _sha512avx2 returns 0 when the cpu lacks either, and
+ * _sha2block128 then does the work itself.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SIMDX86
+#endif
+
+#include "os.h"
+
+#ifdef SIMDX86
+
+#define AVX2 __attribute__((target("avx2,bmi2")))
+
+#define ROTR(x,n)	(((x) >> (n)) | ((x) << (64-(n))))
+#define SIGMA0(x)	(ROTR((x),28) ^ ROTR((x),34) ^ ROTR((x),39))
+#define SIGMA1(x)	(ROTR((x),14) ^ ROTR((x),18) ^ ROTR((x),41))
+#define Ch(x,y,z)	((z) ^ ((x) & ((y) ^ (z))))
+#define Maj(x,y,z)	(((x) | (y)) & ((z) | ((x) & (y))))
+
+/*
+ * first 64 bits of the fractional parts of cube roots of
+ * first 80 primes (2..311).
+ */
+static u64int K512[80] = {
+	0x428a2f98d728ae22LL, 0x7137449123ef65cdLL, 0xb5c0fbcfec4d3b2fLL, 0xe9b5dba58189dbbcLL,
+	0x3956c25bf348b538LL, 0x59f111f1b605d019LL, 0x923f82a4af194f9bLL, 0xab1c5ed5da6d8118LL,
+	0xd807aa98a3030242LL, 0x12835b0145706fbeLL, 0x243185be4ee4b28cLL, 0x550c7dc3d5ffb4e2LL,
+	0x72be5d74f27b896fLL, 0x80deb1fe3b1696b1LL, 0x9bdc06a725c71235LL, 0xc19bf174cf692694LL,
+	0xe49b69c19ef14ad2LL, 0xefbe4786384f25e3LL, 0x0fc19dc68b8cd5b5LL, 0x240ca1cc77ac9c65LL,
+	0x2de92c6f592b0275LL, 0x4a7484aa6ea6e483LL, 0x5cb0a9dcbd41fbd4LL, 0x76f988da831153b5LL,
+	0x983e5152ee66dfabLL, 0xa831c66d2db43210LL, 0xb00327c898fb213fLL, 0xbf597fc7beef0ee4LL,
+	0xc6e00bf33da88fc2LL, 0xd5a79147930aa725LL, 0x06ca6351e003826fLL, 0x142929670a0e6e70LL,
+	0x27b70a8546d22ffcLL, 0x2e1b21385c26c926LL, 0x4d2c6dfc5ac42aedLL, 0x53380d139d95b3dfLL,
+	0x650a73548baf63deLL, 0x766a0abb3c77b2a8LL, 0x81c2c92e47edaee6LL, 0x92722c851482353bLL,
+	0xa2bfe8a14cf10364LL, 0xa81a664bbc423001LL, 0xc24b8b70d0f89791LL, 0xc76c51a30654be30LL,
+	0xd192e819d6ef5218LL, 0xd69906245565a910LL, 0xf40e35855771202aLL, 0x106aa07032bbd1b8LL,
+	0x19a4c116b8d2d0c8LL, 0x1e376c085141ab53LL, 0x2748774cdf8eeb99LL, 0x34b0bcb5e19b48a8LL,
+	0x391c0cb3c5c95a63LL, 0x4ed8aa4ae3418acbLL, 0x5b9cca4f7763e373LL, 0x682e6ff3d6b2b8a3LL,
+	0x748f82ee5defb2fcLL, 0x78a5636f43172f60LL, 0x84c87814a1f0ab72LL, 0x8cc702081a6439ecLL,
+	0x90befffa23631e28LL, 0xa4506cebde82bde9LL, 0xbef9a3f7b2c67915LL, 0xc67178f2e372532bLL,
+	0xca273eceea26619cLL, 0xd186b8c721c0c207LL, 0xeada7dd6cde0eb1eLL, 0xf57d4f7fee6ed178LL,
+	0x06f067aa72176fbaLL, 0x0a637dc5a2c898a6LL, 0x113f9804bef90daeLL, 0x1b710b35131c471bLL,
+	0x28db77f523047d84LL, 0x32caab7b40c72493LL, 0x3c9ebe0a15c9bebcLL, 0x431d67c49c100d4cLL,
+	0x4cc5d4becb3e42b6LL, 0x597f299cfc657e2aLL, 0x5fcb6fab3ad6faecLL, 0x6c44198c4a475817LL
+};
+
+/* no 64 bit rotates short of AVX-512 */
+#define VROTR(x, n)	_mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64-(n)))
+#define VSIGMA0(x)	_mm256_xor_si256(_mm256_xor_si256(VROTR(x, 1), VROTR(x, 8)), _mm256_srli_epi64(x, 7))
+#define VSIGMA1(x)	_mm256_xor_si256(_mm256_xor_si256(VROTR(x, 19), VROTR(x, 61)), _mm256_srli_epi64(x, 6))
+
+#define ROUND(a,b,c,d,e,f,g,h,i) \
+	h += SIGMA1(e) + Ch(e,f,g) + wk[i]; \
+	d += h; \
+	h += SIGMA0(a) + Maj(a,b,c);
+
+/* w[i] to w[i+3] and wk[i] to wk[i+3] */
+#define SCHED(i) \
+	x = _mm256_add_epi64(_mm256_loadu_si256((__m256i*)&w[(i)-16]), \
+		VSIGMA0(_mm256_loadu_si256((__m256i*)&w[(i)-15]))); \
+	x = _mm256_add_epi64(x, _mm256_loadu_si256((__m256i*)&w[(i)-7])); \
+	y = _mm256_castsi128_si256(_mm_loadu_si128((__m128i*)&w[(i)-2])); \
+	lo = _mm256_add_epi64(x, VSIGMA1(y)); \
+	y = _mm256_permute4x64_epi64(lo, 0x40); \
+	x = _mm256_blend_epi32(lo, _mm256_add_epi64(x, VSIGMA1(y)), 0xf0); \
+	_mm256_storeu_si256((__m256i*)&w[i], x); \
+	_mm256_storeu_si256((__m256i*)&wk[i], \
+		_mm256_add_epi64(x, _mm256_loadu_si256((__m256i*)&K512[i])));
+
+AVX2 static void
+sha512blocks(uchar *p, ulong len, u64int *s)
+{
+	__m256i bswap, x, y, lo;
+	u64int w[80], wk[80], a, b, c, d, e, f, g, h;
+	uchar *end;
+	int i;
+
+	bswap = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+		7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	for(end = p+len; p < end; p += 128){
+		for(i = 0; i < 16; i += 4){
+			x = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i*)(p+8*i)), bswap);
+			_mm256_storeu_si256((__m256i*)&w[i], x);
+			_mm256_storeu_si256((__m256i*)&wk[i],
+				_mm256_add_epi64(x, _mm256_loadu_si256((__m256i*)&K512[i])));
+		}
+		a = s[0];
+		b = s[1];
+		c = s[2];
+		d = s[3];
+		e = s[4];
+		f = s[5];
+		g = s[6];
+		h = s[7];
+		for(i = 0; i < 80; i += 8){
+			if(i < 64){
+				SCHED(i+16)
+				SCHED(i+20)
+			}
+			ROUND(a,b,c,d,e,f,g,h,i)
+			ROUND(h,a,b,c,d,e,f,g,i+1)
+			ROUND(g,h,a,b,c,d,e,f,i+2)
+			ROUND(f,g,h,a,b,c,d,e,i+3)
+			ROUND(e,f,g,h,a,b,c,d,i+4)
+			ROUND(d,e,f,g,h,a,b,c,i+5)
+			ROUND(c,d,e,f,g,h,a,b,i+6)
+			ROUND(b,c,d,e,f,g,h,a,i+7)
+		}
+		s[0] += a;
+		s[1] += b;
+		s[2] += c;
+		s[3] += d;
+		s[4] += e;
+		s[5] += f;
+		s[6] += g;
+		s[7] += h;
+	}
+}
+
+#undef ROUND
+#undef SCHED
+
+int
+_sha512avx2(uchar *p, ulong len, u64int *s)
+{
+	static int avx2 = -1;
+
+	if(avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+	if(!avx2)
+		return 0;
+	sha512blocks(p, len, s);
+	return 1;
+}
+
+#else
+
+int
+_sha512avx2(uchar *p, ulong len, u64int *s)
+{
+	USED(p);
+	USED(len);
+	USED(s);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * SHA-1 and SHA-256 blocks with the cpu's SHA instructions:
+ * the SHA extensions on amd64 and the ARMv8 Cryptography
+ * Extension on arm64.  _sha1ni and _sha256ni return 0 when
+ * the cpu has no such instructions, and _sha1block and
+ * _sha2block64 then do the work themselves.
+ *
+ * The arm64 code has yet to be run on an arm64 cpu and is
+ * only compiled with -DARM64SIMD.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SHAX86
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(ARM64SIMD)
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define SHAARM
+#endif
+
+#include "os.h"
+
+#if defined(SHAX86) || defined(SHAARM)
+
+/*
+ * first 32 bits of the fractional parts of cube roots of
+ * first 64 primes (2..311).
+ */
+static u32int K256[64] = {
+	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,
+	0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+	0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,
+	0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+	0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,
+	0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+	0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,
+	0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+	0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,
+	0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+	0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,
+	0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+	0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,
+	0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,
+	0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2,
+};
+
+#endif
+
+#ifdef SHAX86
+
+#define SHANI __attribute__((target("sha,sse4.1")))
+
+/*
+ * Rounds 4g to 4g+3, w[g&3] holding their message words.
+ * sha1msg1, the xor and sha1msg2 build w[g+4] from
+ * w[g] to w[g+3] over the groups before it is needed.
+ */
+#define SHA1GROUP(g, f) \
+	if((g) < 4) \
+		w[(g)&3] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(p+16*(g))), bswap); \
+	if((g) == 0) \
+		e[0] = _mm_add_epi32(e[0], w[0]); \
+	else \
+		e[(g)&1] = _mm_sha1nexte_epu32(e[(g)&1], w[(g)&3]); \
+	e[((g)+1)&1] = abcd; \
+	if((g) >= 3 && (g) <= 18) \
+		w[((g)+1)&3] = _mm_sha1msg2_epu32(w[((g)+1)&3], w[(g)&3]); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e[(g)&1], f); \
+	if((g) >= 1 && (g) <= 16) \
+		w[((g)-1)&3] = _mm_sha1msg1_epu32(w[((g)-1)&3], w[(g)&3]); \
+	if((g) >= 2 && (g) <= 17) \
+		w[((g)+2)&3] = _mm_xor_si128(w[((g)+2)&3], w[(g)&3]);
+
+SHANI static void
+sha1blocks(uchar *p, ulong len, u32int *s)
+{
+	__m128i abcd, abcd0, e[2], e0, w[4], bswap;
+	uchar *end;
+
+	bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)s), 0x1b);
+	e[0] = _mm_set_epi32(s[4], 0, 0, 0);
+	for(end = p+len; p < end; p += 64){
+		abcd0 = abcd;
+		e0 = e[0];
+		SHA1GROUP(0, 0) SHA1GROUP(1, 0) SHA1GROUP(2, 0) SHA1GROUP(3, 0) SHA1GROUP(4, 0)
+		SHA1GROUP(5, 1) SHA1GROUP(6, 1) SHA1GROUP(7, 1) SHA1GROUP(8, 1) SHA1GROUP(9, 1)
+		SHA1GROUP(10, 2) SHA1GROUP(11, 2) SHA1GROUP(12, 2) SHA1GROUP(13, 2) SHA1GROUP(14, 2)
+		SHA1GROUP(15, 3) SHA1GROUP(16, 3) SHA1GROUP(17, 3) SHA1GROUP(18, 3) SHA1GROUP(19, 3)
+		e[0] = _mm_sha1nexte_epu32(e[0], e0);
+		abcd = _mm_add_epi32(abcd, abcd0);
+	}
+	_mm_storeu_si128((__m128i*)s, _mm_shuffle_epi32(abcd, 0x1b));
+	s[4] = _mm_extract_epi32(e[0], 3);
+}
+
+#undef SHA1GROUP
+
+/*
+ * The state is kept as ABEF and CDGH, the way
+ * sha256rnds2 wants it; each group of four rounds
+ * takes two.  w[g&3] works as for SHA-1.
+ */
+SHANI static void
+sha256blocks(uchar *p, ulong len, u32int *s)
+{
+	__m128i abef, cdgh, abef0, cdgh0, m, t, w[4], bswap;
+	uchar *end;
+	int g;
+
+	bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	t = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)&s[0]), 0xb1);	/* cdab */
+	cdgh = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*)&s[4]), 0x1b);	/* efgh */
+	abef = _mm_alignr_epi8(t, cdgh, 8);
+	cdgh = _mm_blend_epi16(cdgh, t, 0xf0);
+	for(end = p+len; p < end; p += 64){
+		abef0 = abef;
+		cdgh0 = cdgh;
+#pragma GCC unroll 16
+		for(g = 0; g < 16; g++){
+			if(g < 4)
+				w[g] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(p+16*g)), bswap);
+			m = _mm_add_epi32(w[g&3], _mm_loadu_si128((__m128i*)&K256[4*g]));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, m);
+			if(g >= 3 && g <= 14){
+				t = _mm_alignr_epi8(w[g&3], w[(g-1)&3], 4);
+				w[(g+1)&3] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(g+1)&3], t), w[g&3]);
+			}
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(m, 0x0e));
+			if(g >= 1 && g <= 12)
+				w[(g-1)&3] = _mm_sha256msg1_epu32(w[(g-1)&3], w[g&3]);
+		}
+		abef = _mm_add_epi32(abef, abef0);
+		cdgh = _mm_add_epi32(cdgh, cdgh0);
+	}
+	t = _mm_shuffle_epi32(abef, 0x1b);	/* feba */
+	cdgh = _mm_shuffle_epi32(cdgh, 0xb1);	/* dchg */
+	_mm_storeu_si128((__m128i*)&s[0], _mm_blend_epi16(t, cdgh, 0xf0));
+	_mm_storeu_si128((__m128i*)&s[4], _mm_alignr_epi8(cdgh, t, 8));
+}
+
+static int
+hassha(void)
+{
+	return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+}
+
+#endif	/* SHAX86 */
+
+#ifdef SHAARM
+
+#ifdef __clang__
+#define SHACE __attribute__((target("crypto")))
+#else
+#define SHACE __attribute__((target("+crypto")))
+#endif
+
+#define LOADBE(p)	vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)))
+
+SHACE static void
+sha1blocks(uchar *p, ulong len, u32int *s)
+{
+	static u32int K[4] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+	uint32x4_t abcd, abcd0, w[4], t;
+	u32int e, e0, e1;
+	uchar *end;
+	int g;
+
+	abcd = vld1q_u32(s);
+	e = s[4];
+	for(end = p+len; p < end; p += 64){
+		abcd0 = abcd;
+		e0 = e;
+		w[0] = LOADBE(p);
+		w[1] = LOADBE(p+16);
+		w[2] = LOADBE(p+32);
+		w[3] = LOADBE(p+48);
+#pragma GCC unroll 20
+		for(g = 0; g < 20; g++){
+			t = vaddq_u32(w[g&3], vdupq_n_u32(K[g/5]));
+			e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+			if(g < 5)
+				abcd = vsha1cq_u32(abcd, e, t);
+			else if(g < 10 || g >= 15)
+				abcd = vsha1pq_u32(abcd, e, t);
+			else
+				abcd = vsha1mq_u32(abcd, e, t);
+			e = e1;
+			if(g < 16)
+				w[g&3] = vsha1su1q_u32(vsha1su0q_u32(w[g&3], w[(g+1)&3], w[(g+2)&3]), w[(g+3)&3]);
+		}
+		abcd = vaddq_u32(abcd, abcd0);
+		e += e0;
+	}
+	vst1q_u32(s, abcd);
+	s[4] = e;
+}
+
+SHACE static void
+sha256blocks(uchar *p, ulong len, u32int *s)
+{
+	uint32x4_t abcd, efgh, abcd0, efgh0, w[4], t, a;
+	uchar *end;
+	int g;
+
+	abcd = vld1q_u32(&s[0]);
+	efgh = vld1q_u32(&s[4]);
+	for(end = p+len; p < end; p += 64){
+		abcd0 = abcd;
+		efgh0 = efgh;
+		w[0] = LOADBE(p);
+		w[1] = LOADBE(p+16);
+		w[2] = LOADBE(p+32);
+		w[3] = LOADBE(p+48);
+#pragma GCC unroll 16
+		for(g = 0; g < 16; g++){
+			t = vaddq_u32(w[g&3], vld1q_u32(&K256[4*g]));
+			if(g < 12)
+				w[g&3] = vsha256su0q_u32(w[g&3], w[(g+1)&3]);
+			a = abcd;
+			abcd = vsha256hq_u32(abcd, efgh, t);
+			efgh = vsha256h2q_u32(efgh, a, t);
+			if(g < 12)
+				w[g&3] = vsha256su1q_u32(w[g&3], w[(g+2)&3], w[(g+3)&3]);
+		}
+		abcd = vaddq_u32(abcd, abcd0);
+		efgh = vaddq_u32(efgh, efgh0);
+	}
+	vst1q_u32(&s[0], abcd);
+	vst1q_u32(&s[4], efgh);
+}
+
+#undef LOADBE
+
+static int
+hassha(void)
+{
+#if defined(__linux__) && defined(HWCAP_SHA1) && defined(HWCAP_SHA2)
+	return (getauxval(AT_HWCAP) & (HWCAP_SHA1|HWCAP_SHA2)) == (HWCAP_SHA1|HWCAP_SHA2);
+#elif defined(__APPLE__)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+#endif	/* SHAARM */
+
+#if defined(SHAX86) || defined(SHAARM)
+
+static int sha = -1;
+
+int
+_sha1ni(uchar *p, ulong len, u32int *s)
+{
+	if(sha < 0)
+		sha = hassha();
+	if(!sha)
+		return 0;
+	sha1blocks(p, len, s);
+	return 1;
+}
+
+int
+_sha256ni(uchar *p, ulong len, u32int *s)
+{
+	if(sha < 0)
+		sha = hassha();
+	if(!sha)
+		return 0;
+	sha256blocks(p, len, s);
+	return 1;
+}
+
+#else
+
+int
+_sha1ni(uchar *p, ulong len, u32int *s)
+{
+	USED(p);
+	USED(len);
+	USED(s);
+	return 0;
+}
+
+int
+_sha256ni(uchar *p, ulong len, u32int *s)
+{
+	USED(p);
+	USED(len);
+	USED(s);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,640 @@
+/*
+ * mnttest [-S] [-d delay] [-M flags] [-n mbytes]
+ *
+ * Mounts this kernel's own namespace, served by exportfs,
+ * on /mnt through a relay that holds every message for
+ * delay ms, with the devmnt options given as for drawterm -M.
+ * With -S exportfs talks to the relay over a host socket
+ * pair and splices file reads to it, as drawterm -Z does.
+ * It then reads and writes, through the mount, a file of
+ * mbytes of pseudo-random data made under /root/tmp, and
+ * checks each result against the file read directly, and
+ * that failed writes to /dev/full are reported.  It also
+ * reads the file from several processes at once, reads it
+ * again, to see the cache used if the options ask for it,
+ * and after changing it directly, and reads it at and past
+ * its end, to see replies spliced with -S.  Last it unmounts, which
+ * must shut the mount down.  One line is
+ * printed per check, and #c/mntstat before the unmount.
+ * The exit status is non-empty if any check failed.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "u.h"
+#include "lib.h"
+#include "kern/dat.h"
+#include "kern/fns.h"
+#include "user.h"
+#include "args.h"
+#include "drawterm.h"
+
+char *argv0;
+
+enum
+{
+	Nrelay	= 1024,		/* messages a relay holds */
+	Maxmsg	= 70000,
+};
+
+typedef struct Relay Relay;
+struct Relay
+{
+	int	in;
+	int	out;
+	Lock	lk;
+	struct {
+		uchar	*p;
+		int	n;
+		ulong	t;
+	} q[Nrelay];
+	int	h;
+	int	t;
+};
+
+static int	delay;
+static char	*path;		/* the file, directly */
+static char	*mpath;		/* the file, through /mnt */
+static char	*opath;		/* a copy of it */
+static char	*ompath;
+static int	nfail;
+static int	mfd;		/* the mount's channel */
+static int	mflag;		/* its options */
+static int	sflag;		/* exportfs on a socket, splicing */
+
+static struct {
+	Lock	lk;
+	ulong	sum;
+	vlong	n;
+	int	done;
+	int	bad;
+} conc;
+
+static void
+relayrd(void *a)
+{
+	Relay *r;
+	uchar *p;
+	int n;
+
+	r = a;
+	for(;;){
+		p = malloc(Maxmsg);
+		n = read(r->in, p, Maxmsg);
+		if(n <= 0)
+			pexit("", 0);
+		for(;;){
+			lock(&r->lk);
+			if(r->t - r->h < Nrelay)
+				break;
+			unlock(&r->lk);
+			osmsleep(1);
+		}
+		r->q[r->t%Nrelay].p = p;
+		r->q[r->t%Nrelay].n = n;
+		r->q[r->t%Nrelay].t = ticks() + delay;
+		r->t++;
+		unlock(&r->lk);
+	}
+}
+
+static void
+relaywr(void *a)
+{
+	Relay *r;
+	uchar *p;
+	ulong t;
+	int n;
+
+	r = a;
+	for(;;){
+		lock(&r->lk);
+		if(r->h == r->t){
+			unlock(&r->lk);
+			osmsleep(1);
+			continue;
+		}
+		p = r->q[r->h%Nrelay].p;
+		n = r->q[r->h%Nrelay].n;
+		t = r->q[r->h%Nrelay].t;
+		unlock(&r->lk);
+		while((long)(ticks() - t) < 0)
+			osmsleep(1);
+		if(write(r->out, p, n) != n)
+			pexit("", 0);
+		free(p);
+		lock(&r->lk);
+		r->h++;
+		unlock(&r->lk);
+	}
+}
+
+static void
+relay(int in, int out)
+{
+	Relay *r;
+
+	r = mallocz(sizeof *r, 1);
+	r->in = in;
+	r->out = out;
+	kproc("relayrd", relayrd, r);
+	kproc("relaywr", relaywr, r);
+}
+
+static void
+srvproc(void *a)
+{
+	int fd;
+
+	fd = (int)(uintptr)a;
+	exportfs(fd, fd);
+}
+
+static void
+result(char *name, int ok, ulong t0)
+{
+	print("%-28s %s %lud ms\n", name, ok ? "ok" : "FAIL", ticks()-t0);
+	if(!ok)
+		nfail++;
+}
+
+/* sum of the file read bs bytes at a time */
+static ulong
+sum(char *file, int bs, vlong *tot)
+{
+	int fd, n, i;
+	uchar *buf;
+	ulong s;
+
+	*tot = -1;
+	if((fd = open(file, OREAD)) < 0)
+		return 0;
+	buf = malloc(bs);
+	s = 0;
+	*tot = 0;
+	while((n = read(fd, buf, bs)) > 0){
+		for(i = 0; i < n; i++)
+			s = s*31 + buf[i];
+		*tot += n;
+	}
+	if(n < 0)
+		*tot = -1;
+	close(fd);
+	free(buf);
+	return s;
+}
+
+/* make a new file to test with, set path to its name */
+static void
+mkfile(vlong len)
+{
+	uchar buf[8192];
+	ulong x;
+	int fd, i;
+	vlong n;
+
+	for(i = 0; ; i++){
+		path = smprint("/root/tmp/mnttest.%d", i);
+		if((fd = create(path, OWRITE|OEXCL, 0666)) >= 0)
+			break;
+		if(i == 1000)
+			panic("create %s: %r", path);
+		free(path);
+	}
+	x = 1;
+	for(n = 0; n < len; n += sizeof buf){
+		for(i = 0; i < sizeof buf; i++){
+			x = x*1103515245 + 12345;
+			buf[i] = x>>16;
+		}
+		if(write(fd, buf, sizeof buf) != sizeof buf)
+			panic("write %s: %r", path);
+	}
+	close(fd);
+}
+
+static void
+seqread(void)
+{
+	static int bs[] = {8192, 1000, 65536, 24000};
+	char name[32];
+	vlong n0, n1;
+	ulong s0, s1, t0;
+	int i;
+
+	for(i = 0; i < nelem(bs); i++){
+		s0 = sum(path, bs[i], &n0);
+		t0 = ticks();
+		s1 = sum(mpath, bs[i], &n1);
+		snprint(name, sizeof name, "read bs %d", bs[i]);
+		result(name, s0 == s1 && n0 == n1, t0);
+	}
+}
+
+/* runs of sequential reads from scattered offsets */
+static void
+scatter(void)
+{
+	uchar x[5000], y[5000];
+	int fd, fd2, i, n, k, ok;
+	ulong t0;
+	vlong off;
+
+	fd = open(mpath, OREAD);
+	fd2 = open(path, OREAD);
+	t0 = ticks();
+	ok = fd >= 0 && fd2 >= 0;
+	off = 0;
+	for(i = 0; ok && i < 2000; i++){
+		if(i%7 == 0)
+			off = ((i*7919)%100000)*37;
+		n = sizeof x - (i%5)*900;
+		k = pread(fd, x, n, off);
+		if(pread(fd2, y, n, off) != k || k < 0 || memcmp(x, y, k) != 0)
+			ok = 0;
+		off += k;
+	}
+	result("pread scattered", ok, t0);
+	close(fd);
+	close(fd2);
+}
+
+/* copy the file through the mount, bs bytes at a time */
+static void
+seqwrite(void)
+{
+	static int bs[] = {8192, 1000, 65536};
+	char name[32];
+	uchar *buf;
+	vlong n0, n1;
+	ulong s0, s1, t0;
+	int fd, ofd, i, n, ok;
+
+	buf = malloc(65536);
+	s0 = sum(path, 8192, &n0);
+	for(i = 0; i < nelem(bs); i++){
+		snprint(name, sizeof name, "write bs %d", bs[i]);
+		t0 = ticks();
+		if((fd = open(path, OREAD)) < 0 || (ofd = create(ompath, OWRITE, 0666)) < 0){
+			result(name, 0, t0);
+			close(fd);
+			continue;
+		}
+		ok = 1;
+		while(ok && (n = read(fd, buf, bs[i])) > 0)
+			ok = write(ofd, buf, n) == n;
+		ok &= close(ofd) == 0;
+		close(fd);
+		s1 = sum(opath, 8192, &n1);
+		result(name, ok && s0 == s1 && n0 == n1, t0);
+	}
+	free(buf);
+}
+
+/* overwrite part of the copy and read it back on the same fd */
+static void
+modify(void)
+{
+	uchar x[3000], y[3000];
+	vlong n0, n1;
+	ulong s0, s1, t0;
+	int fd, ok;
+
+	t0 = ticks();
+	memset(x, 'x', sizeof x);
+	fd = open(ompath, ORDWR);
+	ok = fd >= 0
+		&& pwrite(fd, x, sizeof x, 10000) == sizeof x
+		&& pread(fd, y, sizeof y, 10000) == sizeof y
+		&& memcmp(x, y, sizeof x) == 0;
+	ok &= close(fd) == 0;
+	s0 = sum(opath, 8192, &n0);
+	s1 = sum(ompath, 8192, &n1);
+	result("write and read back", ok && s0 == s1 && n0 == n1, t0);
+}
+
+static int
+wsync(int fd)
+{
+	Dir d;
+
+	memset(&d, ~0, sizeof d);
+	d.name = d.uid = d.gid = d.muid = "";
+	return dirfwstat(fd, &d);
+}
+
+/*
+ * Writes to /dev/full fail.  With write-behind the error
+ * may come back from a later write or a wstat, but it must
+ * come back.  (Close, as in Plan 9, discards it.)
+ */
+static void
+full(void)
+{
+	static char dev[] = "/mnt/root/dev/full";
+	uchar buf[20000];
+	ulong t0;
+	int fd, i, ok;
+
+	memset(buf, 0, sizeof buf);
+	t0 = ticks();
+	ok = 0;
+	if((fd = open(dev, OWRITE)) >= 0){
+		for(i = 0; i < 6; i++)
+			if(write(fd, buf, sizeof buf) < 0)
+				ok = 1;
+		ok |= wsync(fd) < 0;
+		close(fd);
+	}
+	result("full: writes, wstat", ok, t0);
+
+	t0 = ticks();
+	ok = 0;
+	if((fd = open(dev, OWRITE)) >= 0){
+		ok = write(fd, buf, sizeof buf) < 0;
+		ok |= wsync(fd) < 0;
+		close(fd);
+	}
+	result("full: write, wstat", ok, t0);
+}
+
+static char*	mntstat(void);
+
+static ulong
+cachehits(void)
+{
+	char *s;
+
+	if((s = strstr(mntstat(), "cache hits ")) == nil)
+		return 0;
+	return strtoul(s+11, nil, 10);
+}
+
+/*
+ * With MCACHE a second read comes from the cache, but a
+ * change made to the file behind the mount's back, which
+ * changes its mtime and so its qid.vers, is seen.
+ */
+static void
+cache(void)
+{
+	uchar buf[4096];
+	vlong n0, n1;
+	ulong s0, s1, h, t0;
+	int fd, ok;
+
+	s0 = sum(path, 8192, &n0);
+	sum(mpath, 8192, &n1);
+	h = cachehits();
+	t0 = ticks();
+	s1 = sum(mpath, 8192, &n1);
+	h = cachehits() - h;
+	ok = s0 == s1 && n0 == n1;
+	if(mflag&MCACHE)
+		ok &= h >= n0/8192;
+	else
+		ok &= h == 0;
+	result("reread", ok, t0);
+
+	/* mtime has a granularity of a second */
+	osmsleep(1100);
+	memset(buf, 'y', sizeof buf);
+	if((fd = open(path, OWRITE)) >= 0){
+		pwrite(fd, buf, sizeof buf, 5000);
+		close(fd);
+	}
+	s0 = sum(path, 8192, &n0);
+	t0 = ticks();
+	s1 = sum(mpath, 8192, &n1);
+	result("reread after change", s0 == s1 && n0 == n1, t0);
+}
+
+static ulong
+spliced(void)
+{
+	char *s;
+
+	if((s = strstr(mntstat(), "spliced ")) == nil)
+		return 0;
+	return strtoul(s+8, nil, 10);
+}
+
+/*
+ * With -S, exportfs answers reads of the file by splicing
+ * the data from it to the socket.  Reads must come back
+ * the same, short at the end of the file and empty at or
+ * past it.  Without -S nothing is spliced.
+ */
+static void
+splicereads(void)
+{
+	uchar buf[8192], mbuf[8192];
+	vlong n0, n1;
+	ulong s0, s1, sp, t0;
+	int fd, mfd, n, m, ok;
+
+	s0 = sum(path, 8192, &n0);
+	sp = spliced();
+	t0 = ticks();
+	s1 = sum(mpath, 8192, &n1);
+	sp = spliced() - sp;
+	ok = s0 == s1 && n0 == n1;
+	if(!sflag)
+		ok &= sp == 0;
+	else if((mflag&MCACHE) == 0)	/* else the cache may have it all */
+		ok &= sp > 0;
+	result("spliced read", ok, t0);
+
+	sp = spliced();
+	t0 = ticks();
+	ok = 0;
+	if((fd = open(path, OREAD)) >= 0 && (mfd = open(mpath, OREAD)) >= 0){
+		n = pread(fd, buf, sizeof buf, n0-100);
+		m = pread(mfd, mbuf, sizeof mbuf, n0-100);
+		ok = n == 100 && m == n && memcmp(buf, mbuf, n) == 0;
+		ok &= pread(mfd, mbuf, 1, n0-1) == 1 && mbuf[0] == buf[99];
+		ok &= pread(mfd, mbuf, sizeof mbuf, n0) == 0;
+		ok &= pread(mfd, mbuf, sizeof mbuf, n0+5000) == 0;
+		close(mfd);
+	}
+	if(fd >= 0)
+		close(fd);
+	/* each of the four preads, empty replies too */
+	if(sflag && (mflag&(MCACHE|MRAH)) == 0)
+		ok &= spliced() - sp == 4;
+	result("short read, read at end", ok, t0);
+}
+
+static void
+creader(void *a)
+{
+	vlong n;
+	ulong s;
+
+	s = sum(mpath, (int)(uintptr)a, &n);
+	lock(&conc.lk);
+	if(s != conc.sum || n != conc.n)
+		conc.bad++;
+	conc.done++;
+	unlock(&conc.lk);
+	pexit("", 0);
+}
+
+/* readers sharing the mount, each with its own block size */
+static void
+concurrent(void)
+{
+	ulong t0;
+	int i;
+
+	conc.sum = sum(path, 8192, &conc.n);
+	t0 = ticks();
+	for(i = 0; i < 8; i++)
+		kproc("creader", creader, (void*)(uintptr)(1000+3000*i));
+	while(conc.done < 8)
+		osmsleep(10);
+	result("8 readers at once", conc.bad == 0, t0);
+}
+
+static char*
+mntstat(void)
+{
+	static char buf[2000];
+	int fd, n;
+
+	buf[0] = 0;
+	if((fd = open("#c/mntstat", OREAD)) < 0)
+		return buf;
+	if((n = read(fd, buf, sizeof buf-1)) > 0)
+		buf[n] = 0;
+	close(fd);
+	return buf;
+}
+
+static int	unmounted;
+
+static void
+unmounter(void *a)
+{
+	USED(a);
+	unmount(nil, "/mnt");
+	close(mfd);
+	unmounted = 1;
+	pexit("", 0);
+}
+
+/*
+ * Once nothing refers to it, the mount must go away,
+ * stopping its reader kproc if it has one.
+ */
+static void
+mntshutdown(void)
+{
+	ulong t0;
+	char *s;
+
+	t0 = ticks();
+	kproc("unmount", unmounter, nil);
+	for(;;){
+		s = mntstat();
+		if(unmounted && strstr(s, " gate queue ") == nil && strstr(s, " kproc queue ") == nil)
+			break;
+		if(ticks()-t0 > 5000){
+			result("unmount", 0, t0);
+			return;
+		}
+		osmsleep(10);
+	}
+	result("unmount", 1, t0);
+}
+
+static void
+usage(void)
+{
+	fprint(2, "usage: %s [-S] [-d delay] [-M flags] [-n mbytes]\n", argv0);
+	exits("usage");
+}
+
+int
+main(int argc, char **argv)
+{
+	extern ulong kerndate;
+	int pc[2], ps[2], sv[2], mb;
+
+	kerndate = seconds();
+	eve = getuser();
+	if(eve == nil)
+		eve = "drawterm";
+	osinit();
+	procinit0();
+	printinit();
+	chandevreset();
+	chandevinit();
+	quotefmtinstall();
+	if(bind("#c", "/dev", MBEFORE) < 0)
+		panic("bind #c: %r");
+	if(bind("#U", "/root", MREPL) < 0)
+		panic("bind #U: %r");
+
+	mb = 8;
+	ARGBEGIN{
+	case 'd':
+		delay = atoi(EARGF(usage()));
+		break;
+	case 'M':
+		if((mflag = mountflags(EARGF(usage()))) < 0)
+			usage();
+		break;
+	case 'n':
+		mb = atoi(EARGF(usage()));
+		break;
+	case 'S':
+		sflag = 1;
+		break;
+	default:
+		usage();
+	}ARGEND;
+	if(argc != 0 || mb <= 0)
+		usage();
+
+	mkfile((vlong)mb*1024*1024);
+	mpath = smprint("/mnt%s", path);
+	opath = smprint("%s.out", path);
+	ompath = smprint("/mnt%s", opath);
+
+	if(pipe(pc) < 0)
+		panic("pipe: %r");
+	if(sflag){
+		/* the host fds that exportfs can splice to */
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+			panic("socketpair failed");
+		ps[0] = lfdfd(sv[0]);
+		ps[1] = lfdfd(sv[1]);
+		exportsplice = 1;
+	}else if(pipe(ps) < 0)
+		panic("pipe: %r");
+	relay(pc[0], ps[1]);
+	relay(ps[1], pc[0]);
+	kproc("exportfs", srvproc, (void*)(uintptr)ps[0]);
+	mfd = pc[1];
+	if(mount(mfd, -1, "/mnt", MREPL|mflag, "") < 0)
+		panic("mount: %r");
+
+	seqread();
+	scatter();
+	seqwrite();
+	modify();
+	full();
+	concurrent();
+	cache();
+	splicereads();
+	print("%s", mntstat());
+	mntshutdown();
+
+	remove(path);
+	remove(opath);
+	if(nfail > 0)
+		exits("fail");
+	exits(0);
+	return 0;
+}